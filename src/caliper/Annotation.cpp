@@ -40,9 +40,11 @@
 #include <Log.h>
 #include <Variant.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstring>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace cali;
@@ -53,29 +55,127 @@ namespace cali
     extern Attribute loop_attr;
 }
 
+// --- Region handle
+
+namespace
+{
+    /// Per-thread context tree node caches, indexed by region handle
+    struct NodeCache {
+        Caliper::NodeCacheEntry* entries;
+        unsigned                 size;
+
+        ~NodeCache() {
+            delete[] entries;
+            entries = nullptr;
+            size    = 0;
+        }
+    };
+
+    thread_local NodeCache t_node_cache { nullptr, 0 };
+
+    std::atomic<unsigned>  s_num_region_handles { 0 };
+}
+
+struct RegionHandle::Impl {
+    std::string             name;
+    Variant                 data;
+    unsigned                index;
+    std::atomic<Attribute*> iter_attr;
+
+    Impl(const char* n)
+        : name(n),
+          data(CALI_TYPE_STRING, name.c_str(), name.size()),
+          index(s_num_region_handles++),
+          iter_attr(nullptr)
+        { }
+
+    /// \brief Return this thread's node cache entry for the region. 
+    ///   The pointer is invalidated by node_cache() calls for other regions.
+    Caliper::NodeCacheEntry* node_cache() {
+        NodeCache* c = &t_node_cache;
+
+        if (index >= c->size) {
+            unsigned size = std::max(std::max(2 * c->size, index + 1), 16u);
+            Caliper::NodeCacheEntry* entries = new Caliper::NodeCacheEntry[size]();
+
+            std::copy(c->entries, c->entries + c->size, entries);
+            delete[] c->entries;
+
+            c->entries = entries;
+            c->size    = size;
+        }
+
+        return c->entries + index;
+    }
+
+    Attribute iteration_attr(Caliper& c) {
+        Attribute* attr = iter_attr.load();
+
+        if (!attr) {
+            Attribute* new_attr = 
+                new Attribute(c.create_attribute(std::string("iteration#") + name, CALI_TYPE_INT, CALI_ATTR_ASVALUE));
+
+            // Set iter_attr. If it's not null, another thread has set it already
+            if (iter_attr.compare_exchange_strong(attr, new_attr))
+                attr = new_attr;
+            else
+                delete new_attr;
+        }
+
+        return *attr;
+    }
+};
+
+RegionHandle::RegionHandle(const char* name)
+    : pI(new Impl(name))
+{ }
+
+const char*
+RegionHandle::name() const
+{
+    return pI->name.c_str();
+}
+
 // --- Pre-defined Function annotation class
 
 Function::Function(const char* name)
+    : pH(0)
 {
     Caliper().begin(function_attr, Variant(CALI_TYPE_STRING, name, strlen(name)));
 }
 
+Function::Function(const RegionHandle& region)
+    : pH(&region)
+{
+    Caliper c;
+
+    c.begin(function_attr, pH->pI->data, pH->pI->node_cache());
+}
+
 Function::~Function()
 {
-    Caliper().end(function_attr);
+    if (pH)
+        Caliper().end(function_attr, pH->pI->node_cache());
+    else
+        Caliper().end(function_attr);
 }
         
 // --- Pre-defined loop annotation class
 
 struct Loop::Impl {
-    Attribute iter_attr;
-    int       level;
+    Attribute           iter_attr;
+    const RegionHandle* handle;
+    int                 level;
     
     Impl(const char* name)
-        : level(0) {
+        : handle(0), level(0) {
         iter_attr =
             Caliper().create_attribute(std::string("iteration#") + name, CALI_TYPE_INT, CALI_ATTR_ASVALUE);
     }
+
+    Impl(const Attribute& attr, const RegionHandle* region)
+        : iter_attr(attr), handle(region), level(0)
+        { }
 };
 
 Loop::Iteration::Iteration(const Impl* p, int i)
@@ -89,13 +189,38 @@ Loop::Iteration::~Iteration()
     Caliper().end(pI->iter_attr);
 }
 
-Loop::Loop(const char* name)
-    : pI(new Impl(name))
+void
+Loop::begin(const char* name)
 {
+    pI = new Impl(name);
+
     if (Caliper().begin(loop_attr, Variant(CALI_TYPE_STRING, name, strlen(name))) == CALI_SUCCESS)
         ++pI->level;
 }
 
+Loop::Loop(const char* name)
+    : pI(0)
+{
+    begin(name);
+}
+
+Loop::Loop(const RegionHandle& region, const char* name)
+    : pI(0)
+{
+    // The loop name might not be a constant: only use the handle if it matches
+    if (strcmp(name, region.pI->name.c_str()) != 0) {
+        begin(name);
+        return;
+    }
+
+    Caliper c;
+
+    pI = new Impl(region.pI->iteration_attr(c), &region);
+
+    if (c.begin(loop_attr, region.pI->data, region.pI->node_cache()) == CALI_SUCCESS)
+        ++pI->level;
+}
+
 Loop::~Loop()
 {
     end();
@@ -112,7 +237,11 @@ void
 Loop::end()
 {
     if (pI->level > 0) {
-        Caliper().end(loop_attr);
+        if (pI->handle)
+            Caliper().end(loop_attr, pI->handle->pI->node_cache());
+        else
+            Caliper().end(loop_attr);
+
         --(pI->level);
     }
 }
@@ -344,6 +473,77 @@ Annotation& Annotation::set(const Variant& data)
     return *this;
 }
 
+// --- batch updates
+
+namespace
+{
+
+typedef cali_err (Caliper::*BatchUpdateFn)(size_t, const Attribute[], const Variant[]);
+
+}
+
+struct Annotation::BatchUpdate {
+    static void apply(BatchUpdateFn fn, size_t n, Annotation* const annotations[], const Variant* data) {
+        const size_t MaxStackBatch = 16;
+
+        Caliper   c;
+
+        Attribute attr_buf[MaxStackBatch];
+        std::vector<Attribute> attr_vec;
+        Attribute* attr = attr_buf;
+
+        if (n > MaxStackBatch) {
+            attr_vec.resize(n);
+            attr = attr_vec.data();
+        }
+
+        // Attributes with a type mismatch are invalid and will be skipped
+        for (size_t i = 0; i < n; ++i) {
+            attr[i] = annotations[i]->pI->get_attribute(c, data[i].type());
+
+            if (attr[i].type() != data[i].type())
+                attr[i] = Attribute::invalid;
+        }
+
+        (c.*fn)(n, attr, data);
+    }
+
+    static void end(size_t n, Annotation* const annotations[]) {
+        const size_t MaxStackBatch = 16;
+
+        Caliper   c;
+
+        Attribute attr_buf[MaxStackBatch];
+        std::vector<Attribute> attr_vec;
+        Attribute* attr = attr_buf;
+
+        if (n > MaxStackBatch) {
+            attr_vec.resize(n);
+            attr = attr_vec.data();
+        }
+
+        for (size_t i = 0; i < n; ++i)
+            attr[i] = annotations[i]->pI->get_attribute(c);
+
+        c.end_batch(n, attr);
+    }
+};
+
+void Annotation::begin_batch(size_t n, Annotation* const annotations[], const Variant* data)
+{
+    BatchUpdate::apply(&Caliper::begin_batch, n, annotations, data);
+}
+
+void Annotation::set_batch(size_t n, Annotation* const annotations[], const Variant* data)
+{
+    BatchUpdate::apply(&Caliper::set_batch, n, annotations, data);
+}
+
+void Annotation::end_batch(size_t n, Annotation* const annotations[])
+{
+    BatchUpdate::end(n, annotations);
+}
+
 void Annotation::end()
 {
     pI->end();
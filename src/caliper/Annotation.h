@@ -47,12 +47,44 @@ namespace cali
 
 class Variant;
 
+/// \brief Pre-resolved region name for the C++ annotation macros
+///
+/// A region handle keeps a copy of the region name and, for each thread,
+/// the context tree node of the region under the context it was last
+/// entered from. Entering a region again from the same context then skips
+/// the context tree lookup. Region handles should be function-local 
+/// static objects, as created by the \c CALI_CXX_MARK_FUNCTION and 
+/// \c CALI_CXX_MARK_LOOP_BEGIN macros.
+
+class RegionHandle
+{
+    struct Impl;
+    Impl* pI;
+
+    RegionHandle(const RegionHandle&);
+    RegionHandle& operator = (const RegionHandle&);
+
+    friend class Function;
+    friend class Loop;
+
+public:
+
+    RegionHandle(const char* name);
+
+    // The (implicit) destructor deliberately does not free the handle data:
+    // instrumented code may still run during static destruction.
+
+    const char* name() const;
+};
+
 /// \brief Pre-defined function annotation class
     
 class Function
 {
 private:
 
+    const RegionHandle* pH;
+
     // Do not copy Function objects: will double-end things
     Function(const Function&);
     Function& operator = (const Function&);
@@ -60,6 +92,7 @@ private:
 public:
 
     Function(const char* name);
+    Function(const RegionHandle& region);
 
     ~Function();
 };
@@ -71,6 +104,8 @@ class Loop
     struct Impl;
     Impl* pI;    
 
+    void begin(const char* name);
+
 public:
 
     class Iteration {
@@ -83,6 +118,9 @@ public:
     };
 
     Loop(const char* name);
+    /// \brief Begin loop \a name. Uses the pre-resolved \a region if 
+    ///   \a name matches its name.
+    Loop(const RegionHandle& region, const char* name);
     ~Loop();
 
     Iteration iteration(int i);
@@ -98,6 +136,8 @@ class Annotation
     struct Impl;
     Impl*  pI;
 
+    struct BatchUpdate;
+
 
 public:
 
@@ -153,6 +193,21 @@ public:
     Annotation& set(cali_attr_type type, void* data, uint64_t size);
     Annotation& set(const Variant& data);
 
+    /// \}
+    /// \name Batch updates
+    /// \{
+
+    /// \brief Begin values for several annotations with a single blackboard
+    ///   update. Event callbacks are invoked for each annotation. 
+    ///   End the annotations with end_batch() or individually.
+    static void begin_batch(size_t n, Annotation* const annotations[], const Variant* data);
+    /// \brief Set values for several annotations with a single blackboard
+    ///   update. Event callbacks are invoked for each annotation.
+    static void set_batch(size_t n, Annotation* const annotations[], const Variant* data);
+    /// \brief End several annotations with a single blackboard update,
+    ///   in reverse order. Counterpart of begin_batch(). 
+    static void end_batch(size_t n, Annotation* const annotations[]);
+
     /// \}
     /// \name \c end()
     /// \{
@@ -40,6 +40,7 @@
 #include "ContextBuffer.h"
 #include "SnapshotRecord.h"
 #include "MetadataTree.h"
+#include "TaskContext.h"
 
 #include <Services.h>
 
@@ -104,6 +105,10 @@ namespace
             c.flush(nullptr);
             c.events().finish_evt(&c);
 
+            if (TaskContext::num_dropped_entries() > 0)
+                Log(1).stream() << "Task contexts: dropped " << TaskContext::num_dropped_entries()
+                                << " entries because a task context was full" << endl;
+
             c.release_scope(c.default_scope(CALI_SCOPE_PROCESS));
             // Somehow default thread scope is not released by pthread_key_create destructor
             c.release_scope(c.default_scope(CALI_SCOPE_THREAD));
@@ -113,6 +118,21 @@ namespace
         // Caliper::release();
     }
 
+    // --- Per-thread instance cache
+
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
+    /// The calling thread's scope, as resolved by the last Caliper::instance() call.
+    /// Reset when the scope is released.
+    thread_local Caliper::Scope* t_thread_scope CALI_TLS_INITIAL_EXEC = nullptr;
+
+    /// The task context that is active on the calling thread, if any.
+    thread_local TaskContext*    t_task_context CALI_TLS_INITIAL_EXEC = nullptr;
+
     // --- Siglock
 
     class siglock {
@@ -152,6 +172,54 @@ struct Caliper::Scope
         : scope(s) { }
 };
 
+namespace
+{
+    /// Reference to the blackboard that holds a scope's entries: the scope's 
+    /// ContextBuffer, or, for the task scope, the task context that is active
+    /// on the calling thread.
+    class BlackboardRef
+    {
+        ContextBuffer* m_cb;
+        TaskContext*   m_task;
+
+    public:
+
+        BlackboardRef(Caliper::Scope* s)
+            : m_cb(&s->blackboard), 
+              m_task(s->scope == CALI_SCOPE_TASK ? ::t_task_context : nullptr)
+            { }
+
+        Variant  get(const Attribute& attr) const {
+            return m_task ? m_task->get(attr) : m_cb->get(attr);
+        }
+        Node*    get_node(const Attribute& attr) const {
+            return m_task ? m_task->get_node(attr) : m_cb->get_node(attr);
+        }
+        Variant  exchange(const Attribute& attr, const Variant& data) {
+            return m_task ? m_task->exchange(attr, data) : m_cb->exchange(attr, data);
+        }
+        cali_err set_node(const Attribute& attr, Node* node) {
+            return m_task ? m_task->set_node(attr, node) : m_cb->set_node(attr, node);
+        }
+        cali_err set(const Attribute& attr, const Variant& data) {
+            return m_task ? m_task->set(attr, data) : m_cb->set(attr, data);
+        }
+        cali_err unset(const Attribute& attr) {
+            return m_task ? m_task->unset(attr) : m_cb->unset(attr);
+        }
+        void     snapshot(SnapshotRecord* sbuf) const {
+            if (m_task)
+                m_task->snapshot(sbuf);
+            else
+                m_cb->snapshot(sbuf);
+        }
+
+        bool operator != (const BlackboardRef& other) const {
+            return m_cb != other.m_cb || m_task != other.m_task;
+        }
+    };
+}
+
 
 //
 // --- Caliper Global Data
@@ -205,6 +273,16 @@ struct Caliper::GlobalData
     Scope*                 default_thread_scope;
     Scope*                 default_task_scope;
 
+    TaskContextPool        task_pool;
+
+    /// Released thread scopes, kept for reuse by new threads. At most
+    /// max_thread_scope_pool scopes are kept; scopes beyond that are deleted.
+    std::mutex             thread_scope_pool_lock;
+    std::vector<Scope*>    thread_scope_pool;
+    std::size_t            max_thread_scope_pool;
+    std::atomic<unsigned>  num_reused_thread_scopes;
+    std::atomic<unsigned>  num_deleted_thread_scopes;
+
     pthread_key_t          thread_scope_key;
 
     // --- constructor
@@ -222,9 +300,13 @@ struct Caliper::GlobalData
           automerge { true },
           process_scope        { new Scope(CALI_SCOPE_PROCESS) },
           default_thread_scope { new Scope(CALI_SCOPE_THREAD)  },
-          default_task_scope   { new Scope(CALI_SCOPE_TASK)    }
+          default_task_scope   { new Scope(CALI_SCOPE_TASK)    },
+          max_thread_scope_pool    { 64 },
+          num_reused_thread_scopes { 0 },
+          num_deleted_thread_scopes { 0 }
     {
         automerge = config.get("automerge").to_bool();
+        max_thread_scope_pool = config.get("thread_scope_pool_size").to_uint();
         
         name_attr = Attribute::make_attribute(default_thread_scope->tree.node( 8));
         type_attr = Attribute::make_attribute(default_thread_scope->tree.node( 9));
@@ -260,6 +342,49 @@ struct Caliper::GlobalData
         delete default_task_scope;
     }
     
+    /// Take a released thread scope from the pool, or create a new one
+    Scope* make_thread_scope() {
+        {
+            std::lock_guard<std::mutex>
+                g(thread_scope_pool_lock);
+
+            if (!thread_scope_pool.empty()) {
+                Scope* s = thread_scope_pool.back();
+                thread_scope_pool.pop_back();
+
+                ++num_reused_thread_scopes;
+
+                return s;
+            }
+        }
+
+        return new Scope(CALI_SCOPE_THREAD);
+    }
+
+    /// Return a released thread scope to the pool. Clears the blackboard,
+    /// but keeps the context tree with its node blocks and memory pool, 
+    /// so that nodes created in this scope remain valid. If the pool is
+    /// full, the process scope's context tree takes over the scope's node 
+    /// memory, and the scope is deleted.
+    void recycle_thread_scope(Scope* s) {
+        s->blackboard.clear();
+
+        {
+            std::lock_guard<std::mutex>
+                g(thread_scope_pool_lock);
+
+            if (thread_scope_pool.size() < max_thread_scope_pool) {
+                thread_scope_pool.push_back(s);
+                return;
+            }
+        }
+
+        process_scope->tree.adopt_memory(s->tree);
+        ++num_deleted_thread_scopes;
+
+        delete s;
+    }
+
     Scope* acquire_thread_scope(bool create = true) {
         Scope* scope = static_cast<Scope*>(pthread_getspecific(thread_scope_key));
 
@@ -358,6 +483,11 @@ const ConfigSet::Entry Caliper::GlobalData::s_configdata[] = {
       "Decreases the size of context records, but may increase\n"
       "the amount of metadata and reduce performance." 
     },
+    { "thread_scope_pool_size", CALI_TYPE_UINT, "64",
+      "Max. number of released thread scopes kept for reuse",
+      "Maximum number of released thread scopes that are kept for reuse\n"
+      "by new threads. Scopes beyond this number are deleted." 
+    },
     { "attribute_properties", CALI_TYPE_STRING, "",
       "List of attribute property presets",
       "List of attribute property presets, in the form\n"
@@ -367,7 +497,7 @@ const ConfigSet::Entry Caliper::GlobalData::s_configdata[] = {
       "  nomerge:       Create dedicated context tree branch, don't merge with other attributes\n"
       "  process_scope: Process-scope attribute\n"
       "  thread_scope:  Thread-scope attribute\n"
-      "  task_scope:    Task-scope attribute (currently not supported)\n"
+      "  task_scope:    Task-scope attribute (see cali_task_switch())\n"
       "  skip_events:   Do not invoke callback functions for updates\n"
       "  hidden:        Do not include this attribute in snapshots\n" 
     },
@@ -455,13 +585,15 @@ Caliper::create_scope(cali_context_scope_t st)
 {
     assert(mG != 0);
 
-    Scope* s = new Scope(st);
+    Scope* s = nullptr;
     
     switch (st) {
     case CALI_SCOPE_THREAD:
+        s = mG->make_thread_scope();
         m_thread_scope = s;
         break;
     case CALI_SCOPE_TASK:
+        s = new Scope(st);
         m_task_scope   = s;
         break;
     case CALI_SCOPE_PROCESS:
@@ -469,7 +601,6 @@ Caliper::create_scope(cali_context_scope_t st)
             << "Caliper::create_scope(): error: attempt to create a process scope"
             << endl;
 
-        delete s;        
         return 0;
     }
 
@@ -507,14 +638,119 @@ Caliper::release_scope(Caliper::Scope* s)
             s->blackboard.print_statistics(
                 Log(2).stream() << "Releasing " << scopestr << " scope:\n      " ) 
             << "\n      ") << std::endl;
+
+        if (s == mG->default_thread_scope)
+            Log(2).stream() << "Thread scopes: " << mG->num_reused_thread_scopes.load() << " reused, "
+                            << mG->num_deleted_thread_scopes.load() << " deleted" << std::endl;
     }
     
+    // Invalidate the fast instance cache if this is the calling thread's scope
+    if (s == ::t_thread_scope)
+        ::t_thread_scope = nullptr;
+
+    {
+        std::lock_guard<::siglock>
+            g(m_thread_scope->lock);
+    
+        mG->events.release_scope_evt(this, s->scope);
+    }
+
+    // Do NOT delete the scope directly because we may still need the node
+    // data in its memory pool. Instead, let a new thread reuse it, or hand
+    // the node memory over before the scope is deleted.
+    if (s->scope == CALI_SCOPE_THREAD && s != mG->default_thread_scope)
+        mG->recycle_thread_scope(s);
+}
+
+
+// --- Task context API
+
+/// Create a task context.
+///
+/// Task contexts are lightweight blackboards for task-scope attributes
+/// (CALI_ATTR_SCOPE_TASK). They are taken from a pool and can hold a small,
+/// fixed number of entries. Use switch_task() to make a task context
+/// active on the calling thread.
+///
+/// This function is not signal safe.
+///
+/// \return The new task context, or nullptr if the pool is exhausted.
+
+TaskContext*
+Caliper::create_task()
+{
+    if (!mG)
+        return nullptr;
+
+    return mG->task_pool.acquire();
+}
+
+/// Make the given task context active on the calling thread.
+///
+/// While a task context is active, updates of task-scope attributes on
+/// this thread go to the task context, and snapshots that include
+/// CALI_SCOPE_TASK contain its entries. A task context must only be 
+/// active on one thread at a time, but may move between threads. 
+/// If  task is nullptr, task-scope attributes go to the default 
+/// (process-wide) task scope blackboard again.
+///
+/// This function is signal safe.
+///
+/// \param task The task context to activate. May be nullptr.
+/// \return The previously active task context on this thread, or nullptr.
+
+TaskContext*
+Caliper::switch_task(TaskContext* task)
+{
+    if (!mG)
+        return nullptr;
+
     std::lock_guard<::siglock>
         g(m_thread_scope->lock);
-    
-    mG->events.release_scope_evt(this, s->scope);
-    // do NOT delete this because we may still need the node data in the scope's memory pool
-    // delete ctx;
+
+    TaskContext* prev = ::t_task_context;
+    ::t_task_context  = task;
+
+    return prev;
+}
+
+/// Return the task context that is active on the calling thread.
+///
+/// This function is signal safe.
+///
+/// \return The active task context, or nullptr if there is none.
+
+TaskContext*
+Caliper::current_task() const
+{
+    return ::t_task_context;
+}
+
+/// Return a task context to the pool.
+///
+/// The context's entries are discarded. If the task context is active 
+/// on the calling thread, it is deactivated. It must not be active on 
+/// any other thread.
+///
+/// This function is not signal safe.
+///
+/// \param task The task context to release.
+
+void
+Caliper::release_task(TaskContext* task)
+{
+    if (!mG || !task)
+        return;
+
+    {
+        std::lock_guard<::siglock>
+            g(m_thread_scope->lock);
+
+        if (::t_task_context == task)
+            ::t_task_context = nullptr;
+    }
+
+    mG->task_pool.release(task);
 }
 
 
@@ -730,9 +966,30 @@ Caliper::pull_snapshot(int scopes, const SnapshotRecord* trigger_info, SnapshotR
 
     mG->events.snapshot(this, scopes, trigger_info, sbuf);
 
+    pull_context(scopes, sbuf);
+}
+
+/// Copy blackboard contents into a snapshot buffer.
+///
+/// Like pull_snapshot(), but only adds the blackboard contents of the
+/// given scopes. Does not invoke the snapshot callbacks.
+///
+/// This function is signal safe.
+///
+/// \param scopes Specifies which blackboard(s) contents to put into the snapshot buffer. 
+///               Bitfield of cali_scope_t values combined with bitwise OR.
+/// \param sbuf   Caller-provided snapshot record buffer. Must have sufficient free space.
+void
+Caliper::pull_context(int scopes, SnapshotRecord* sbuf)
+{
+    assert(mG != 0);
+
+    std::lock_guard<::siglock>
+        g(m_thread_scope->lock);
+
     for (cali_context_scope_t s : { CALI_SCOPE_TASK, CALI_SCOPE_THREAD, CALI_SCOPE_PROCESS })
         if (scopes & s)
-            scope(s)->blackboard.snapshot(sbuf);
+            BlackboardRef(scope(s)).snapshot(sbuf);
 }
 
 /// Trigger and process a snapshot. 
@@ -773,6 +1030,30 @@ Caliper::push_snapshot(int scopes, const SnapshotRecord* trigger_info)
     mG->events.process_snapshot(this, trigger_info, &sbuf);
 }
 
+/// Process a previously pulled snapshot.
+///
+/// Passes a snapshot record obtained earlier with pull_snapshot() to the
+/// snapshot processing services registered with Caliper. This allows
+/// services to take snapshots in a restricted context (e.g., a signal
+/// handler) and process them later.
+///
+/// This function invokes the process_snapshot callbacks.
+/// This function is signal safe, but processing services typically are not.
+///
+/// \param trigger_info Trigger information list used when the snapshot was taken.
+/// \param in_snapshot  Snapshot record to be processed.
+
+void
+Caliper::process_snapshot(const SnapshotRecord* trigger_info, const SnapshotRecord* in_snapshot)
+{
+    assert(mG != 0);
+
+    std::lock_guard<::siglock>
+        g(m_thread_scope->lock);
+
+    mG->events.process_snapshot(this, trigger_info, in_snapshot);
+}
+
 /// Flush aggregation and / or trace buffers.
 ///
 /// Flushes trace buffers and / or the aggregation database in the trace and aggregation
@@ -847,6 +1128,26 @@ Caliper::flush_snapshot(const SnapshotRecord* flush_info, const SnapshotRecord*
 
 cali_err 
 Caliper::begin(const Attribute& attr, const Variant& data)
+{
+    return begin(attr, data, nullptr);
+}
+
+/// Push attribute:value pair on blackboard, using a node cache.
+///
+/// Same as begin(const Attribute&, const Variant&), but if the 
+/// current context node of `attr` is the parent node stored in `cache`, 
+/// re-uses the cached child node instead of looking it up in the context
+/// tree. Otherwise, updates `cache` with the new parent/child node pair. 
+/// The cache must be used only with the given attribute:value pair.
+///
+/// This function is signal safe.
+///
+/// \param attr  Attribute key
+/// \param data  Value to set
+/// \param cache Node cache for this attribute:value pair. May be null.
+
+cali_err 
+Caliper::begin(const Attribute& attr, const Variant& data, NodeCacheEntry* cache)
 {
     cali_err ret = CALI_EINV;
 
@@ -861,14 +1162,28 @@ Caliper::begin(const Attribute& attr, const Variant& data)
         mG->events.pre_begin_evt(this, attr, data);
 
     Scope* s = scope(attr2caliscope(attr));
-    ContextBuffer* sb = &s->blackboard;
+    BlackboardRef sb(s);
     
     if (attr.store_as_value())
-        ret = sb->set(attr, data);
-    else
-        ret = sb->set_node(mG->get_key(attr),
-                           m_thread_scope->tree.get_path(1, &attr, &data,
-                                                         sb->get_node(mG->get_key(attr))));
+        ret = sb.set(attr, data);
+    else {
+        const Attribute& key    = mG->get_key(attr);
+        Node*            parent = sb.get_node(key);
+        Node*            node   = nullptr;
+
+        if (cache && cache->node && cache->parent == parent)
+            node = cache->node;
+        else {
+            node = m_thread_scope->tree.get_path(1, &attr, &data, parent);
+
+            if (cache && node) {
+                cache->parent = parent;
+                cache->node   = node;
+            }
+        }
+
+        ret = sb.set_node(key, node);
+    }
 
     // invoke callbacks
     if (!attr.skip_events())
@@ -888,6 +1203,24 @@ Caliper::begin(const Attribute& attr, const Variant& data)
 
 cali_err 
 Caliper::end(const Attribute& attr)
+{
+    return end(attr, nullptr);
+}
+
+/// Pop/remove top-most entry with given attribute from blackboard, 
+/// using a node cache.
+///
+/// Same as end(const Attribute&), but if the current context node of
+/// `attr` is the child node in `cache`, restores the cached parent node
+/// instead of rebuilding the path in the context tree.
+///
+/// This function is signal safe.
+///
+/// \param attr  Attribute key.
+/// \param cache Node cache used in the corresponding begin(). May be null.
+
+cali_err 
+Caliper::end(const Attribute& attr, const NodeCacheEntry* cache)
 {
     if (!mG || attr == Attribute::invalid)
         return CALI_EINV;
@@ -895,7 +1228,7 @@ Caliper::end(const Attribute& attr)
     cali_err ret = CALI_EINV;
 
     Scope* s = scope(attr2caliscope(attr));
-    ContextBuffer* sb = &s->blackboard;
+    BlackboardRef sb(s);
 
     Variant val;
 
@@ -904,24 +1237,32 @@ Caliper::end(const Attribute& attr)
 
     // invoke callbacks
     if (!attr.skip_events()) {
-        Entry e = get(attr);
+        Node* node = cache && !attr.store_as_value() ? sb.get_node(mG->get_key(attr)) : nullptr;
+        Entry e    = node && node == cache->node ? Entry(node) : get(attr);
 
         if (!e.is_empty()) // prevent callbacks in end-before-begin situations 
             mG->events.pre_end_evt(this, attr, e.value());
     }
     
     if (attr.store_as_value())
-        ret = sb->unset(attr);
+        ret = sb.unset(attr);
     else {
-        Node* node = sb->get_node(mG->get_key(attr));
+        Node* node = sb.get_node(mG->get_key(attr));
 
-        if (node) {
+        if (cache && node && node == cache->node) {
+            if (cache->parent)
+                ret = sb.set_node(mG->get_key(attr), cache->parent);
+            else
+                ret = sb.unset(mG->get_key(attr));
+
+            node = cache->node;
+        } else if (node) {
             node = m_thread_scope->tree.remove_first_in_path(node, attr);
                 
             if (node == m_thread_scope->tree.root())
-                ret = sb->unset(mG->get_key(attr));
+                ret = sb.unset(mG->get_key(attr));
             else if (node)
-                ret = sb->set_node(mG->get_key(attr), node);
+                ret = sb.set_node(mG->get_key(attr), node);
         }
 
         if (!node)
@@ -960,18 +1301,18 @@ Caliper::set(const Attribute& attr, const Variant& data)
         g(m_thread_scope->lock);
 
     Scope* s = scope(attr2caliscope(attr));
-    ContextBuffer* sb = &s->blackboard;
+    BlackboardRef sb(s);
 
     // invoke callbacks
     if (!attr.skip_events())
         mG->events.pre_set_evt(this, attr, data);
 
     if (attr.store_as_value())
-        ret = sb->set(attr, data);
+        ret = sb.set(attr, data);
     else {
         Attribute key = mG->get_key(attr);
         
-        ret = sb->set_node(key, m_thread_scope->tree.replace_first_in_path(sb->get_node(key), attr, data));
+        ret = sb.set_node(key, m_thread_scope->tree.replace_first_in_path(sb.get_node(key), attr, data));
     }
     
     // invoke callbacks
@@ -1008,7 +1349,7 @@ Caliper::set_path(const Attribute& attr, size_t n, const Variant* data) {
         g(m_thread_scope->lock);
 
     Scope* s = scope(attr2caliscope(attr));
-    ContextBuffer* sb = &s->blackboard;
+    BlackboardRef sb(s);
 
     // invoke callbacks
     if (!attr.skip_events())
@@ -1020,8 +1361,8 @@ Caliper::set_path(const Attribute& attr, size_t n, const Variant* data) {
     } else {
         Attribute key = mG->get_key(attr);
         
-        ret = sb->set_node(key,
-                           m_thread_scope->tree.replace_all_in_path(sb->get_node(key), attr, n, data));
+        ret = sb.set_node(key,
+                           m_thread_scope->tree.replace_all_in_path(sb.get_node(key), attr, n, data));
     }
     
     // invoke callbacks
@@ -1031,6 +1372,348 @@ Caliper::set_path(const Attribute& attr, size_t n, const Variant* data) {
     return ret;
 }
 
+/// Incrementally update a path of entries for the given attribute.
+///
+/// Like set_path(attr, n, data), but skips the context tree lookup for
+/// the first \a n_same entries of the path. These must be identical to
+/// the first \a n_same entries of a previous update of \a attr with this
+/// function, whose resulting nodes are provided in \a nodes. The prefix
+/// is only reused if the blackboard still holds that path, i.e. if no
+/// other entry has been added to this part of the blackboard since.
+/// Otherwise, the function falls back to a regular set_path() update.
+///
+/// This function is signal safe.
+///
+/// \param attr   The attribute. Must not be an immediate-value attribute.
+/// \param n      Number of entries in \a data
+/// \param data   The path entries, from root to leaf
+/// \param n_same Number of leading entries in \a data identical to the
+///   previous update
+/// \param nodes  Array of at least \a n entries. Input: the nodes of the
+///   previous update. Output: the nodes of this update.
+
+cali_err
+Caliper::set_path(const Attribute& attr, size_t n, const Variant* data, size_t n_same, Node* nodes[])
+{
+    if (n < 1)
+        return CALI_SUCCESS;
+    if (!mG || attr == Attribute::invalid || attr.store_as_value())
+        return CALI_EINV;
+
+    std::lock_guard<::siglock>
+        g(m_thread_scope->lock);
+
+    Scope* s = scope(attr2caliscope(attr));
+    BlackboardRef sb(s);
+
+    // invoke callbacks
+    if (!attr.skip_events())
+        mG->events.pre_set_evt(this, attr, data[n-1]);
+
+    Attribute key  = mG->get_key(attr);
+    Node*     path = sb.get_node(key);
+    Node*     leaf = nullptr;
+
+    n_same = std::min(n_same, n);
+
+    if (n_same > 0 && nodes[n_same-1]) {
+        // The prefix is valid if the current path ends with nodes of attr
+        // only, down from nodes[n_same-1]
+
+        Node* node = path;
+
+        while (node && node != nodes[n_same-1] && node->attribute() == attr.id())
+            node = node->parent();
+
+        if (node == nodes[n_same-1])
+            leaf = (n_same < n ? 
+                    m_thread_scope->tree.get_path(attr, n-n_same, data+n_same, nodes[n_same-1]) :
+                    nodes[n-1]);
+    }
+
+    if (!leaf)
+        leaf = m_thread_scope->tree.replace_all_in_path(path, attr, n, data);
+
+    cali_err ret = sb.set_node(key, leaf);
+
+    // return the nodes of the new path
+    {
+        Node* node = leaf;
+
+        for (size_t i = n; node && i > 0; --i, node = node->parent())
+            nodes[i-1] = node;
+    }
+    
+    // invoke callbacks
+    if (!attr.skip_events())
+        mG->events.post_set_evt(this, attr, data[n-1]);
+
+    return ret;
+}
+
+/// Apply a batch of updates to the blackboard. Consecutive attributes 
+/// in the batch that are stored in the same context tree branch are 
+/// updated with a single tree lookup.
+///
+/// \note We assume that m_thread_scope->lock is locked!
+
+cali_err
+Caliper::apply_batch(size_t n, const Attribute attr[], const Variant data[], bool replace)
+{
+    cali_err ret = CALI_SUCCESS;
+
+    for (size_t i = 0; i < n; ) {
+        if (attr[i] == Attribute::invalid) {
+            ret = CALI_EINV;
+            ++i;
+            continue;
+        }
+
+        BlackboardRef sb(scope(attr2caliscope(attr[i])));
+
+        if (attr[i].store_as_value()) {
+            if (sb.set(attr[i], data[i]) != CALI_SUCCESS)
+                ret = CALI_EINV;
+
+            ++i;
+            continue;
+        }
+
+        // Find run of attributes in the same blackboard entry
+
+        const Attribute& key = mG->get_key(attr[i]);
+        size_t           len = 1;
+
+        for ( ; i+len < n; ++len) {
+            const Attribute& a = attr[i+len];
+
+            if (a == Attribute::invalid || a.store_as_value() || mG->get_key(a) != key ||
+                BlackboardRef(scope(attr2caliscope(a))) != sb)
+                break;
+        }
+
+        Node* node = sb.get_node(key);
+
+        if (replace)
+            for (size_t j = i; node && j < i+len; ++j)
+                node = m_thread_scope->tree.remove_first_in_path(node, attr[j]);
+
+        node = m_thread_scope->tree.get_path(len, attr+i, data+i, node);
+
+        if (sb.set_node(key, node) != CALI_SUCCESS)
+            ret = CALI_EINV;
+
+        i += len;
+    }
+
+    return ret;
+}
+
+/// Push a batch of attribute:value pairs on the blackboard.
+///
+/// Same as invoking begin() for each attribute:value pair in order, 
+/// but updates the blackboard with a single lock acquisition and as 
+/// few context tree lookups as possible. 
+/// 
+/// The pre_begin/post_begin callbacks are invoked for each attribute
+/// that does not have the CALI_ATTR_SKIP_EVENTS property, in batch 
+/// order. All pre_begin callbacks run before the blackboard update,
+/// and all post_begin callbacks after it. 
+///
+/// This function is signal safe.
+///
+/// \param n    Number of attribute:value pairs
+/// \param attr Attribute keys
+/// \param data Values
+
+cali_err
+Caliper::begin_batch(size_t n, const Attribute attr[], const Variant data[])
+{
+    if (!mG)
+        return CALI_EINV;
+    if (n < 1)
+        return CALI_SUCCESS;
+
+    std::lock_guard<::siglock>
+        g(m_thread_scope->lock);
+
+    // invoke callbacks
+    for (size_t i = 0; i < n; ++i)
+        if (attr[i] != Attribute::invalid && !attr[i].skip_events())
+            mG->events.pre_begin_evt(this, attr[i], data[i]);
+
+    cali_err ret = apply_batch(n, attr, data, false);
+
+    // invoke callbacks
+    for (size_t i = 0; i < n; ++i)
+        if (attr[i] != Attribute::invalid && !attr[i].skip_events())
+            mG->events.post_begin_evt(this, attr[i], data[i]);
+
+    return ret;
+}
+
+/// Set a batch of attribute:value pairs on the blackboard.
+///
+/// Same as invoking set() for each attribute:value pair in order, 
+/// but updates the blackboard with a single lock acquisition and as 
+/// few context tree lookups as possible. 
+/// 
+/// The pre_set/post_set callbacks are invoked for each attribute
+/// that does not have the CALI_ATTR_SKIP_EVENTS property, in batch
+/// order. All pre_set callbacks run before the blackboard update,
+/// and all post_set callbacks after it. 
+///
+/// This function is signal safe.
+///
+/// \param n    Number of attribute:value pairs
+/// \param attr Attribute keys
+/// \param data Values
+
+cali_err
+Caliper::set_batch(size_t n, const Attribute attr[], const Variant data[])
+{
+    if (!mG)
+        return CALI_EINV;
+    if (n < 1)
+        return CALI_SUCCESS;
+
+    std::lock_guard<::siglock>
+        g(m_thread_scope->lock);
+
+    // invoke callbacks
+    for (size_t i = 0; i < n; ++i)
+        if (attr[i] != Attribute::invalid && !attr[i].skip_events())
+            mG->events.pre_set_evt(this, attr[i], data[i]);
+
+    cali_err ret = apply_batch(n, attr, data, true);
+
+    // invoke callbacks
+    for (size_t i = 0; i < n; ++i)
+        if (attr[i] != Attribute::invalid && !attr[i].skip_events())
+            mG->events.post_set_evt(this, attr[i], data[i]);
+
+    return ret;
+}
+
+/// Pop/remove a batch of attributes from the blackboard.
+///
+/// The counterpart of begin_batch(). Same as invoking end() for each
+/// attribute in reverse order, but updates the blackboard with a single
+/// lock acquisition and as few context tree operations as possible. 
+///
+/// The pre_end/post_end callbacks are invoked for each active attribute
+/// that does not have the CALI_ATTR_SKIP_EVENTS property, in reverse
+/// batch order. All pre_end callbacks run before the blackboard update,
+/// and all post_end callbacks after it.
+///
+/// This function is signal safe.
+///
+/// \param n    Number of attributes
+/// \param attr Attribute keys
+
+cali_err
+Caliper::end_batch(size_t n, const Attribute attr[])
+{
+    if (!mG)
+        return CALI_EINV;
+    if (n < 1)
+        return CALI_SUCCESS;
+
+    std::lock_guard<::siglock>
+        g(m_thread_scope->lock);
+
+    // invoke callbacks
+    for (size_t i = n; i > 0; --i) {
+        const Attribute& a = attr[i-1];
+
+        if (a == Attribute::invalid || a.skip_events())
+            continue;
+
+        Variant val;
+
+        if (a.store_as_value())
+            val = BlackboardRef(scope(attr2caliscope(a))).get(a);
+        else {
+            // an attribute may appear more than once in the batch: 
+            // report the value that the corresponding end() would see
+            size_t k = 0;
+
+            for (size_t j = i; j < n; ++j)
+                if (attr[j] == a)
+                    ++k;
+
+            Node* node = BlackboardRef(scope(attr2caliscope(a))).get_node(mG->get_key(a));
+
+            for ( ; node; node = node->parent())
+                if (node->attribute() == a.id() && k-- == 0)
+                    break;
+
+            if (node)
+                val = node->data();
+        }
+
+        if (!val.empty()) // prevent callbacks in end-before-begin situations
+            mG->events.pre_end_evt(this, a, val);
+    }
+
+    cali_err ret = CALI_SUCCESS;
+
+    for (size_t i = 0; i < n; ) {
+        if (attr[i] == Attribute::invalid) {
+            ret = CALI_EINV;
+            ++i;
+            continue;
+        }
+
+        BlackboardRef sb(scope(attr2caliscope(attr[i])));
+
+        if (attr[i].store_as_value()) {
+            if (sb.unset(attr[i]) != CALI_SUCCESS)
+                ret = CALI_EINV;
+
+            ++i;
+            continue;
+        }
+
+        // Find run of attributes in the same blackboard entry
+
+        const Attribute& key = mG->get_key(attr[i]);
+        size_t           len = 1;
+
+        for ( ; i+len < n; ++len) {
+            const Attribute& a = attr[i+len];
+
+            if (a == Attribute::invalid || a.store_as_value() || mG->get_key(a) != key ||
+                BlackboardRef(scope(attr2caliscope(a))) != sb)
+                break;
+        }
+
+        Node* node = sb.get_node(key);
+
+        if (node) {
+            for (size_t j = i; j < i+len; ++j)
+                node = m_thread_scope->tree.remove_first_in_path(node, attr[j]);
+
+            if (node == m_thread_scope->tree.root())
+                ret = sb.unset(key);
+            else if (node)
+                ret = sb.set_node(key, node);
+        } else {
+            Log(0).stream() << "error: trying to end inactive attribute " << attr[i].name() << endl;
+            ret = CALI_EINV;
+        }
+
+        i += len;
+    }
+
+    // invoke callbacks
+    for (size_t i = n; i > 0; --i)
+        if (attr[i-1] != Attribute::invalid && !attr[i-1].skip_events())
+            mG->events.post_end_evt(this, attr[i-1], Variant());
+
+    return ret;
+}
+
 // --- Query
 
 /// Retrieve entry for the given attribute key from the blackboard
@@ -1053,12 +1736,12 @@ Caliper::get(const Attribute& attr)
     std::lock_guard<::siglock>
         g(m_thread_scope->lock);
 
-    ContextBuffer* sb = &(scope(attr2caliscope(attr))->blackboard);
+    BlackboardRef sb(scope(attr2caliscope(attr)));
 
     if (attr.store_as_value())
-        return Entry(attr, sb->get(attr));
+        return Entry(attr, sb.get(attr));
     else
-        return Entry(m_thread_scope->tree.find_node_with_attribute(attr, sb->get_node(mG->get_key(attr))));
+        return Entry(m_thread_scope->tree.find_node_with_attribute(attr, sb.get_node(mG->get_key(attr))));
 
     return e;
 }
@@ -1178,7 +1861,7 @@ Caliper::exchange(const Attribute& attr, const Variant& data)
     std::lock_guard<::siglock>
         g(m_thread_scope->lock);
 
-    return scope(attr2caliscope(attr))->blackboard.exchange(attr, data);
+    return BlackboardRef(scope(attr2caliscope(attr))).exchange(attr, data);
 }
 
 
@@ -1208,13 +1891,18 @@ Caliper::Caliper()
 /// \see sigsafe_instance()
 ///
 /// Caliper will initialize itself in the first instance object request on a
-/// process.
+/// process. The calling thread's scope is resolved once and then kept in 
+/// thread-local storage until the scope is released.
 /// 
 /// \return Caliper instance object
 
 Caliper
 Caliper::instance()
 {
+    // Fast path: thread scope has been resolved on this thread before
+    if (::t_thread_scope && GlobalData::s_init_lock == 0)
+        return Caliper(GlobalData::sG, ::t_thread_scope);
+
     if (GlobalData::s_init_lock != 0) {
         if (GlobalData::s_init_lock == 2)
             // Caliper had been initialized previously; we're past the static destructor
@@ -1231,7 +1919,11 @@ Caliper::instance()
         }
     }
 
-    return Caliper(GlobalData::sG, GlobalData::sG->acquire_thread_scope());
+    Scope* thread_scope = GlobalData::sG->acquire_thread_scope();
+
+    ::t_thread_scope = thread_scope;
+
+    return Caliper(GlobalData::sG, thread_scope);
 }
 
 /// Construct a signal-safe Caliper instance object.
@@ -1250,7 +1942,10 @@ Caliper::sigsafe_instance()
         return Caliper(0);
 
     Scope* task_scope   = 0; // FIXME: figure out task scope 
-    Scope* thread_scope = GlobalData::sG->acquire_thread_scope(false);
+    Scope* thread_scope = ::t_thread_scope;
+
+    if (!thread_scope)
+        thread_scope = GlobalData::sG->acquire_thread_scope(false);
 
     if (!thread_scope || thread_scope->lock.is_locked())
         return Caliper(0);
@@ -1258,6 +1953,16 @@ Caliper::sigsafe_instance()
     return Caliper(GlobalData::sG, thread_scope, task_scope, true /* is signal */);
 }
 
+Node*
+Caliper::scopeless_node(cali_id_t id)
+{
+    if (GlobalData::s_init_lock != 0)
+        return nullptr;
+
+    // The node table is shared by all context trees, so any tree will do
+    return GlobalData::sG->default_thread_scope->tree.node(id);
+}
+
 void
 Caliper::release()
 {
@@ -53,6 +53,7 @@ namespace cali
 
 class Node;    
 class SnapshotRecord;
+class TaskContext;
     
 /// @class Caliper
 
@@ -82,6 +83,8 @@ private:
         { }
 
     Scope* scope(cali_context_scope_t scope);
+
+    cali_err apply_batch(size_t n, const Attribute attr[], const Variant data[], bool replace);
     
 
 public:
@@ -162,10 +165,19 @@ public:
 
     void      set_scope_callback(cali_context_scope_t context, ScopeCallbackFn cb);
 
+    // --- Task context API
+
+    TaskContext* create_task();
+    TaskContext* switch_task(TaskContext* task);
+    TaskContext* current_task() const;
+    void         release_task(TaskContext* task);
+
     // --- Snapshot API
 
     void      push_snapshot(int scopes, const SnapshotRecord* trigger_info);
     void      pull_snapshot(int scopes, const SnapshotRecord* trigger_info, SnapshotRecord* snapshot);
+    void      pull_context(int scopes, SnapshotRecord* snapshot);
+    void      process_snapshot(const SnapshotRecord* trigger_info, const SnapshotRecord* snapshot);
 
     void      flush(const SnapshotRecord* flush_info);
     void      flush_snapshot(const SnapshotRecord* flush_info, const SnapshotRecord* snapshot);
@@ -176,9 +188,31 @@ public:
     cali_err  end(const Attribute& attr);
     cali_err  set(const Attribute& attr, const Variant& data);
     cali_err  set_path(const Attribute& attr, size_t n, const Variant data[]);
+    /// \brief Like set_path(), but reuse the first \a n_same nodes of a
+    ///   previous set_path() update of \a attr, given in \a nodes. Returns
+    ///   the nodes of the new path in \a nodes, which must have space for
+    ///   \a n entries.
+    cali_err  set_path(const Attribute& attr, size_t n, const Variant data[], size_t n_same, Node* nodes[]);
+
+    cali_err  begin_batch(size_t n, const Attribute attr[], const Variant data[]);
+    cali_err  set_batch(size_t n, const Attribute attr[], const Variant data[]);
+    cali_err  end_batch(size_t n, const Attribute attr[]);
 
     Variant   exchange(const Attribute& attr, const Variant& data);
 
+    /// \brief A cached context tree transition: \a node is the child of 
+    ///   \a parent for one fixed attribute:value pair
+    struct NodeCacheEntry {
+        Node* parent;
+        Node* node;
+    };
+
+    /// \brief Like begin(), but use and update \a cache to skip the context
+    ///   tree lookup. \a cache must only be used with one attribute:value pair.
+    cali_err  begin(const Attribute& attr, const Variant& data, NodeCacheEntry* cache);
+    /// \brief Like end(), but use \a cache from the corresponding begin()
+    cali_err  end(const Attribute& attr, const NodeCacheEntry* cache);
+
     // --- Direct metadata / data access API
 
     void      make_entrylist(size_t n, const Attribute* attr, const Variant* value, SnapshotRecord& list);
@@ -221,6 +255,11 @@ public:
     
     static Caliper sigsafe_instance();
 
+    /// \brief Return node by id without a Caliper instance. Does not create
+    ///   a thread scope, so service-internal threads (e.g., I/O threads) 
+    ///   can resolve nodes without becoming instrumented threads.
+    static Node*   scopeless_node(cali_id_t id);
+
     friend struct GlobalData;
 };
 
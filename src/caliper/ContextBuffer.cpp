@@ -268,6 +268,18 @@ struct ContextBuffer::ContextBufferImpl
         return ret;
     }
 
+    void clear() {
+        std::lock_guard<util::spinlock> lock(m_lock);
+
+        m_keys.clear();
+        m_attr.clear();
+        m_data.clear();
+        m_nodes.clear();
+
+        m_num_nodes  = 0;
+        m_num_hidden = 0;
+    }
+
     void snapshot(SnapshotRecord* sbuf) const {
         std::lock_guard<util::spinlock> lock(m_lock);
 
@@ -347,6 +359,11 @@ cali_err ContextBuffer::unset(const Attribute& attr)
     return mP->unset(attr);
 }
 
+void ContextBuffer::clear()
+{
+    mP->clear();
+}
+
 void ContextBuffer::snapshot(SnapshotRecord* sbuf) const
 {
     mP->snapshot(sbuf);
@@ -72,6 +72,9 @@ public:
     cali_err set(const Attribute&, const Variant&);
     cali_err unset(const Attribute&);
 
+    /// \brief Remove all entries
+    void     clear();
+
     /// @}
     /// @name get context
     /// @{
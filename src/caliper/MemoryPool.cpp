@@ -105,6 +105,22 @@ struct MemoryPool::MemoryPoolImpl
         return ptr;
     }
 
+    void merge(MemoryPoolImpl* other) {
+        std::lock_guard<util::spinlock> lock(m_lock);
+        std::lock_guard<util::spinlock> other_lock(other->m_lock);
+
+        // keep allocating from our current chunk
+        m_chunks.insert(m_chunks.end(), other->m_chunks.begin(), other->m_chunks.end());
+
+        m_total_reserved += other->m_total_reserved;
+        m_total_used     += other->m_total_used;
+
+        other->m_chunks.clear();
+        other->m_index          = 0;
+        other->m_total_reserved = 0;
+        other->m_total_used     = 0;
+    }
+
     std::ostream& print_statistics(std::ostream& os) const {
         os << "Metadata memory pool: "
            << m_total_reserved << " bytes reserved, "
@@ -169,6 +185,12 @@ void* MemoryPool::allocate(size_t bytes)
     return mP->allocate(bytes, mP->m_can_expand);
 }
 
+void MemoryPool::merge(MemoryPool& other)
+{
+    if (&other != this)
+        mP->merge(other.mP.get());
+}
+
 std::ostream& MemoryPool::print_statistics(std::ostream& os) const
 {
     return mP->print_statistics(os);
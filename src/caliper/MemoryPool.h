@@ -68,6 +68,11 @@ public:
 
     void* allocate(std::size_t bytes);
 
+    /// \brief Take over all memory chunks of \a other.
+    /// Memory allocated from \a other remains valid for the lifetime of 
+    /// this pool; \a other is left empty.
+    void  merge(MemoryPool& other);
+
     std::ostream& print_statistics(std::ostream& os) const;
 };
 
@@ -612,6 +612,12 @@ MetadataTree::get_path(size_t n, const Node* nodelist[], Node* parent)
     return mP->get_path(n, nodelist, parent);
 }
 
+Node*
+MetadataTree::get_path(const Attribute& attr, size_t n, const Variant data[], Node* parent)
+{
+    return mP->get_path(attr, n, data, parent);
+}
+
 Node*
 MetadataTree::remove_first_in_path(Node* path, const Attribute& attr)
 {
@@ -662,6 +668,16 @@ MetadataTree::type_node(cali_attr_type type) const
     return MetadataTreeImpl::mG.load()->type_nodes[type];
 }
 
+//
+// --- Memory management ---
+//
+
+void
+MetadataTree::adopt_memory(MetadataTree& other)
+{
+    mP->m_mempool.merge(other.mP->m_mempool);
+}
+
 //
 // --- I/O ---
 //
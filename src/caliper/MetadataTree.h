@@ -70,6 +70,11 @@ namespace cali
         ///   the data of the nodes given in the nodelist in the order of that list
         Node*
         get_path(size_t n, const Node* nodelist[], Node* parent);
+
+        /// \brief Get or construct a path in the tree under parent with
+        ///   \a n entries of the given attribute
+        Node*
+        get_path(const Attribute& attr, size_t n, const Variant data[], Node* parent);
         
         Node*
         remove_first_in_path(Node* path, const Attribute& attr);
@@ -94,6 +99,13 @@ namespace cali
         Node*
         type_node(cali_attr_type type) const;
 
+        // --- Memory management ---
+
+        /// \brief Take over the node memory of \a other, so that nodes 
+        ///   created in \a other remain valid after it is destroyed
+        void
+        adopt_memory(MetadataTree& other);
+
         // --- I/O ---
 
         std::ostream&
@@ -0,0 +1,377 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+///@ file TaskContext.cpp
+///@ TaskContext and TaskContextPool implementation
+
+#include "TaskContext.h"
+
+#include "SnapshotRecord.h"
+
+#include <Attribute.h>
+#include <Log.h>
+#include <Node.h>
+
+#include <algorithm>
+
+using namespace cali;
+
+namespace
+{
+
+/// Number of entries dropped because a task context was full
+std::atomic<size_t> num_dropped_entries { 0 };
+
+/// Warn about full task contexts only once; report the count at finish
+void report_overflow(const char* what, const Attribute& attr)
+{
+    if (num_dropped_entries.fetch_add(1) == 0)
+        Log(0).stream() << "Task context: too many " << what << ", dropping " 
+                        << attr.name() << ". Further occurrences are not reported." << std::endl;
+}
+
+} // namespace [anonymous]
+
+
+//
+// --- TaskContext
+//
+
+TaskContext::TaskContext()
+    : m_num_nodes(0), m_num_imm(0), m_num_hidden(0), m_num_timers(0), m_index(0), m_next_free(0)
+{ }
+
+size_t
+TaskContext::find_imm(cali_id_t key) const
+{
+    return std::find(m_imm_keys, m_imm_keys + m_num_imm, key) - m_imm_keys;
+}
+
+void
+TaskContext::erase_imm(size_t n)
+{
+    size_t num_visible = m_num_imm - m_num_hidden;
+
+    if (n < num_visible) {
+        // move last visible entry into the gap, then last hidden entry
+        // into the last visible entry's place
+        m_imm_keys[n] = m_imm_keys[num_visible-1];
+        m_imm_data[n] = m_imm_data[num_visible-1];
+        n = num_visible-1;
+    } else
+        --m_num_hidden;
+
+    m_imm_keys[n] = m_imm_keys[m_num_imm-1];
+    m_imm_data[n] = m_imm_data[m_num_imm-1];
+
+    --m_num_imm;
+}
+
+Variant
+TaskContext::get(const Attribute& attr) const
+{
+    if (attr.store_as_value()) {
+        size_t n = find_imm(attr.id());
+
+        return n < m_num_imm ? m_imm_data[n] : Variant();
+    }
+
+    Node* node = get_node(attr);
+
+    return node ? Variant(node->id()) : Variant();
+}
+
+Node*
+TaskContext::get_node(const Attribute& attr) const
+{
+    size_t n = std::find(m_node_keys, m_node_keys + m_num_nodes, attr.id()) - m_node_keys;
+
+    return n < m_num_nodes ? m_nodes[n] : nullptr;
+}
+
+Variant
+TaskContext::exchange(const Attribute& attr, const Variant& value)
+{
+    Variant ret;
+    size_t  n = find_imm(attr.id());
+
+    if (n < m_num_imm) {
+        ret = m_imm_data[n];
+        m_imm_data[n] = value;
+    } else
+        set(attr, value);
+
+    return ret;
+}
+
+cali_err
+TaskContext::set_node(const Attribute& attr, Node* node)
+{
+    if (!node || attr.store_as_value())
+        return CALI_EINV;
+
+    size_t n = std::find(m_node_keys, m_node_keys + m_num_nodes, attr.id()) - m_node_keys;
+
+    if (n == m_num_nodes) {
+        if (m_num_nodes >= MaxNodes) {
+            report_overflow("context tree entries", attr);
+            return CALI_EBUSY;
+        }
+
+        m_node_keys[m_num_nodes++] = attr.id();
+    }
+
+    m_nodes[n] = node;
+
+    return CALI_SUCCESS;
+}
+
+cali_err
+TaskContext::set(const Attribute& attr, const Variant& value)
+{
+    if (!attr.store_as_value())
+        return CALI_EINV;
+
+    size_t n = find_imm(attr.id());
+
+    if (n == m_num_imm) {
+        if (m_num_imm >= MaxImmediates) {
+            report_overflow("immediate entries", attr);
+            return CALI_EBUSY;
+        }
+
+        ++m_num_imm;
+
+        if (attr.is_hidden())
+            ++m_num_hidden;
+        else if (m_num_hidden > 0) {
+            // keep hidden entries at the end: move first hidden entry to the back
+            size_t first_hidden = m_num_imm - 1 - m_num_hidden;
+
+            m_imm_keys[n] = m_imm_keys[first_hidden];
+            m_imm_data[n] = m_imm_data[first_hidden];
+            n = first_hidden;
+        }
+
+        m_imm_keys[n] = attr.id();
+    }
+
+    m_imm_data[n] = value;
+
+    return CALI_SUCCESS;
+}
+
+cali_err
+TaskContext::unset(const Attribute& attr)
+{
+    if (attr.store_as_value()) {
+        size_t n = find_imm(attr.id());
+
+        if (n < m_num_imm)
+            erase_imm(n);
+    } else {
+        size_t n = std::find(m_node_keys, m_node_keys + m_num_nodes, attr.id()) - m_node_keys;
+
+        if (n < m_num_nodes) {
+            --m_num_nodes;
+            m_node_keys[n] = m_node_keys[m_num_nodes];
+            m_nodes[n]     = m_nodes[m_num_nodes];
+        }
+    }
+
+    return CALI_SUCCESS;
+}
+
+void
+TaskContext::snapshot(SnapshotRecord* sbuf) const
+{
+    size_t num_visible = m_num_imm - m_num_hidden;
+
+    if (m_num_nodes + num_visible > 0)
+        sbuf->append(m_num_nodes, m_nodes, num_visible, m_imm_keys, m_imm_data);
+}
+
+uint64_t*
+TaskContext::find_timer(uint64_t key)
+{
+    for (size_t n = m_num_timers; n > 0; --n)
+        if (m_timer_keys[n-1] == key)
+            return m_timer_start + (n-1);
+
+    return nullptr;
+}
+
+bool
+TaskContext::push_timer(uint64_t key, uint64_t start)
+{
+    if (m_num_timers >= MaxTimers)
+        return false;
+
+    m_timer_keys[m_num_timers]  = key;
+    m_timer_start[m_num_timers] = start;
+    ++m_num_timers;
+
+    return true;
+}
+
+void
+TaskContext::erase_timer(uint64_t* start)
+{
+    size_t n = start - m_timer_start;
+
+    if (n >= m_num_timers)
+        return;
+
+    // keep the stack order
+    std::copy(m_timer_keys  + n + 1, m_timer_keys  + m_num_timers, m_timer_keys  + n);
+    std::copy(m_timer_start + n + 1, m_timer_start + m_num_timers, m_timer_start + n);
+
+    --m_num_timers;
+}
+
+size_t
+TaskContext::num_dropped_entries()
+{
+    return ::num_dropped_entries.load();
+}
+
+void
+TaskContext::clear()
+{
+    m_num_nodes  = 0;
+    m_num_imm    = 0;
+    m_num_hidden = 0;
+    m_num_timers = 0;
+}
+
+
+//
+// --- TaskContextPool
+//
+
+TaskContextPool::TaskContextPool()
+    : m_head(0), m_num_chunks(0), m_num_acquired(0)
+{
+    for (size_t i = 0; i < MaxChunks; ++i)
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+}
+
+TaskContextPool::~TaskContextPool()
+{
+    for (size_t i = 0; i < m_num_chunks.load(); ++i)
+        delete[] m_chunks[i].load();
+}
+
+void
+TaskContextPool::push(uint32_t index)
+{
+    TaskContext* ctx  = context(index);
+    uint64_t     head = m_head.load(std::memory_order_relaxed);
+    uint64_t     newhead;
+
+    do {
+        ctx->m_next_free.store(static_cast<uint32_t>(head & 0xFFFFFFFF), std::memory_order_relaxed);
+        newhead = ((head >> 32) + 1) << 32 | (index + 1);
+    } while (!m_head.compare_exchange_weak(head, newhead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool
+TaskContextPool::grow()
+{
+    std::lock_guard<std::mutex>
+        g(m_grow_lock);
+
+    // another thread may have grown the pool in the meantime
+    if ((m_head.load() & 0xFFFFFFFF) != 0)
+        return true;
+
+    size_t n = m_num_chunks.load();
+
+    if (n >= MaxChunks)
+        return false;
+
+    TaskContext* chunk = new TaskContext[ChunkSize];
+
+    for (size_t i = 0; i < ChunkSize; ++i)
+        chunk[i].m_index = static_cast<uint32_t>(n * ChunkSize + i);
+
+    m_chunks[n].store(chunk, std::memory_order_release);
+    m_num_chunks.store(n + 1);
+
+    for (size_t i = ChunkSize; i > 0; --i)
+        push(static_cast<uint32_t>(n * ChunkSize + i - 1));
+
+    return true;
+}
+
+TaskContext*
+TaskContextPool::acquire()
+{
+    uint64_t head = m_head.load(std::memory_order_acquire);
+
+    while (true) {
+        uint32_t index = static_cast<uint32_t>(head & 0xFFFFFFFF);
+
+        if (index == 0) {
+            if (!grow()) {
+                Log(0).stream() << "Task context pool exhausted" << std::endl;
+                return nullptr;
+            }
+
+            head = m_head.load(std::memory_order_acquire);
+            continue;
+        }
+
+        // Contexts are never freed, so reading the link of a context that
+        // was popped concurrently is safe; the ABA tag rejects the CAS then
+        TaskContext* ctx     = context(index - 1);
+        uint64_t     newhead = ((head >> 32) + 1) << 32 | ctx->m_next_free.load(std::memory_order_relaxed);
+
+        if (m_head.compare_exchange_weak(head, newhead, std::memory_order_acquire, std::memory_order_acquire)) {
+            ++m_num_acquired;
+            return ctx;
+        }
+    }
+}
+
+void
+TaskContextPool::release(TaskContext* ctx)
+{
+    if (!ctx)
+        return;
+
+    ctx->clear();
+    --m_num_acquired;
+
+    push(ctx->m_index);
+}
@@ -0,0 +1,179 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+///@ file TaskContext.h
+///@ TaskContext class declaration
+
+#ifndef CALI_TASKCONTEXT_H
+#define CALI_TASKCONTEXT_H
+
+#include "Variant.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace cali
+{
+
+class Attribute;
+class SnapshotRecord;
+class Node;
+
+/// \brief A lightweight blackboard for task-scope attributes.
+///
+/// Holds a small, fixed number of context tree node and immediate
+/// entries inline, so it can be switched in and out cheaply by task-based
+/// runtimes. Unlike ContextBuffer, a TaskContext is not internally
+/// synchronized: it must only be modified by the thread it is active on.
+/// TaskContext objects are obtained from and returned to a TaskContextPool.
+
+class TaskContext
+{
+public:
+
+    static const size_t MaxNodes      = 8;
+    static const size_t MaxImmediates = 8;
+    static const size_t MaxTimers     = 8;
+
+private:
+
+    cali_id_t m_node_keys[MaxNodes];
+    Node*     m_nodes[MaxNodes];
+    size_t    m_num_nodes;
+
+    // Immediate entries: visible entries first, hidden entries at the end
+    cali_id_t m_imm_keys[MaxImmediates];
+    Variant   m_imm_data[MaxImmediates];
+    size_t    m_num_imm;
+    size_t    m_num_hidden;
+
+    // Phase timers: start times of active regions of task-scope attributes
+    uint64_t  m_timer_keys[MaxTimers];
+    uint64_t  m_timer_start[MaxTimers];
+    size_t    m_num_timers;
+
+    uint32_t              m_index;     ///< Index in the pool
+    std::atomic<uint32_t> m_next_free; ///< Freelist link: index+1 of next free context, or 0
+
+    friend class TaskContextPool;
+
+    size_t    find_imm(cali_id_t key) const;
+    void      erase_imm(size_t n);
+
+public:
+
+    TaskContext();
+
+    /// @name blackboard interface (same as ContextBuffer)
+    /// @{
+
+    Variant   get(const Attribute&) const;
+    Node*     get_node(const Attribute&) const;
+
+    Variant   exchange(const Attribute&, const Variant&);
+
+    cali_err  set_node(const Attribute&, Node*);
+    cali_err  set(const Attribute&, const Variant&);
+    cali_err  unset(const Attribute&);
+
+    void      snapshot(SnapshotRecord* sbuf) const;
+
+    /// @}
+
+    /// @name phase timers
+    /// Start times of active begin/end regions of task-scope attributes
+    /// are kept with the task context (rather than per thread), so that a
+    /// region can end on a different thread than it began on.
+    /// @{
+
+    /// \brief Return the start time of the innermost timer with the given
+    ///   key, or nullptr if there is none.
+    uint64_t* find_timer(uint64_t key);
+    /// \brief Start a timer. Returns false if the context is full.
+    bool      push_timer(uint64_t key, uint64_t start);
+    /// \brief Remove the timer returned by find_timer().
+    void      erase_timer(uint64_t* start);
+
+    /// @}
+
+    void      clear();
+
+    /// \brief Number of entries dropped in all task contexts because
+    ///   they were full
+    static size_t num_dropped_entries();
+};
+
+/// \brief A pool of TaskContext objects with a lock-free freelist.
+///
+/// Contexts are allocated in chunks that are never freed. Acquiring and
+/// releasing a context only takes a compare-and-swap on the freelist head
+/// in the common case; growing the pool takes a lock.
+
+class TaskContextPool
+{
+    static const size_t ChunkSize = 1024;
+    static const size_t MaxChunks = 4096;
+
+    /// Freelist head: ABA tag in the upper 32 bits, index+1 of the first
+    /// free context in the lower 32 bits
+    std::atomic<uint64_t>     m_head;
+
+    std::atomic<TaskContext*> m_chunks[MaxChunks];
+    std::atomic<size_t>       m_num_chunks;
+    std::mutex                m_grow_lock;
+
+    std::atomic<size_t>       m_num_acquired;
+
+    TaskContext* context(uint32_t index) const {
+        return m_chunks[index / ChunkSize].load(std::memory_order_acquire) + (index % ChunkSize);
+    }
+
+    void         push(uint32_t index);
+    bool         grow();
+
+public:
+
+    TaskContextPool();
+    ~TaskContextPool();
+
+    TaskContext* acquire();
+    void         release(TaskContext* ctx);
+
+    size_t       num_allocated() const { return m_num_chunks.load() * ChunkSize; }
+    size_t       num_in_use() const    { return m_num_acquired.load(); }
+};
+
+} // namespace cali
+
+#endif // CALI_TASKCONTEXT_H
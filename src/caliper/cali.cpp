@@ -45,6 +45,7 @@
 #include <cstring>
 #include <unordered_map>
 #include <mutex>
+#include <vector>
 
 
 using namespace cali;
@@ -103,6 +104,29 @@ cali_find_attribute(const char* name)
 }
 
 
+//
+// --- Task contexts
+//
+
+cali_task_context_t*
+cali_task_create()
+{
+    return reinterpret_cast<cali_task_context_t*>(Caliper::instance().create_task());
+}
+
+cali_task_context_t*
+cali_task_switch(cali_task_context_t* task)
+{
+    return reinterpret_cast<cali_task_context_t*>(Caliper::instance().switch_task(reinterpret_cast<TaskContext*>(task)));
+}
+
+void
+cali_task_release(cali_task_context_t* task)
+{
+    Caliper::instance().release_task(reinterpret_cast<TaskContext*>(task));
+}
+
+
 //
 // --- Context interface
 //
@@ -238,6 +262,79 @@ cali_set_string(cali_id_t attr_id, const char* val)
     return c.set(attr, Variant(CALI_TYPE_STRING, val, strlen(val)));
 }
 
+namespace
+{
+
+typedef cali_err (Caliper::*BatchUpdateFn)(size_t, const Attribute[], const Variant[]);
+
+cali_err
+batch_update(BatchUpdateFn fn, size_t n, const cali_id_t attr_list[], const void* value_list[], const size_t size_list[])
+{
+    const size_t MaxStackBatch = 16;
+
+    Caliper   c;
+
+    Attribute attr_buf[MaxStackBatch];
+    Variant   data_buf[MaxStackBatch];
+
+    std::vector<Attribute> attr_vec;
+    std::vector<Variant>   data_vec;
+
+    Attribute* attr = attr_buf;
+    Variant*   data = data_buf;
+
+    if (n > MaxStackBatch) {
+        attr_vec.resize(n);
+        data_vec.resize(n);
+
+        attr = attr_vec.data();
+        data = data_vec.data();
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        attr[i] = c.get_attribute(attr_list[i]);
+        data[i] = Variant(attr[i].type(), value_list[i], size_list[i]);
+    }
+
+    return (c.*fn)(n, attr, data);
+}
+
+} // namespace [anonymous]
+
+cali_err
+cali_begin_batch(size_t n, const cali_id_t attr_list[], const void* value_list[], const size_t size_list[])
+{
+    return ::batch_update(&Caliper::begin_batch, n, attr_list, value_list, size_list);
+}
+
+cali_err
+cali_set_batch(size_t n, const cali_id_t attr_list[], const void* value_list[], const size_t size_list[])
+{
+    return ::batch_update(&Caliper::set_batch, n, attr_list, value_list, size_list);
+}
+
+cali_err
+cali_end_batch(size_t n, const cali_id_t attr_list[])
+{
+    const size_t MaxStackBatch = 16;
+
+    Caliper   c;
+
+    Attribute attr_buf[MaxStackBatch];
+    std::vector<Attribute> attr_vec;
+    Attribute* attr = attr_buf;
+
+    if (n > MaxStackBatch) {
+        attr_vec.resize(n);
+        attr = attr_vec.data();
+    }
+
+    for (size_t i = 0; i < n; ++i)
+        attr[i] = c.get_attribute(attr_list[i]);
+
+    return c.end_batch(n, attr);
+}
+
 cali_err
 cali_safe_end_string(cali_id_t attr_id, const char* val)
 {
@@ -120,6 +120,47 @@ cali_push_snapshot(int scope, int n,
                    const void*     trigger_info_val_list[],
                    const size_t    trigger_info_size_list[]);
 
+/*
+ * --- Task contexts ----------------------------------------------------
+ */
+
+/**
+ * Opaque handle for a task context. Task contexts hold the 
+ * task-scope (CALI_ATTR_SCOPE_TASK) attributes of a task.
+ */
+
+typedef struct cali_task_context cali_task_context_t;
+
+/**
+ * Create a task context. Task contexts are taken from a pool 
+ * and can hold a small number of task-scope attributes.
+ * \return The new task context, or NULL if none is available
+ */
+
+cali_task_context_t*
+cali_task_create();
+
+/**
+ * Make \a task the active task context on the calling thread.
+ * Task-scope attributes updated on this thread are stored in the
+ * active task context, and snapshots that include CALI_SCOPE_TASK
+ * contain its entries. A task context must only be active on one 
+ * thread at a time.
+ * \param task The task context to activate. If NULL, deactivate the 
+ *   current task context.
+ * \return The previously active task context on this thread, or NULL
+ */
+
+cali_task_context_t*
+cali_task_switch(cali_task_context_t* task);
+
+/**
+ * Return \a task to the task context pool. Its entries are discarded.
+ */
+
+void
+cali_task_release(cali_task_context_t* task);
+
 /*
  * --- Instrumentation API -----------------------------------
  */
@@ -180,6 +221,56 @@ cali_set_int(cali_id_t attr, int val);
 cali_err  
 cali_set_string(cali_id_t attr, const char* val);
 
+/**
+ * Add values for several attributes to the blackboard at once.
+ * Same as a sequence of cali_begin() calls for each attribute, but updates
+ * the blackboard with a single context tree lookup where possible. 
+ * Event callbacks are invoked for each attribute in the batch.
+ * Remove the attributes with cali_end_batch() or individually with 
+ * cali_end().
+ * \param n          Number of attribute:value pairs
+ * \param attr_list  Attribute IDs
+ * \param value_list Pointers to the values
+ * \param size_list  Sizes (in bytes) of the values
+ */
+
+cali_err
+cali_begin_batch(size_t n, 
+                 const cali_id_t attr_list[], 
+                 const void*     value_list[],
+                 const size_t    size_list[]);
+
+/**
+ * Change the values of several attributes on the blackboard at once.
+ * Same as a sequence of cali_set() calls for each attribute, but updates
+ * the blackboard with a single context tree lookup where possible. 
+ * Event callbacks are invoked for each attribute in the batch.
+ * \param n          Number of attribute:value pairs
+ * \param attr_list  Attribute IDs
+ * \param value_list Pointers to the values
+ * \param size_list  Sizes (in bytes) of the values
+ */
+
+cali_err
+cali_set_batch(size_t n, 
+               const cali_id_t attr_list[], 
+               const void*     value_list[],
+               const size_t    size_list[]);
+
+/**
+ * Remove several attributes from the blackboard at once.
+ * Same as a sequence of cali_end() calls for each attribute in reverse
+ * order, but updates the blackboard with as few context tree operations
+ * as possible. Counterpart of cali_begin_batch().
+ * Event callbacks are invoked for each attribute in the batch.
+ * \param n          Number of attributes
+ * \param attr_list  Attribute IDs
+ */
+
+cali_err
+cali_end_batch(size_t n, 
+               const cali_id_t attr_list[]);
+
 /**
  * Put attribute with name \param attr_name on the blackboard.
  */
@@ -45,11 +45,13 @@
 
 /// \macro C++ macro to mark a function
 #define CALI_CXX_MARK_FUNCTION \
-    cali::Function __cali_ann##__func__(__func__)
+    static cali::RegionHandle __cali_region##__func__(__func__); \
+    cali::Function __cali_ann##__func__(__cali_region##__func__)
 
 /// \macro Mark a loop in C++ 
 #define CALI_CXX_MARK_LOOP_BEGIN(loop_id, name) \
-    cali::Loop __cali_loop_##loop_id(name)
+    static cali::RegionHandle __cali_loop_region_##loop_id(name); \
+    cali::Loop __cali_loop_##loop_id(__cali_loop_region_##loop_id, name)
 
 /// \macro C++ macro for a loop iteration
 #define CALI_CXX_MARK_LOOP_ITERATION(loop_id, iter) \
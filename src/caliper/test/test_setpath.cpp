@@ -0,0 +1,120 @@
+#include "../Caliper.h"
+
+#include "Node.h"
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+using namespace cali;
+
+namespace
+{
+
+std::vector<int> get_path(Caliper& c, const Attribute& attr)
+{
+    std::vector<int> ret;
+
+    for (const Node* node = c.get(attr).node(); node; node = node->parent())
+        if (node->attribute() == attr.id())
+            ret.insert(ret.begin(), node->data().to_int());
+
+    return ret;
+}
+
+} // namespace [anonymous]
+
+//
+// --- Incremental set_path() updates
+//
+
+// The tests below pass a deliberately wrong prefix length: the prefix
+// nodes are reused only if the cache is valid, so the stale prefix value 
+// shows whether the cached nodes were used.
+
+TEST(SetPathTest, ReusePrefix) {
+    Caliper   c;
+    Attribute attr = 
+        c.create_attribute("test.setpath.reuse", CALI_TYPE_INT, CALI_ATTR_SKIP_EVENTS | CALI_ATTR_NOMERGE);
+
+    Node*   nodes[3] = { nullptr, nullptr, nullptr };
+    Variant v1[3] = { Variant(1), Variant(2), Variant(3) };
+    Variant v2[3] = { Variant(9), Variant(2), Variant(4) };
+
+    c.set_path(attr, 3, v1, 0, nodes);
+    EXPECT_EQ(get_path(c, attr), (std::vector<int> { 1, 2, 3 }));
+
+    c.set_path(attr, 3, v2, 2, nodes);
+    EXPECT_EQ(get_path(c, attr), (std::vector<int> { 1, 2, 4 }));
+
+    c.end(attr);
+}
+
+TEST(SetPathTest, TwoAttributes) {
+    // Like the callpath service with both address and name paths: 
+    // alternating updates of two attributes in separate blackboard 
+    // entries must not invalidate each other's cached prefix
+
+    Caliper   c;
+    Attribute a = 
+        c.create_attribute("test.setpath.a", CALI_TYPE_INT, CALI_ATTR_SKIP_EVENTS | CALI_ATTR_NOMERGE);
+    Attribute b = 
+        c.create_attribute("test.setpath.b", CALI_TYPE_INT, CALI_ATTR_SKIP_EVENTS | CALI_ATTR_NOMERGE);
+    Attribute r = 
+        c.create_attribute("test.setpath.region", CALI_TYPE_INT, CALI_ATTR_SKIP_EVENTS);
+
+    Node*   a_nodes[3] = { nullptr, nullptr, nullptr };
+    Node*   b_nodes[3] = { nullptr, nullptr, nullptr };
+
+    Variant v1[3] = { Variant(1), Variant(2), Variant(3) };
+    Variant v2[3] = { Variant(9), Variant(2), Variant(4) };
+
+    c.set_path(a, 3, v1, 0, a_nodes);
+    c.set_path(b, 3, v1, 0, b_nodes);
+
+    // a region update in between does not affect the path entries
+    c.begin(r, Variant(42));
+
+    c.set_path(a, 3, v2, 2, a_nodes);
+    c.set_path(b, 3, v2, 2, b_nodes);
+
+    EXPECT_EQ(get_path(c, a), (std::vector<int> { 1, 2, 4 }));
+    EXPECT_EQ(get_path(c, b), (std::vector<int> { 1, 2, 4 }));
+    EXPECT_EQ(c.get(r).value().to_int(), 42);
+
+    // a correct update replaces the whole path
+    c.set_path(a, 3, v2, 0, a_nodes);
+    c.set_path(b, 3, v1, 3, b_nodes);
+
+    EXPECT_EQ(get_path(c, a), (std::vector<int> { 9, 2, 4 }));
+    EXPECT_EQ(get_path(c, b), (std::vector<int> { 1, 2, 4 }));
+
+    c.end(r);
+    c.end(a);
+    c.end(b);
+}
+
+TEST(SetPathTest, InvalidatedPrefix) {
+    // With the path in a shared (auto-merged) blackboard entry, another 
+    // entry added after the path invalidates the cached prefix 
+
+    Caliper   c;
+    Attribute a = 
+        c.create_attribute("test.setpath.merged", CALI_TYPE_INT, CALI_ATTR_SKIP_EVENTS);
+    Attribute r = 
+        c.create_attribute("test.setpath.merged.region", CALI_TYPE_INT, CALI_ATTR_SKIP_EVENTS);
+
+    Node*   nodes[3] = { nullptr, nullptr, nullptr };
+    Variant v1[3] = { Variant(1), Variant(2), Variant(3) };
+    Variant v2[3] = { Variant(9), Variant(2), Variant(4) };
+
+    c.set_path(a, 3, v1, 0, nodes);
+    c.begin(r, Variant(42));
+    c.set_path(a, 3, v2, 2, nodes);
+
+    EXPECT_EQ(get_path(c, a), (std::vector<int> { 9, 2, 4 }));
+    EXPECT_EQ(c.get(r).value().to_int(), 42);
+
+    c.end(r);
+    c.end(a);
+}
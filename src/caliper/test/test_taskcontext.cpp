@@ -0,0 +1,195 @@
+#include "../TaskContext.h"
+
+#include "../Caliper.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cali;
+
+//
+// --- TaskContext phase timers
+//
+
+TEST(TaskContextTest, PhaseTimers) {
+    TaskContext ctx;
+
+    EXPECT_EQ(ctx.find_timer(1), nullptr);
+
+    EXPECT_TRUE(ctx.push_timer(1, 10));
+    EXPECT_TRUE(ctx.push_timer(2, 20));
+    EXPECT_TRUE(ctx.push_timer(1, 30));
+
+    // innermost timer with a key wins
+    uint64_t* t = ctx.find_timer(1);
+
+    ASSERT_NE(t, nullptr);
+    EXPECT_EQ(*t, 30);
+
+    ctx.erase_timer(t);
+
+    t = ctx.find_timer(1);
+    ASSERT_NE(t, nullptr);
+    EXPECT_EQ(*t, 10);
+
+    // erasing from the middle keeps the other timers
+    ctx.erase_timer(t);
+
+    t = ctx.find_timer(2);
+    ASSERT_NE(t, nullptr);
+    EXPECT_EQ(*t, 20);
+    EXPECT_EQ(ctx.find_timer(1), nullptr);
+
+    ctx.clear();
+
+    EXPECT_EQ(ctx.find_timer(2), nullptr);
+}
+
+TEST(TaskContextTest, PhaseTimerOverflow) {
+    TaskContext ctx;
+
+    for (uint64_t i = 0; i < TaskContext::MaxTimers; ++i)
+        EXPECT_TRUE(ctx.push_timer(i, i));
+
+    EXPECT_FALSE(ctx.push_timer(TaskContext::MaxTimers, 0));
+    EXPECT_EQ(ctx.find_timer(TaskContext::MaxTimers), nullptr);
+
+    ctx.erase_timer(ctx.find_timer(0));
+
+    EXPECT_TRUE(ctx.push_timer(TaskContext::MaxTimers, 42));
+    ASSERT_NE(ctx.find_timer(TaskContext::MaxTimers), nullptr);
+    EXPECT_EQ(*ctx.find_timer(TaskContext::MaxTimers), 42);
+}
+
+TEST(TaskContextTest, DroppedEntries) {
+    Caliper     c;
+    TaskContext ctx;
+
+    size_t num_dropped = TaskContext::num_dropped_entries();
+
+    for (size_t i = 0; i <= TaskContext::MaxImmediates + 1; ++i) {
+        Attribute attr = 
+            c.create_attribute(std::string("test.taskcontext.dropped.") + std::to_string(i), CALI_TYPE_INT,
+                               CALI_ATTR_ASVALUE | CALI_ATTR_SCOPE_TASK | CALI_ATTR_SKIP_EVENTS);
+
+        EXPECT_EQ(ctx.set(attr, Variant(static_cast<int>(i))), 
+                  i < TaskContext::MaxImmediates ? CALI_SUCCESS : CALI_EBUSY);
+    }
+
+    EXPECT_EQ(TaskContext::num_dropped_entries(), num_dropped + 2);
+}
+
+//
+// --- TaskContextPool
+//
+
+TEST(TaskContextPoolTest, ConcurrentAcquireRelease) {
+    Caliper   c;
+    Attribute attr = 
+        c.create_attribute("test.taskpool.id", CALI_TYPE_UINT, 
+                           CALI_ATTR_ASVALUE | CALI_ATTR_SCOPE_TASK | CALI_ATTR_SKIP_EVENTS);
+
+    TaskContextPool pool;
+
+    const size_t NumThreads = 8;
+    const size_t NumIter    = 2000;
+    const size_t NumHeld    = 16;
+
+    std::vector<std::thread> threads;
+    std::vector<size_t>      errors(NumThreads, 0);
+
+    for (size_t t = 0; t < NumThreads; ++t)
+        threads.emplace_back([&pool,&attr,&errors,t,NumIter,NumHeld](){
+                TaskContext* ctx[NumHeld];
+
+                for (size_t i = 0; i < NumIter; ++i) {
+                    // each context is handed out only once at a time: mark
+                    // it, and check the marks after other threads had a go
+                    for (size_t n = 0; n < NumHeld; ++n) {
+                        ctx[n] = pool.acquire();
+
+                        if (!ctx[n] || !ctx[n]->get(attr).empty()) // must be cleared
+                            ++errors[t];
+                        else
+                            ctx[n]->set(attr, Variant(static_cast<uint64_t>((t * NumIter + i) * NumHeld + n)));
+                    }
+
+                    std::this_thread::yield();
+
+                    for (size_t n = 0; n < NumHeld; ++n) {
+                        if (!ctx[n])
+                            continue;
+                        if (ctx[n]->get(attr).to_uint() != (t * NumIter + i) * NumHeld + n)
+                            ++errors[t];
+
+                        pool.release(ctx[n]);
+                    }
+                }
+            });
+
+    for (auto& t : threads)
+        t.join();
+
+    for (size_t t = 0; t < NumThreads; ++t)
+        EXPECT_EQ(errors[t], 0) << "in thread " << t;
+
+    EXPECT_EQ(pool.num_in_use(), 0);
+    EXPECT_GE(pool.num_allocated(), NumThreads * NumHeld);
+}
+
+TEST(TaskContextPoolTest, ConcurrentTaskSwitch) {
+    Attribute attr = 
+        Caliper().create_attribute("test.taskswitch.id", CALI_TYPE_UINT, 
+                                   CALI_ATTR_ASVALUE | CALI_ATTR_SCOPE_TASK | CALI_ATTR_SKIP_EVENTS);
+
+    const size_t NumThreads = 8;
+    const size_t NumTasks   = 500;
+
+    std::vector<std::thread> threads;
+    std::vector<size_t>      errors(NumThreads, 0);
+
+    for (size_t t = 0; t < NumThreads; ++t)
+        threads.emplace_back([&attr,&errors,t,NumTasks](){
+                Caliper c;
+
+                TaskContext* outer = c.create_task();
+                c.switch_task(outer);
+                c.set(attr, Variant(static_cast<uint64_t>(t)));
+
+                for (size_t i = 0; i < NumTasks; ++i) {
+                    uint64_t     id   = (t + 1) * NumTasks + i;
+                    TaskContext* task = c.create_task();
+                    TaskContext* prev = c.switch_task(task);
+
+                    if (prev != outer || !c.get(attr).value().empty())
+                        ++errors[t];
+
+                    c.set(attr, Variant(id));
+
+                    std::this_thread::yield();
+
+                    if (c.get(attr).value().to_uint() != id)
+                        ++errors[t];
+
+                    c.switch_task(prev);
+                    c.release_task(task);
+
+                    if (c.get(attr).value().to_uint() != t)
+                        ++errors[t];
+                }
+
+                c.release_task(outer);
+
+                if (c.current_task() != nullptr)
+                    ++errors[t];
+            });
+
+    for (auto& t : threads)
+        t.join();
+
+    for (size_t t = 0; t < NumThreads; ++t)
+        EXPECT_EQ(errors[t], 0) << "in thread " << t;
+}
@@ -0,0 +1,125 @@
+#include "../Caliper.h"
+
+#include "Node.h"
+
+#include "gtest/gtest.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cali;
+
+namespace
+{
+
+/// Check that a new thread starts with an empty context, then set both
+/// attributes. Returns the id of the node attribute's context node.
+cali_id_t check_and_set_thread_context(const Attribute& node_attr, const Attribute& val_attr, int i, size_t& errors)
+{
+    Caliper c;
+
+    if (!c.get(node_attr).is_empty() || !c.get(val_attr).value().empty())
+        ++errors;
+
+    std::string str = std::string("thread.") + std::to_string(i);
+
+    c.begin(node_attr, Variant(CALI_TYPE_STRING, str.c_str(), str.size()));
+    c.set(val_attr, Variant(i));
+
+    Entry e = c.get(node_attr);
+
+    if (e.is_empty() || !e.node() || c.get(val_attr).value().to_int() != i)
+        ++errors;
+
+    // leave the context in place: the thread scope must be cleared when it
+    // is reused by another thread
+
+    return e.node() ? e.node()->id() : CALI_INV_ID;
+}
+
+} // namespace [anonymous]
+
+TEST(ThreadScopeTest, ContextClearedOnReuse) {
+    Attribute node_attr =
+        Caliper().create_attribute("test.threadscope.reuse.node", CALI_TYPE_STRING, CALI_ATTR_SCOPE_THREAD);
+    Attribute val_attr =
+        Caliper().create_attribute("test.threadscope.reuse.val", CALI_TYPE_INT,
+                                   CALI_ATTR_SCOPE_THREAD | CALI_ATTR_ASVALUE);
+
+    const int NumThreads = 200;
+
+    size_t errors = 0;
+
+    // one thread at a time, so each new thread reuses the previous one's scope
+    for (int i = 0; i < NumThreads; ++i) {
+        std::thread t([&node_attr,&val_attr,&errors,i](){
+                check_and_set_thread_context(node_attr, val_attr, i, errors);
+            });
+
+        t.join();
+    }
+
+    EXPECT_EQ(errors, 0);
+}
+
+TEST(ThreadScopeTest, PoolOverflow) {
+    Attribute node_attr =
+        Caliper().create_attribute("test.threadscope.overflow.node", CALI_TYPE_STRING, CALI_ATTR_SCOPE_THREAD);
+    Attribute val_attr =
+        Caliper().create_attribute("test.threadscope.overflow.val", CALI_TYPE_INT,
+                                   CALI_ATTR_SCOPE_THREAD | CALI_ATTR_ASVALUE);
+
+    // more live threads than the default thread scope pool size, so that
+    // some scopes are deleted when the threads exit
+    const int NumThreads = 160;
+    const int NumRounds  = 2;
+
+    std::vector<cali_id_t>   node_ids(NumThreads * NumRounds, CALI_INV_ID);
+    std::vector<size_t>      errors(NumThreads, 0);
+
+    for (int r = 0; r < NumRounds; ++r) {
+        std::mutex               mtx;
+        std::condition_variable  cv;
+        int                      num_waiting = 0;
+
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < NumThreads; ++t)
+            threads.emplace_back([&,r,t](){
+                    int i = r * NumThreads + t;
+
+                    node_ids[i] = check_and_set_thread_context(node_attr, val_attr, i, errors[t]);
+
+                    // keep all threads of this round alive at the same time
+                    std::unique_lock<std::mutex> lock(mtx);
+
+                    if (++num_waiting == NumThreads)
+                        cv.notify_all();
+                    else
+                        cv.wait(lock, [&](){ return num_waiting == NumThreads; });
+                });
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    for (int t = 0; t < NumThreads; ++t)
+        EXPECT_EQ(errors[t], 0) << "in thread " << t;
+
+    // context nodes created in released (and possibly deleted) scopes must stay valid
+
+    Caliper c;
+
+    for (int i = 0; i < NumThreads * NumRounds; ++i) {
+        ASSERT_NE(node_ids[i], CALI_INV_ID);
+
+        Node* node = c.node(node_ids[i]);
+
+        ASSERT_NE(node, nullptr);
+        EXPECT_EQ(node->attribute(), node_attr.id());
+        EXPECT_EQ(node->data().to_string(), std::string("thread.") + std::to_string(i));
+    }
+}
@@ -0,0 +1,287 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file NetBatch.cpp
+/// Binary batch format implementation
+
+#include "NetBatch.h"
+
+#include "c-util/vlenc.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace cali;
+
+namespace
+{
+
+const unsigned char magic[4] = { 'C', 'A', 'L', 'B' };
+
+void append_u64(uint64_t val, std::vector<unsigned char>& buf)
+{
+    unsigned char tmp[10];
+    size_t n = vlenc_u64(val, tmp);
+
+    buf.insert(buf.end(), tmp, tmp+n);
+}
+
+void append_variant(const Variant& v, std::vector<unsigned char>& buf)
+{
+    const unsigned char* ptr  = static_cast<const unsigned char*>(v.data());
+    size_t               size = v.empty() ? 0 : v.size();
+
+    append_u64(static_cast<uint64_t>(v.type()), buf);
+    append_u64(size, buf);
+
+    if (size > 0)
+        buf.insert(buf.end(), ptr, ptr+size);
+}
+
+// The ids use id+1, so that CALI_INV_ID encodes as 0 
+
+inline uint64_t enc_id(cali_id_t id) { return id == CALI_INV_ID ? 0 : id + 1; }
+inline cali_id_t dec_id(uint64_t v)  { return v == 0 ? CALI_INV_ID : v - 1;   }
+
+bool read_u64(const unsigned char* buf, size_t size, size_t* pos, uint64_t* val)
+{
+    if (*pos >= size)
+        return false;
+
+    if (size - *pos >= 10) {
+        *val = vldec_u64(buf + *pos, pos);
+        return true;
+    }
+
+    // near the end of the buffer: don't read past it
+    unsigned char tmp[10] = { 0 };
+    std::copy(buf + *pos, buf + size, tmp);
+
+    size_t p = 0;
+    *val = vldec_u64(tmp, &p);
+
+    if (*pos + p > size)
+        return false;
+
+    *pos += p;
+
+    return true;
+}
+
+bool read_variant(const unsigned char* buf, size_t size, size_t* pos, Variant* v)
+{
+    uint64_t type = 0, len = 0;
+
+    if (!read_u64(buf, size, pos, &type) || !read_u64(buf, size, pos, &len))
+        return false;
+    if (type > CALI_MAXTYPE || len > size - *pos)
+        return false;
+
+    const unsigned char* ptr = buf + *pos;
+    *pos += len;
+
+    switch (type) {
+    case CALI_TYPE_INV:
+        *v = Variant();
+        break;
+    case CALI_TYPE_USR:
+    case CALI_TYPE_STRING:
+        *v = Variant(static_cast<cali_attr_type>(type), ptr, len);
+        break;
+    default:
+    {
+        // copy fixed-size types so we don't read past the encoded value
+        uint64_t tmp = 0;
+        std::memcpy(&tmp, ptr, std::min<size_t>(len, sizeof(tmp)));
+        *v = Variant(static_cast<cali_attr_type>(type), &tmp, len);
+    }
+    }
+
+    return true;
+}
+
+void write_u32(uint32_t val, unsigned char* buf)
+{
+    for (int i = 0; i < 4; ++i)
+        buf[i] = static_cast<unsigned char>((val >> (8*i)) & 0xFF);
+}
+
+uint32_t read_u32(const unsigned char* buf)
+{
+    uint32_t val = 0;
+
+    for (int i = 0; i < 4; ++i)
+        val |= static_cast<uint32_t>(buf[i]) << (8*i);
+
+    return val;
+}
+
+} // namespace 
+
+namespace cali
+{
+
+namespace netbatch
+{
+
+void write_header(const Header& header, unsigned char* buf)
+{
+    std::copy(magic, magic+4, buf);
+
+    buf[4] = Version;
+    buf[5] = static_cast<unsigned char>(header.flags);
+    buf[6] = 0;
+    buf[7] = 0;
+
+    write_u32(header.raw_size,     buf+8);
+    write_u32(header.payload_size, buf+12);
+}
+
+bool read_header(const unsigned char* buf, Header* header)
+{
+    if (!std::equal(magic, magic+4, buf) || buf[4] != Version)
+        return false;
+
+    header->flags        = buf[5];
+    header->raw_size     = read_u32(buf+8);
+    header->payload_size = read_u32(buf+12);
+
+    return true;
+}
+
+void append_node(cali_id_t id, cali_id_t attr, cali_id_t parent, const Variant& data, 
+                 std::vector<unsigned char>& buf)
+{
+    append_u64(NodeKind, buf);
+    append_u64(enc_id(id), buf);
+    append_u64(enc_id(attr), buf);
+    append_u64(enc_id(parent), buf);
+    append_variant(data, buf);
+}
+
+void append_snapshot(size_t n_nodes, const cali_id_t node_ids[], 
+                     size_t n_imm,   const cali_id_t attr[], const Variant data[],
+                     std::vector<unsigned char>& buf)
+{
+    append_u64(SnapshotKind, buf);
+    append_u64(n_nodes, buf);
+
+    for (size_t i = 0; i < n_nodes; ++i)
+        append_u64(enc_id(node_ids[i]), buf);
+
+    append_u64(n_imm, buf);
+
+    for (size_t i = 0; i < n_imm; ++i) {
+        append_u64(enc_id(attr[i]), buf);
+        append_variant(data[i], buf);
+    }
+}
+
+bool decode(const unsigned char* buf, size_t size, NodeFn node_fn, SnapshotFn snapshot_fn)
+{
+    size_t pos = 0;
+
+    std::vector<cali_id_t> ids;
+    std::vector<cali_id_t> attr;
+    std::vector<Variant>   data;
+
+    while (pos < size) {
+        uint64_t kind = 0;
+
+        if (!read_u64(buf, size, &pos, &kind))
+            return false;
+
+        switch (kind) {
+        case NodeKind:
+        {
+            uint64_t id = 0, a = 0, parent = 0;
+            Variant  v;
+
+            if (!read_u64(buf, size, &pos, &id)     ||
+                !read_u64(buf, size, &pos, &a)      ||
+                !read_u64(buf, size, &pos, &parent) ||
+                !read_variant(buf, size, &pos, &v))
+                return false;
+
+            if (node_fn)
+                node_fn(dec_id(id), dec_id(a), dec_id(parent), v);
+        }
+        break;
+        case SnapshotKind:
+        {
+            uint64_t n = 0;
+
+            ids.clear();
+            attr.clear();
+            data.clear();
+
+            if (!read_u64(buf, size, &pos, &n) || n > size - pos)
+                return false;
+
+            for (uint64_t i = 0; i < n; ++i) {
+                uint64_t id = 0;
+
+                if (!read_u64(buf, size, &pos, &id))
+                    return false;
+
+                ids.push_back(dec_id(id));
+            }
+
+            if (!read_u64(buf, size, &pos, &n) || n > size - pos)
+                return false;
+
+            for (uint64_t i = 0; i < n; ++i) {
+                uint64_t a = 0;
+                Variant  v;
+
+                if (!read_u64(buf, size, &pos, &a) || !read_variant(buf, size, &pos, &v))
+                    return false;
+
+                attr.push_back(dec_id(a));
+                data.push_back(v);
+            }
+
+            if (snapshot_fn)
+                snapshot_fn(ids.size(), ids.data(), attr.size(), attr.data(), data.data());
+        }
+        break;
+        default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+} // namespace netbatch
+
+} // namespace cali
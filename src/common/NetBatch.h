@@ -0,0 +1,105 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file NetBatch.h
+/// Binary batch format for streaming context tree nodes and snapshot records
+
+#pragma once
+
+#include "cali_types.h"
+
+#include "Variant.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cali
+{
+
+/// \brief Binary batch format used by the netout service.
+///
+/// A batch is a 16-byte frame header followed by the payload. The
+/// (uncompressed) payload is a sequence of node and snapshot records.
+/// Integers are variable-length encoded; header fields are little endian.
+/// Node records must be defined before (or in the same batch as) the
+/// snapshot records that refer to them.
+
+namespace netbatch
+{
+
+const unsigned char Version    = 1;
+const size_t        HeaderSize = 16;
+
+enum RecordKind {
+    NodeKind     = 1,
+    SnapshotKind = 2
+};
+
+enum HeaderFlags {
+    Compressed   = 1
+};
+
+struct Header {
+    unsigned  flags;
+    uint32_t  raw_size;     ///< Size of the uncompressed payload
+    uint32_t  payload_size; ///< Size of the payload following the header
+};
+
+/// \brief Write frame header into \a buf, which must hold HeaderSize bytes
+void     write_header(const Header& header, unsigned char* buf);
+/// \brief Read frame header from \a buf. Returns \c false if the magic
+///   number or version don't match.
+bool     read_header(const unsigned char* buf, Header* header);
+
+void     append_node(cali_id_t id, cali_id_t attr, cali_id_t parent, const Variant& data, 
+                     std::vector<unsigned char>& buf);
+void     append_snapshot(size_t n_nodes, const cali_id_t node_ids[], 
+                         size_t n_imm,   const cali_id_t attr[], const Variant data[],
+                         std::vector<unsigned char>& buf);
+
+typedef std::function<void(cali_id_t id, cali_id_t attr, cali_id_t parent, const Variant& data)>
+    NodeFn;
+typedef std::function<void(size_t n_nodes, const cali_id_t node_ids[], 
+                           size_t n_imm,   const cali_id_t attr[], const Variant data[])>
+    SnapshotFn;
+
+/// \brief Decode the records in the uncompressed payload \a buf.
+///
+/// String variants passed to the callbacks point into \a buf.
+///
+/// \return \c false if the payload is malformed
+bool     decode(const unsigned char* buf, size_t size, NodeFn node_fn, SnapshotFn snapshot_fn);
+
+} // namespace netbatch
+
+} // namespace cali
@@ -90,6 +90,25 @@ struct cali::SnapshotTextFormatter::SnapshotTextFormatterImpl
         }
     }
 
+    std::vector<FieldSpec>
+    fields() {
+        std::lock_guard<std::mutex>
+            g(m_field_mutex);
+
+        std::vector<FieldSpec> ret;
+
+        for (const Field& f : m_fields) {
+            FieldSpec spec = { f.prefix, f.attr_name, f.width, f.align };
+
+            if (f.attr != Attribute::invalid)
+                spec.attr_name = f.attr.name();
+
+            ret.push_back(spec);
+        }
+
+        return ret;
+    }
+
     std::ostream& 
     print(std::ostream& os, const CaliperMetadataAccessInterface* db, const std::vector<Entry>& list) {
         std::vector<Field> fields;
@@ -173,3 +192,9 @@ SnapshotTextFormatter::print(std::ostream& os, const CaliperMetadataAccessInterf
 {
     return mP->print(os, db, list);
 }
+
+std::vector<SnapshotTextFormatter::FieldSpec>
+SnapshotTextFormatter::fields() const
+{
+    return mP->fields();
+}
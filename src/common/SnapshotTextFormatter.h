@@ -24,6 +24,15 @@ class SnapshotTextFormatter
 
 public:
 
+    /// \brief A parsed format field: a literal prefix followed by the
+    ///   value of attribute \a attr_name, padded to \a width characters
+    struct FieldSpec {
+        std::string prefix;
+        std::string attr_name;
+        int         width;
+        char        align;
+    };
+
     SnapshotTextFormatter(const std::string& format_str = "");
 
     ~SnapshotTextFormatter();
@@ -33,6 +42,10 @@ public:
 
     std::ostream& 
     print(std::ostream&, const CaliperMetadataAccessInterface*, const std::vector<Entry>&);
+
+    /// \brief Return the parsed fields of the current format string
+    std::vector<FieldSpec>
+    fields() const;
 };
 
 }
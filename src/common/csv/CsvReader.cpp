@@ -71,6 +71,39 @@ struct CsvReader::CsvReaderImpl
 
         return true;
     }
+
+    bool read(size_t begin, size_t end, 
+              function<bool(const string&)> line_filter, 
+              function<void(const RecordMap&)> rec_handler) {
+        if (m_filename.empty())
+            return false;
+
+        ifstream is(m_filename.c_str());
+
+        if (!is)
+            return false;
+
+        size_t pos = 0;
+
+        if (begin > 0) {
+            // skip the line running into the range: it belongs to the previous one
+
+            is.seekg(begin - 1);
+
+            string partial;
+
+            if (!getline(is, partial))
+                return true;
+
+            pos = begin + partial.size();
+        }
+
+        for (string line ; pos < end && getline(is, line); pos += line.size() + 1)
+            if (line_filter(line))
+                rec_handler(CsvSpec::read_record(line));
+
+        return true;
+    }
 };
 
 CsvReader::CsvReader(const string& filename)
@@ -85,3 +118,11 @@ CsvReader::read(function<void(const RecordMap&)> rec_handler)
 {
     return mP->read(rec_handler);
 }
+
+bool
+CsvReader::read(size_t begin, size_t end,
+                function<bool(const string&)> line_filter,
+                function<void(const RecordMap&)> rec_handler)
+{
+    return mP->read(begin, end, line_filter, rec_handler);
+}
@@ -38,6 +38,7 @@
 
 #include "../RecordMap.h"
 
+#include <cstddef>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -59,6 +60,16 @@ public:
     ~CsvReader();
 
     bool read(std::function<void(const RecordMap&)>);
+
+    /// \brief Read records from the lines that start within the byte range
+    ///   [\a begin, \a end) of the file. Lines for which \a line_filter 
+    ///   returns \c false are skipped without being parsed.
+    ///
+    /// Splitting a file into adjacent ranges processes each line exactly once.
+    /// Not available for stdin.
+    bool read(std::size_t begin, std::size_t end, 
+              std::function<bool(const std::string&)> line_filter,
+              std::function<void(const RecordMap&)>   rec_handler);
 };
 
 } // namespace cali
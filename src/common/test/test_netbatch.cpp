@@ -0,0 +1,87 @@
+#include "../NetBatch.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <string>
+
+using namespace cali;
+
+TEST(NetBatch_Test, Header) {
+    netbatch::Header in  = { netbatch::Compressed, 1234567, 42 };
+    netbatch::Header out = { 0, 0, 0 };
+
+    unsigned char buf[netbatch::HeaderSize];
+
+    netbatch::write_header(in, buf);
+
+    ASSERT_TRUE(netbatch::read_header(buf, &out));
+
+    EXPECT_EQ(out.flags,        in.flags);
+    EXPECT_EQ(out.raw_size,     in.raw_size);
+    EXPECT_EQ(out.payload_size, in.payload_size);
+
+    buf[0] = 'X';
+
+    EXPECT_FALSE(netbatch::read_header(buf, &out));
+}
+
+TEST(NetBatch_Test, EncodeDecode) {
+    const char* str = "my test string";
+
+    std::vector<unsigned char> buf;
+
+    netbatch::append_node(42, 8, CALI_INV_ID, Variant(CALI_TYPE_STRING, str, strlen(str)), buf);
+    netbatch::append_node(43, 42, 42, Variant(-7), buf);
+
+    cali_id_t node_ids[] = { 43 };
+    cali_id_t attr[]     = { 12, 13, 14 };
+    Variant   data[]     = { Variant(static_cast<uint64_t>(1) << 40), Variant(2.5), Variant(true) };
+
+    netbatch::append_snapshot(1, node_ids, 3, attr, data, buf);
+
+    int num_nodes = 0, num_snapshots = 0;
+
+    bool ok = netbatch::decode(buf.data(), buf.size(), 
+        [&](cali_id_t id, cali_id_t a, cali_id_t parent, const Variant& v) {
+            if (num_nodes == 0) {
+                EXPECT_EQ(id, 42);
+                EXPECT_EQ(a,  8);
+                EXPECT_EQ(parent, CALI_INV_ID);
+                EXPECT_EQ(v.type(), CALI_TYPE_STRING);
+                EXPECT_EQ(v.to_string(), std::string(str));
+            } else {
+                EXPECT_EQ(id, 43);
+                EXPECT_EQ(parent, 42);
+                EXPECT_EQ(v.to_int(), -7);
+            }
+            ++num_nodes;
+        },
+        [&](size_t n, const cali_id_t ids[], size_t m, const cali_id_t a[], const Variant d[]) {
+            ASSERT_EQ(n, 1);
+            ASSERT_EQ(m, 3);
+            EXPECT_EQ(ids[0], 43);
+
+            for (size_t i = 0; i < m; ++i) {
+                EXPECT_EQ(a[i], attr[i]);
+                EXPECT_EQ(d[i], data[i]);
+            }
+
+            ++num_snapshots;
+        });
+
+    EXPECT_TRUE(ok);
+    EXPECT_EQ(num_nodes, 2);
+    EXPECT_EQ(num_snapshots, 1);
+}
+
+TEST(NetBatch_Test, Truncated) {
+    const char* str = "my test string";
+
+    std::vector<unsigned char> buf;
+
+    netbatch::append_node(42, 8, CALI_INV_ID, Variant(CALI_TYPE_STRING, str, strlen(str)), buf);
+
+    for (size_t len = 1; len < buf.size(); ++len)
+        EXPECT_FALSE(netbatch::decode(buf.data(), len, nullptr, nullptr));
+}
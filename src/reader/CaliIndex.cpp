@@ -0,0 +1,413 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// @file CaliIndex.cpp
+/// CaliIndex implementation
+
+#include "CaliIndex.h"
+
+#include "CaliperMetadataDB.h"
+
+#include <Attribute.h>
+#include <Log.h>
+#include <Node.h>
+#include <StringConverter.h>
+
+#include <csv/CsvSpec.h>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace cali;
+using namespace std;
+
+namespace
+{
+
+const char* index_version = "2";
+
+/// Get size and modification time (in nanoseconds) of \a filename
+bool
+file_info(const string& filename, uint64_t* size, uint64_t* mtime)
+{
+    struct stat s;
+
+    if (stat(filename.c_str(), &s) != 0)
+        return false;
+
+#if defined(__APPLE__)
+    const struct timespec& ts = s.st_mtimespec;
+#else
+    const struct timespec& ts = s.st_mtim;
+#endif
+
+    *size  = static_cast<uint64_t>(s.st_size);
+    *mtime = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+
+    return true;
+}
+
+/// Convert a range bound to string without losing precision.
+/// Variant::to_string() only keeps six decimals for floating-point values.
+string
+range_value_string(const Variant& v)
+{
+    if (v.type() == CALI_TYPE_DOUBLE) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.17g", v.to_double());
+
+        return string(buf);
+    }
+
+    return v.to_string();
+}
+
+inline uint64_t
+uint_from_rec(const RecordMap& rec, const char* key)
+{
+    auto it = rec.find(key);
+
+    if (it == rec.end() || it->second.empty())
+        return 0;
+
+    return StringConverter(it->second.front()).to_uint();
+}
+
+inline string
+string_from_rec(const RecordMap& rec, const char* key)
+{
+    auto it = rec.find(key);
+
+    return (it == rec.end() || it->second.empty()) ? string() : it->second.front();
+}
+
+} // namespace [anonymous]
+
+
+struct CaliIndex::CaliIndexImpl
+{
+    struct Block {
+        uint64_t offset;
+        uint64_t length;
+        RangeMap ranges;
+    };
+
+    string            m_filename;
+
+    vector<RecordMap> m_meta;
+    vector<Block>     m_blocks;
+
+    CaliIndexImpl(const string& filename)
+        : m_filename(filename)
+        { }
+
+    //
+    // --- build
+    //
+
+    typedef std::map< cali_id_t, std::pair<Variant, Variant> > IdRangeMap;
+
+    static void update_range(IdRangeMap& ranges, cali_id_t attr_id, const Variant& v) {
+        bool ordered = (v.type() != CALI_TYPE_USR);
+        auto it      = ranges.find(attr_id);
+
+        if (it == ranges.end())
+            ranges.insert(make_pair(attr_id, ordered ? make_pair(v, v) : make_pair(Variant(), Variant())));
+        else if (ordered && !it->second.first.empty()) {
+            if (v < it->second.first)
+                it->second.first  = v;
+            if (it->second.second < v)
+                it->second.second = v;
+        }
+    }
+
+    static void write_block(ostream& os, const CaliperMetadataAccessInterface& db, std::size_t id,
+                            uint64_t offset, uint64_t length, const IdRangeMap& ranges) {
+        CsvSpec::write_record(os, { { "__rec",  { "block"               } },
+                                    { "id",     { std::to_string(id)     } },
+                                    { "offset", { std::to_string(offset) } },
+                                    { "length", { std::to_string(length) } } });
+
+        for (const auto &p : ranges) {
+            Attribute attr = db.get_attribute(p.first);
+
+            if (attr == Attribute::invalid)
+                continue;
+
+            RecordMap rec { { "__rec", { "range"                          } },
+                            { "block", { std::to_string(id)               } },
+                            { "attr",  { attr.name()                      } },
+                            { "type",  { cali_type2string(attr.type())    } } };
+
+            if (!p.second.first.empty()) {
+                rec["min"] = { ::range_value_string(p.second.first)  };
+                rec["max"] = { ::range_value_string(p.second.second) };
+            }
+
+            CsvSpec::write_record(os, rec);
+        }
+    }
+
+    bool build(std::size_t block_size) {
+        uint64_t size = 0, mtime = 0;
+
+        if (!::file_info(m_filename, &size, &mtime))
+            return false;
+
+        ifstream is(m_filename.c_str());
+
+        if (!is)
+            return false;
+
+        string   idxfile = index_filename(m_filename);
+        string   tmpfile = idxfile + ".tmp";
+        ofstream os(tmpfile.c_str());
+
+        if (!os) {
+            Log(0).stream() << "cali-index: could not open " << tmpfile << endl;
+            return false;
+        }
+
+        CsvSpec::write_record(os, { { "__rec",     { "cali-index"                } },
+                                    { "version",   { ::index_version             } },
+                                    { "size",      { std::to_string(size)        } },
+                                    { "mtime",     { std::to_string(mtime)       } },
+                                    { "blocksize", { std::to_string(block_size)  } } });
+
+        // The metadata records are written first, blocks are written after
+        // we have seen the entire file.
+
+        CaliperMetadataDB  db;
+        IdMap              idmap;
+
+        std::size_t        num_blocks = 0;
+        std::size_t        num_recs   = 0;
+        uint64_t           pos        = 0;
+        uint64_t           blk_offset = 0;
+        IdRangeMap         ranges;
+
+        std::ostringstream blocks;
+
+        NodeProcessFn      node_fn = [](CaliperMetadataAccessInterface&, const Node*) { };
+        SnapshotProcessFn  snap_fn =
+            [&ranges](CaliperMetadataAccessInterface&, const EntryList& list) {
+                for (const Entry& e : list)
+                    if (e.node()) {
+                        for (const Node* node = e.node(); node && node->attribute() != CALI_INV_ID; node = node->parent())
+                            update_range(ranges, node->attribute(), node->data());
+                    } else
+                        update_range(ranges, e.attribute(), e.value());
+            };
+
+        for (string line; getline(is, line); ) {
+            uint64_t  start = pos;
+            RecordMap rec   = CsvSpec::read_record(line);
+
+            pos += line.size() + 1;
+
+            if (get_record_type(rec) == "ctx") {
+                if (num_recs == 0)
+                    blk_offset = start;
+
+                db.merge(rec, idmap, node_fn, snap_fn);
+
+                if (++num_recs >= block_size) {
+                    write_block(blocks, db, num_blocks++, blk_offset, pos - blk_offset, ranges);
+                    ranges.clear();
+                    num_recs = 0;
+                }
+            } else {
+                db.merge(rec, idmap, node_fn, snap_fn);
+                CsvSpec::write_record(os, rec);
+            }
+        }
+
+        if (num_recs > 0)
+            write_block(blocks, db, num_blocks++, blk_offset, pos - blk_offset, ranges);
+
+        os << blocks.str();
+        os.close();
+
+        if (!os || std::rename(tmpfile.c_str(), idxfile.c_str()) != 0) {
+            Log(0).stream() << "cali-index: could not write " << idxfile << endl;
+            std::remove(tmpfile.c_str());
+            return false;
+        }
+
+        return true;
+    }
+
+    //
+    // --- load
+    //
+
+    bool load() {
+        m_meta.clear();
+        m_blocks.clear();
+
+        string   idxfile = index_filename(m_filename);
+        ifstream is(idxfile.c_str());
+
+        if (!is)
+            return false;
+
+        string line;
+
+        if (!getline(is, line))
+            return false;
+
+        RecordMap header = CsvSpec::read_record(line);
+        uint64_t  size = 0, mtime = 0;
+
+        if (get_record_type(header) != "cali-index" || ::string_from_rec(header, "version") != ::index_version)
+            return false;
+
+        if (!::file_info(m_filename, &size, &mtime) ||
+            ::uint_from_rec(header, "size")  != size  ||
+            ::uint_from_rec(header, "mtime") != mtime) {
+            Log(1).stream() << "Index " << idxfile << " is out of date" << endl;
+            return false;
+        }
+
+        while (getline(is, line)) {
+            RecordMap rec  = CsvSpec::read_record(line);
+            string    type = get_record_type(rec);
+
+            if (type == "block") {
+                m_blocks.push_back({ ::uint_from_rec(rec, "offset"), ::uint_from_rec(rec, "length"), RangeMap() });
+            } else if (type == "range") {
+                std::size_t block = ::uint_from_rec(rec, "block");
+
+                if (block >= m_blocks.size())
+                    return false;
+
+                m_blocks[block].ranges.insert(make_pair(::string_from_rec(rec, "attr"),
+                                                        AttributeRange { cali_string2type(::string_from_rec(rec, "type").c_str()),
+                                                                         ::string_from_rec(rec, "min"),
+                                                                         ::string_from_rec(rec, "max") }));
+            } else
+                m_meta.push_back(std::move(rec));
+        }
+
+        return true;
+    }
+
+    //
+    // --- read
+    //
+
+    bool read(BlockFilterFn filter, std::function<void(const RecordMap&)> rec_handler, std::size_t* skipped_blocks) {
+        ifstream is(m_filename.c_str());
+
+        if (!is)
+            return false;
+
+        for (const RecordMap& rec : m_meta)
+            rec_handler(rec);
+
+        std::size_t skipped = 0;
+
+        for (const Block& block : m_blocks) {
+            if (filter && !filter(block.ranges)) {
+                ++skipped;
+                continue;
+            }
+
+            is.clear();
+            is.seekg(block.offset);
+
+            uint64_t pos = block.offset;
+
+            for (string line; pos < block.offset + block.length && getline(is, line); ) {
+                pos += line.size() + 1;
+
+                // Metadata records were already processed: skip them without parsing
+                if (line.compare(0, 10, "__rec=node") == 0)
+                    continue;
+
+                RecordMap rec = CsvSpec::read_record(line);
+
+                if (get_record_type(rec) == "ctx")
+                    rec_handler(rec);
+            }
+        }
+
+        if (skipped_blocks)
+            *skipped_blocks = skipped;
+
+        return true;
+    }
+};
+
+
+CaliIndex::CaliIndex(const std::string& filename)
+    : mP { new CaliIndexImpl(filename) }
+{ }
+
+CaliIndex::~CaliIndex()
+{
+    mP.reset();
+}
+
+std::string
+CaliIndex::index_filename(const std::string& filename)
+{
+    return filename + ".idx";
+}
+
+bool
+CaliIndex::build(std::size_t block_size)
+{
+    return mP->build(block_size > 0 ? block_size : 1);
+}
+
+bool
+CaliIndex::load()
+{
+    return mP->load();
+}
+
+std::size_t
+CaliIndex::num_blocks() const
+{
+    return mP->m_blocks.size();
+}
+
+bool
+CaliIndex::read(BlockFilterFn filter, std::function<void(const RecordMap&)> rec_handler, std::size_t* skipped_blocks)
+{
+    return mP->read(filter, rec_handler, skipped_blocks);
+}
@@ -0,0 +1,112 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+///@file CaliIndex.h
+/// CaliIndex class declaration
+
+#ifndef CALI_CALIINDEX_H
+#define CALI_CALIINDEX_H
+
+#include "cali_types.h"
+
+#include "RecordMap.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace cali
+{
+
+/// \brief Sidecar index for a .cali file
+///
+/// The index for file \c foo.cali is stored in \c foo.cali.idx. It contains
+/// a copy of the file's node table and other metadata records, and splits
+/// the file's snapshot records into blocks of consecutive records. For each
+/// block, it stores the byte offsets in the file, and the value range 
+/// (min/max) of each attribute in the block, including attributes on the 
+/// snapshots' node paths. Readers can use the value ranges to skip blocks 
+/// that cannot contain any matching snapshots.
+///
+/// The index records the size and modification time (with nanosecond 
+/// resolution, where the file system provides it) of the .cali file, and
+/// is considered stale if either has changed.
+
+class CaliIndex
+{
+    struct CaliIndexImpl;
+    std::shared_ptr<CaliIndexImpl> mP;
+
+public:
+
+    /// Value range of an attribute in a block. Values are given as strings
+    /// in the attribute's type. \a min and \a max are empty for types without
+    /// an ordering (e.g., blobs).
+    struct AttributeRange {
+        cali_attr_type type;
+        std::string    min;
+        std::string    max;
+    };
+
+    typedef std::map<std::string, AttributeRange> RangeMap;
+
+    /// Return \c false from a BlockFilterFn to skip a block with the given
+    /// attribute ranges.
+    typedef std::function<bool(const RangeMap&)>  BlockFilterFn;
+
+    CaliIndex(const std::string& filename);
+
+    ~CaliIndex();
+
+    static std::string index_filename(const std::string& filename);
+
+    /// \brief Read the .cali file and write its index
+    /// \param block_size Max. number of snapshot records per block
+    bool build(std::size_t block_size = 4096);
+
+    /// \brief Load the index file. Returns \c false if there is no index
+    ///   or the index is stale.
+    bool load();
+
+    std::size_t num_blocks() const;
+
+    /// \brief Read the .cali file through the loaded index. Passes all 
+    ///   metadata records to \a rec_handler first, followed by the snapshot 
+    ///   records of all blocks that pass \a filter.
+    /// \return \c false if the .cali file could not be read
+    bool read(BlockFilterFn filter, std::function<void(const RecordMap&)> rec_handler, std::size_t* skipped_blocks = nullptr);
+};
+
+} // namespace cali
+
+#endif
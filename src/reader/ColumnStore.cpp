@@ -0,0 +1,361 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// @file ColumnStore.cpp
+/// ColumnStore implementation
+
+#include "ColumnStore.h"
+
+#include "Node.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+
+using namespace cali;
+
+namespace
+{
+
+inline bool
+is_string_type(cali_attr_type type)
+{
+    return type == CALI_TYPE_STRING || type == CALI_TYPE_USR;
+}
+
+template<typename T>
+inline int
+compare_raw(uint64_t lhs, uint64_t rhs)
+{
+    T a, b;
+
+    memcpy(&a, &lhs, sizeof(T));
+    memcpy(&b, &rhs, sizeof(T));
+
+    return (a < b ? -1 : (b < a ? 1 : 0));
+}
+
+} // namespace [anonymous]
+
+
+struct ColumnStore::ColumnStoreImpl
+{
+    struct Column {
+        cali_attr_type        type;  ///< Value type. CALI_TYPE_INV until the first value arrives.
+        std::vector<uint64_t> data;  ///< Raw numeric value or dictionary index
+        std::vector<bool>     valid;
+    };
+
+    std::vector<Column>             m_cols;
+    std::vector<uint32_t>           m_row_size;
+
+    std::unordered_map<std::string, uint64_t> m_dict;
+    std::vector<const std::string*> m_dict_strings;
+
+    mutable std::mutex              m_lock;
+
+    //
+    // --- storage
+    //
+
+    uint64_t intern(const char* str, std::size_t len) {
+        // Strings may or may not include the terminating NUL: strip it so
+        // that both map to the same dictionary entry
+        if (len > 0 && str[len-1] == 0)
+            --len;
+
+        auto ret = m_dict.emplace(std::string(str, len), m_dict_strings.size());
+
+        if (ret.second)
+            m_dict_strings.push_back(&(ret.first->first));
+
+        return ret.first->second;
+    }
+
+    Variant value(const Column& col, std::size_t row) const {
+        if (!col.valid[row])
+            return Variant();
+
+        if (is_string_type(col.type)) {
+            const std::string* str = m_dict_strings[col.data[row]];
+            return Variant(col.type, str->data(), str->size());
+        }
+
+        uint64_t bits = col.data[row];
+        return Variant(col.type, &bits, sizeof(uint64_t));
+    }
+
+    void convert_to_string(Column& col) {
+        for (std::size_t row = 0; row < col.data.size(); ++row)
+            if (col.valid[row]) {
+                std::string str = value(col, row).to_string();
+                col.data[row] = intern(str.data(), str.size());
+            }
+
+        col.type = CALI_TYPE_STRING;
+    }
+
+    void push(Column& col, const Variant& v) {
+        if (v.empty()) {
+            col.data.push_back(0);
+            col.valid.push_back(false);
+
+            return;
+        }
+
+        cali_attr_type type = v.type();
+
+        if (col.type == CALI_TYPE_INV)
+            col.type = type;
+        else if (col.type != type && !is_string_type(col.type))
+            convert_to_string(col);
+
+        uint64_t bits = 0;
+
+        if (is_string_type(col.type)) {
+            if (is_string_type(type)) {
+                bits = intern(static_cast<const char*>(v.data()), v.size());
+            } else {
+                std::string str = v.to_string();
+                bits = intern(str.data(), str.size());
+            }
+        } else
+            memcpy(&bits, v.data(), std::min(v.size(), sizeof(uint64_t)));
+
+        col.data.push_back(bits);
+        col.valid.push_back(true);
+    }
+
+    //
+    // --- value extraction
+    //
+
+    static Variant extract(const EntryList& list, cali_id_t attr_id, std::string& path) {
+        for (const Entry& e : list) {
+            if (e.node()) {
+                Variant v;
+                int     n = 0;
+
+                // Nested values of the same attribute are joined to a path string
+                for (const Node* node = e.node(); node; node = node->parent())
+                    if (node->attribute() == attr_id) {
+                        if (n == 1)
+                            path = v.to_string();
+                        if (n > 0)
+                            path = node->data().to_string().append("/").append(path);
+                        else
+                            v = node->data();
+
+                        ++n;
+                    }
+
+                if (n > 1)
+                    return Variant(CALI_TYPE_STRING, path.data(), path.size());
+                if (n > 0)
+                    return v;
+            } else if (e.attribute() == attr_id)
+                return e.value();
+        }
+
+        return Variant();
+    }
+
+    bool append(const EntryList& list, const std::vector<cali_id_t>& attr_ids) {
+        std::vector<Variant>     vals(attr_ids.size());
+        std::vector<std::string> paths(attr_ids.size());
+
+        bool active = false;
+
+        for (std::size_t c = 0; c < attr_ids.size(); ++c) {
+            if (attr_ids[c] == CALI_INV_ID)
+                continue;
+
+            Variant v = extract(list, attr_ids[c], paths[c]);
+
+            // Treat empty strings as missing values
+            if (is_string_type(v.type()) && v.to_string().empty())
+                v = Variant();
+
+            if (!v.empty()) {
+                vals[c] = v;
+                active  = true;
+            }
+        }
+
+        if (!active)
+            return false;
+
+        std::lock_guard<std::mutex>
+            g(m_lock);
+
+        std::size_t num_rows = m_row_size.size();
+
+        if (m_cols.size() < vals.size()) {
+            m_cols.resize(vals.size(), Column { CALI_TYPE_INV, { }, { } });
+
+            for (Column& col : m_cols) {
+                col.data.resize(num_rows, 0);
+                col.valid.resize(num_rows, false);
+            }
+        }
+
+        for (std::size_t c = 0; c < m_cols.size(); ++c)
+            push(m_cols[c], c < vals.size() ? vals[c] : Variant());
+
+        m_row_size.push_back(static_cast<uint32_t>(vals.size()));
+
+        return true;
+    }
+
+    //
+    // --- sort
+    //
+
+    int compare(const Column& col, std::size_t lhs, std::size_t rhs, const std::vector<uint64_t>& rank) const {
+        bool lvalid = col.valid[lhs];
+        bool rvalid = col.valid[rhs];
+
+        if (!lvalid || !rvalid)
+            return (lvalid ? 1 : 0) - (rvalid ? 1 : 0);
+
+        uint64_t l = col.data[lhs];
+        uint64_t r = col.data[rhs];
+
+        switch (col.type) {
+        case CALI_TYPE_STRING:
+        case CALI_TYPE_USR:
+            return compare_raw<uint64_t>(rank[l], rank[r]);
+        case CALI_TYPE_INT:
+            return compare_raw<int>(l, r);
+        case CALI_TYPE_DOUBLE:
+            return compare_raw<double>(l, r);
+        default:
+            return compare_raw<uint64_t>(l, r);
+        }
+    }
+
+    std::vector<std::size_t> sort(const std::vector<std::size_t>& keys) const {
+        std::lock_guard<std::mutex>
+            g(m_lock);
+
+        std::vector<const Column*> key_cols;
+
+        for (std::size_t k : keys)
+            if (k < m_cols.size())
+                key_cols.push_back(&m_cols[k]);
+
+        std::vector<std::size_t> rows(m_row_size.size());
+        std::iota(rows.begin(), rows.end(), 0);
+
+        if (key_cols.empty())
+            return rows;
+
+        // Sort the dictionary once so string comparisons reduce to integer comparisons
+
+        std::vector<uint64_t> rank;
+
+        if (std::any_of(key_cols.begin(), key_cols.end(),
+                        [](const Column* col){ return is_string_type(col->type); })) {
+            std::vector<uint64_t> order(m_dict_strings.size());
+            std::iota(order.begin(), order.end(), 0);
+
+            std::sort(order.begin(), order.end(),
+                      [this](uint64_t lhs, uint64_t rhs){
+                          return *m_dict_strings[lhs] < *m_dict_strings[rhs];
+                      });
+
+            rank.resize(order.size());
+
+            for (std::size_t i = 0; i < order.size(); ++i)
+                rank[order[i]] = i;
+        }
+
+        std::stable_sort(rows.begin(), rows.end(),
+                         [&](std::size_t lhs, std::size_t rhs) {
+                             for (const Column* col : key_cols) {
+                                 int c = compare(*col, lhs, rhs, rank);
+
+                                 if (c != 0)
+                                     return c < 0;
+                             }
+
+                             return false;
+                         });
+
+        return rows;
+    }
+};
+
+
+ColumnStore::ColumnStore()
+    : mP { new ColumnStoreImpl }
+{ }
+
+ColumnStore::~ColumnStore()
+{
+    mP.reset();
+}
+
+bool
+ColumnStore::append(const EntryList& list, const std::vector<cali_id_t>& attr_ids)
+{
+    return mP->append(list, attr_ids);
+}
+
+std::size_t
+ColumnStore::num_rows() const
+{
+    return mP->m_row_size.size();
+}
+
+std::size_t
+ColumnStore::row_size(std::size_t row) const
+{
+    return mP->m_row_size[row];
+}
+
+Variant
+ColumnStore::get(std::size_t row, std::size_t col) const
+{
+    if (col >= mP->m_cols.size())
+        return Variant();
+
+    return mP->value(mP->m_cols[col], row);
+}
+
+std::vector<std::size_t>
+ColumnStore::sort(const std::vector<std::size_t>& keys) const
+{
+    return mP->sort(keys);
+}
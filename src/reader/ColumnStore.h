@@ -0,0 +1,94 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+///@file ColumnStore.h
+/// ColumnStore declarations
+
+#ifndef CALI_COLUMNSTORE_H
+#define CALI_COLUMNSTORE_H
+
+#include "RecordProcessor.h"
+
+#include <memory>
+#include <vector>
+
+namespace cali
+{
+
+/// \brief Columnar in-memory store for snapshot query results
+///
+/// Values are stored in typed columns: numeric values are kept as raw
+/// 64-bit values, strings are dictionary-encoded. A column takes on the
+/// type of the first value stored in it, and is converted into a string
+/// column if values of a different type show up later. Formatting is left
+/// to the user.
+
+class ColumnStore
+{
+    struct ColumnStoreImpl;
+    std::shared_ptr<ColumnStoreImpl> mP;
+
+public:
+
+    ColumnStore();
+
+    ~ColumnStore();
+
+    /// \brief Append a row with the values of the given attributes in \a list.
+    ///
+    /// Nested values of the same attribute are joined into a 
+    /// "/"-separated path string. Attributes with id CALI_INV_ID and attributes
+    /// not found in \a list are stored as missing values. The row is only 
+    /// added if at least one of the values is present. Thread-safe.
+    /// \return \c true if the row was added, \c false otherwise
+    bool append(const EntryList& list, const std::vector<cali_id_t>& attr_ids);
+
+    std::size_t num_rows() const;
+
+    /// \brief Number of columns of \a row, i.e. the number of attributes
+    ///   given when the row was appended.
+    std::size_t row_size(std::size_t row) const;
+
+    /// \brief Return value at \a row, \a col. Returns an empty variant if
+    ///   the value is missing. String variants point into the store's
+    ///   dictionary and remain valid as long as the store exists.
+    Variant     get(std::size_t row, std::size_t col) const;
+
+    /// \brief Return row indices sorted in ascending order by the given 
+    ///   columns, with \a keys[0] as the primary key. Missing values sort
+    ///   first. Stable.
+    std::vector<std::size_t> sort(const std::vector<std::size_t>& keys) const;
+};
+
+} // namespace cali
+
+#endif
@@ -35,6 +35,8 @@
 
 #include "Json.h"
 
+#include "ColumnStore.h"
+
 #include "CaliperMetadataAccessInterface.h"
 
 #include "Attribute.h"
@@ -54,10 +56,9 @@ struct Json::JsonImpl
     std::vector<std::string>                m_col_attr_names;
     std::vector<Attribute>                  m_cols;    
 
-    std::vector< std::vector<std::string> > m_rows;
+    ColumnStore                             m_rows;
 
     std::mutex m_col_lock;
-    std::mutex m_row_lock;
     
     bool                                    m_auto_column;
     
@@ -95,7 +96,7 @@ struct Json::JsonImpl
         m_cols.push_back(attr);
     }
     
-    std::vector<Attribute> update_columns(CaliperMetadataAccessInterface& db, const EntryList& list) {
+    std::vector<cali_id_t> update_columns(CaliperMetadataAccessInterface& db, const EntryList& list) {
         std::lock_guard<std::mutex>
             g(m_col_lock);
         
@@ -126,44 +127,17 @@ struct Json::JsonImpl
             }
         }
 
-        return m_cols;
+        std::vector<cali_id_t> ids;
+        ids.reserve(m_cols.size());
+
+        for (const Attribute& attr : m_cols)
+            ids.push_back(attr.id());
+
+        return ids;
     }
     
     void add(CaliperMetadataAccessInterface& db, const EntryList& list) {
-        std::vector<Attribute>   col(update_columns(db, list));
-        std::vector<std::string> row(col.size());
-
-        bool active = false;
-        
-        for (std::vector<Attribute>::size_type c = 0; c < col.size(); ++c) {
-            if (col[c] == Attribute::invalid)
-                continue;
-
-            std::string val;
-
-            for (Entry e : list) {
-                if (e.node()) {
-                    for (const Node* node = e.node(); node; node = node->parent())
-                        if (node->attribute() == col[c].id())
-                            val = node->data().to_string().append(val.empty() ? "" : "/").append(val);
-                } else {
-                    if (e.attribute() == col[c].id())
-                        val = e.value().to_string();
-                }
-            }
-
-            if (!val.empty()) {
-                active = true;
-                row[c] = val;
-            }
-        }
-
-        if (active) {
-            std::lock_guard<std::mutex>
-                g(m_row_lock);
-            
-            m_rows.push_back(std::move(row));
-        }
+        m_rows.append(list, update_columns(db, list));
     }
 
     void flush(std::ostream& os) {            
@@ -176,10 +150,10 @@ struct Json::JsonImpl
 
         // print rows
 
-        for (auto row : m_rows) {
+        for (std::size_t row = 0; row < m_rows.num_rows(); ++row) {
             os << " [ " ;
-            for (std::vector<std::string>::size_type c = 0; c < row.size(); ++c) {
-                    os << "\"" << row[c] << "\",";
+            for (std::size_t c = 0; c < m_rows.row_size(row); ++c) {
+                    os << "\"" << m_rows.get(row, c).to_string() << "\",";
             }
             os<< "\b ]," ;
         }        
@@ -42,6 +42,9 @@
 
 #include <util/split.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <mutex>
@@ -49,28 +52,146 @@
 using namespace cali;
 using namespace std;
 
+namespace
+{
+
+/// \brief Compare two variants by value. Strings are compared lexicographically,
+///   numbers numerically. Returns \c false if the values are not comparable.
+bool
+compare_values(const Variant& lhs, const Variant& rhs, int* result)
+{
+    cali_attr_type ltype = lhs.type();
+    cali_attr_type rtype = rhs.type();
+
+    if (ltype == CALI_TYPE_INV || rtype == CALI_TYPE_INV || ltype == CALI_TYPE_USR || rtype == CALI_TYPE_USR)
+        return false;
+
+    if (ltype == CALI_TYPE_STRING || rtype == CALI_TYPE_STRING) {
+        if (ltype != rtype)
+            return false;
+
+        const char* lstr = static_cast<const char*>(lhs.data());
+        const char* rstr = static_cast<const char*>(rhs.data());
+        std::size_t llen = lhs.size();
+        std::size_t rlen = rhs.size();
+
+        // ignore terminating NULs
+        if (llen > 0 && lstr[llen-1] == 0)
+            --llen;
+        if (rlen > 0 && rstr[rlen-1] == 0)
+            --rlen;
+
+        int cmp = memcmp(lstr, rstr, std::min(llen, rlen));
+
+        *result = (cmp != 0 ? cmp : (llen < rlen ? -1 : (llen > rlen ? 1 : 0)));
+        return true;
+    }
+
+    if (ltype == rtype) {
+        *result = cali_variant_compare(lhs.c_variant(), rhs.c_variant());
+        return true;
+    }
+
+    double l = lhs.to_double();
+    double r = rhs.to_double();
+
+    *result = (l < r ? -1 : (l > r ? 1 : 0));
+    return true;
+}
+
+} // namespace [anonymous]
+
 struct RecordSelector::RecordSelectorImpl
 {
     enum class Op { Contains, Equals, Less, Greater };
 
-    struct Clause {
+    struct ClauseConfig {
+        std::string   attr_name;
         cali_id_t     attr_id;
         std::string   value;
         Op            op;
         bool          negate;
     };
 
-    struct ClauseConfig {
-        std::string   attr_name;
-        cali_id_t     attr_id;
-        std::string   value;
+    /// Compiled clause: comparison value converted to the attribute's type.
+    /// \a attr_id is CALI_INV_ID while the attribute is unknown; the clause
+    /// then treats the attribute as absent.
+    struct Filter {
+        std::atomic<cali_id_t> attr_id;
+        Variant       value;
         Op            op;
         bool          negate;
     };
 
+    /// Lock-free two-level table of 64-bit words indexed by node id
+    class MemoTable {
+        static const std::size_t  BlockSize  = 16384;
+        static const std::size_t  MaxBlocks  = 16384;
+
+        std::atomic< std::atomic<uint64_t>* > m_blocks[MaxBlocks];
+
+    public:
+
+        MemoTable() {
+            for (std::size_t i = 0; i < MaxBlocks; ++i)
+                m_blocks[i].store(nullptr);
+        }
+
+        ~MemoTable() {
+            for (std::size_t i = 0; i < MaxBlocks; ++i)
+                delete[] m_blocks[i].load();
+        }
+
+        /// Return slot for \a id, or \c nullptr if \a id is out of range
+        std::atomic<uint64_t>* slot(cali_id_t id) {
+            std::size_t block = id / BlockSize;
+
+            if (block >= MaxBlocks)
+                return nullptr;
+
+            std::atomic<uint64_t>* ptr = m_blocks[block].load();
+
+            if (!ptr) {
+                std::atomic<uint64_t>* newblock = new std::atomic<uint64_t>[BlockSize];
+
+                for (std::size_t i = 0; i < BlockSize; ++i)
+                    newblock[i].store(0, std::memory_order_relaxed);
+
+                if (m_blocks[block].compare_exchange_strong(ptr, newblock))
+                    ptr = newblock;
+                else
+                    delete[] newblock;
+            }
+
+            return ptr + (id % BlockSize);
+        }
+    };
+
     std::vector<ClauseConfig> m_clauses;
+    std::vector<Filter>       m_filters;
+    std::atomic<bool>         m_compiled;
+    std::atomic<int>          m_num_unresolved;
     std::mutex                m_clause_lock;
-    
+
+    // Per-node memo of "path from this node to the root matches filter i", 
+    // as a bitmask, with bit 63 marking a valid entry. Only used if there
+    // are less than 64 filters.
+
+    static const uint64_t     MemoValid      = (1ULL << 63);
+
+    MemoTable                 m_memo;
+
+    // Only used while some clauses are unresolved: bit 0 marks attribute
+    // ids that have been checked against the unresolved clauses, bit 1
+    // marks nodes whose path to the root has been checked.
+
+    MemoTable                 m_attr_checked;
+
+    RecordSelectorImpl()
+        : m_compiled(false),
+          m_num_unresolved(0)
+        { }
+
     bool parse_clause(const string& str) {
         // parse "[-]attribute[(<>=)value]" string
 
@@ -93,7 +214,7 @@ struct RecordSelector::RecordSelectorImpl
             clause.value.assign(str, opos+1, string::npos);
 
             struct ops_t { char c; Op op; } const ops[] = {
-                // { '<', Op::Less     }, { '>', Op::Greater  },
+                { '<', Op::Less     }, { '>', Op::Greater  },
                 { '=', Op::Equals   }, { 0,   Op::Contains }
             };
 
@@ -123,68 +244,247 @@ struct RecordSelector::RecordSelectorImpl
         for (const string& s : clause_strings)
             if (!parse_clause(s))
                 cerr << "cali-query: malformed selector clause: \"" << s << "\"" << endl;
+
+        m_filters = std::vector<Filter>(m_clauses.size());
+
+        for (std::vector<ClauseConfig>::size_type i = 0; i < m_clauses.size(); ++i) {
+            m_filters[i].attr_id.store(CALI_INV_ID);
+            m_filters[i].op     = m_clauses[i].op;
+            m_filters[i].negate = m_clauses[i].negate;
+        }
+
+        m_num_unresolved.store(static_cast<int>(m_clauses.size()));
     }
 
-    Clause check_and_update_clause(CaliperMetadataAccessInterface& db, ClauseConfig& clause) {
+    /// Resolve clause \a i to attribute \a attr. Assumes m_clause_lock is locked.
+    void resolve(std::vector<ClauseConfig>::size_type i, const Attribute& attr) {
+        ClauseConfig& clause = m_clauses[i];
+
+        clause.attr_id = attr.id();
+
+        // The value string is owned by the clause config, so string 
+        // variants remain valid
+        if (clause.op != Op::Contains)
+            m_filters[i].value = Variant::from_string(attr.type(), clause.value.c_str());
+
+        // publish the value before the id
+        m_filters[i].attr_id.store(attr.id(), std::memory_order_release);
+        m_num_unresolved.fetch_sub(1);
+    }
+
+    /// Resolve the attribute ids of all clauses whose attributes exist.
+    /// Clauses with unknown attributes treat them as absent until they
+    /// are resolved by check_attribute().
+    void compile(CaliperMetadataAccessInterface& db) {
         std::lock_guard<std::mutex>
             g(m_clause_lock);
 
-        if (clause.attr_id == CALI_INV_ID) {
-            Attribute attr = db.get_attribute(clause.attr_name);
+        if (m_compiled.load())
+            return;
+
+        for (std::vector<ClauseConfig>::size_type i = 0; i < m_clauses.size(); ++i) {
+            if (m_clauses[i].attr_id != CALI_INV_ID)
+                continue;
+
+            Attribute attr = db.get_attribute(m_clauses[i].attr_name);
 
             if (attr != Attribute::invalid)
-                clause.attr_id = attr.id();
+                resolve(i, attr);
         }
-        
-        return { clause.attr_id, clause.value, clause.op, clause.negate };
+
+        m_compiled.store(true);
     }
-    
-    bool match(cali_id_t attr_id, const Variant& data, const Clause& clause) {            
-        if (clause.attr_id == attr_id)
-            switch (clause.op) {
-            case Op::Contains:
-                return true;
-            case Op::Equals:
-                return clause.value == data.to_string();
-            default:
-                break;
-            }
+
+    /// Resolve unresolved clauses that refer to attribute \a id. Each
+    /// attribute id is only looked up once.
+    void check_attribute(CaliperMetadataAccessInterface& db, cali_id_t id) {
+        std::atomic<uint64_t>* slot = m_attr_checked.slot(id);
+
+        if (slot && (slot->load(std::memory_order_acquire) & 1))
+            return;
+
+        std::lock_guard<std::mutex>
+            g(m_clause_lock);
+
+        if (slot && (slot->load() & 1))
+            return;
+
+        Attribute attr = db.get_attribute(id);
+
+        if (attr != Attribute::invalid)
+            for (std::vector<ClauseConfig>::size_type i = 0; i < m_clauses.size(); ++i)
+                if (m_clauses[i].attr_id == CALI_INV_ID && m_clauses[i].attr_name == attr.name())
+                    resolve(i, attr);
+
+        if (slot)
+            slot->fetch_or(1, std::memory_order_release);
+    }
+
+    static bool match(cali_id_t attr_id, const Variant& data, const Filter& filter) {            
+        if (filter.attr_id.load(std::memory_order_acquire) != attr_id)
+            return false;
+
+        if (filter.op == Op::Contains)
+            return true;
+
+        int cmp = 0;
+
+        if (!::compare_values(data, filter.value, &cmp))
+            return false;
+
+        switch (filter.op) {
+        case Op::Equals:
+            return cmp == 0;
+        case Op::Less:
+            return cmp <  0;
+        case Op::Greater:
+            return cmp >  0;
+        default:
+            break;
+        }
 
         return false;
     }    
-    
-    bool match(const Entry& entry, const Clause& clause) {
-        const Node* node = entry.node();
-
-        if (node) {
-            for ( ; node && node->id() != CALI_INV_ID; node = node->parent())
-                if (match(node->attribute(), node->data(), clause))
-                    return true;
-        } else if (match(entry.attribute(), entry.value(), clause))
-            return true;
+
+    static bool match_path(const Node* node, const Filter& filter) {
+        for ( ; node && node->id() != CALI_INV_ID; node = node->parent())
+            if (match(node->attribute(), node->data(), filter))
+                return true;
 
         return false;
     }
 
+    /// Check the attributes of all nodes on the path from \a node against
+    /// unresolved clauses. Stops at nodes that were checked before.
+    void check_path(CaliperMetadataAccessInterface& db, const Node* node) {
+        for ( ; node && node->id() != CALI_INV_ID; node = node->parent()) {
+            std::atomic<uint64_t>* slot = m_attr_checked.slot(node->id());
+
+            if (slot && (slot->load(std::memory_order_acquire) & 2))
+                break;
+
+            check_attribute(db, node->attribute());
+
+            if (slot)
+                slot->fetch_or(2, std::memory_order_release);
+        }
+    }
+
+    /// Return bitmask of the filters matched on the path from \a node
+    /// to the root. Uses and updates the memo.
+    uint64_t path_matches(const Node* node) {
+        if (!node || node->id() == CALI_INV_ID)
+            return 0;
+
+        std::atomic<uint64_t>* slot = m_memo.slot(node->id());
+
+        if (slot) {
+            uint64_t m = slot->load(std::memory_order_relaxed);
+
+            if (m & MemoValid)
+                return m & ~MemoValid;
+        }
+
+        uint64_t m = path_matches(node->parent());
+
+        for (std::vector<Filter>::size_type i = 0; i < m_filters.size(); ++i)
+            if (match(node->attribute(), node->data(), m_filters[i]))
+                m |= (1ULL << i);
+
+        if (slot)
+            slot->store(m | MemoValid, std::memory_order_relaxed);
+
+        return m;
+    }
+
     bool pass(CaliperMetadataAccessInterface& db, const EntryList& list) {
-        for (ClauseConfig& clause_conf : m_clauses) {
-            Clause clause = check_and_update_clause(db, clause_conf);
+        if (!m_compiled.load())
+            compile(db);
+
+        // Resolve clauses on attributes that showed up since the last record.
+        // A record's attributes are always defined before the record, so the
+        // filters below see every attribute in it. This must happen before
+        // path_matches() memoizes any new node.
+        if (m_num_unresolved.load(std::memory_order_relaxed) > 0) {
+            for (const Entry& e : list) {
+                if (e.node())
+                    check_path(db, e.node());
+                else
+                    check_attribute(db, e.attribute());
+            }
+        }
+
+        bool     use_memo  = m_filters.size() < 64;
+        uint64_t path_bits = 0;
 
-            if (clause.attr_id == CALI_INV_ID) {
-                if (clause.negate)
+        if (use_memo)
+            for (const Entry& e : list)
+                if (e.node())
+                    path_bits |= path_matches(e.node());
+
+        for (std::vector<Filter>::size_type i = 0; i < m_filters.size(); ++i) {
+            const Filter& filter = m_filters[i];
+
+            // unknown attribute: not in this record
+            if (filter.attr_id.load(std::memory_order_acquire) == CALI_INV_ID) {
+                if (filter.negate)
                     continue;
                 else
                     return false;
-	    }
+            }
 
-            bool m = false;
+            bool m = use_memo && (path_bits & (1ULL << i));
 
-            for (const Entry& e : list)
-                if ((m = (m || match(e, clause))))
-                    break;
+            for (auto it = list.begin(); !m && it != list.end(); ++it)
+                if (it->node())
+                    m = !use_memo && match_path(it->node(), filter);
+                else
+                    m = match(it->attribute(), it->value(), filter);
+
+            if (m == filter.negate)
+                return false;
+        }
+
+        return true;
+    }
+
+    bool may_pass(AttributeRangeFn range_fn) const {
+        for (const ClauseConfig& clause : m_clauses) {
+            // Negated clauses can't exclude a range: some snapshots in it may
+            // not have the attribute
+            if (clause.negate)
+                continue;
 
-            if (m == clause.negate)
+            Variant min, max;
+
+            if (!range_fn(clause.attr_name, min, max))
                 return false;
+            if (clause.op == Op::Contains || min.empty() || max.empty())
+                continue;
+
+            Variant value = Variant::from_string(min.type(), clause.value.c_str());
+            int     lcmp  = 0;
+            int     ucmp  = 0;
+
+            if (!::compare_values(min, value, &lcmp) || !::compare_values(max, value, &ucmp))
+                continue;
+
+            switch (clause.op) {
+            case Op::Equals:
+                if (lcmp > 0 || ucmp < 0)
+                    return false;
+                break;
+            case Op::Less:
+                if (lcmp >= 0)
+                    return false;
+                break;
+            case Op::Greater:
+                if (ucmp <= 0)
+                    return false;
+                break;
+            default:
+                break;
+            }
         }
 
         return true;
@@ -209,3 +509,9 @@ RecordSelector::operator()(CaliperMetadataAccessInterface& db, const EntryList&
     if (mP->pass(db, list))
         push(db, list);
 }
+
+bool
+RecordSelector::may_pass(AttributeRangeFn range_fn) const
+{
+    return mP->may_pass(range_fn);
+}
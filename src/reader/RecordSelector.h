@@ -38,7 +38,9 @@
 
 #include "RecordProcessor.h"
 
+#include <functional>
 #include <memory>
+#include <string>
 
 namespace cali
 {
@@ -57,6 +59,15 @@ public:
     ~RecordSelector();
 
     void operator()(CaliperMetadataAccessInterface&, const EntryList& node, SnapshotProcessFn) const;
+
+    /// Returns \c false if the given attribute does not occur, otherwise sets
+    /// its minimum and maximum value (or empty variants if they are unknown).
+    typedef std::function<bool(const std::string& attr_name, Variant& min, Variant& max)> AttributeRangeFn;
+
+    /// \brief Check if any snapshot with attribute values in the ranges given
+    ///   by \a range_fn could pass the selection. Used to skip data blocks
+    ///   using index metadata.
+    bool may_pass(AttributeRangeFn range_fn) const;
 };
 
 } // namespace cali
@@ -35,18 +35,20 @@
 
 #include "Table.h"
 
+#include "ColumnStore.h"
+
 #include "CaliperMetadataAccessInterface.h"
 
 #include "Attribute.h"
 #include "ContextRecord.h"
 #include "Node.h"
-#include "StringConverter.h"
 
 #include "util/split.hpp"
 
 #include <algorithm>
 #include <iterator>
 #include <mutex>
+#include <numeric>
 
 using namespace cali;
 
@@ -66,10 +68,9 @@ struct Table::TableImpl
     };
 
     std::vector<Column>                     m_cols;
-    std::vector< std::vector<std::string> > m_rows;
+    ColumnStore                             m_rows;
 
     std::mutex                              m_col_lock;
-    std::mutex                              m_row_lock;
 
     bool                                    m_auto_column;
     std::size_t                             m_num_sort_columns;
@@ -127,7 +128,7 @@ struct Table::TableImpl
         m_cols.emplace_back(name, name.size(), attr, true);
     }
 
-    std::vector<Column> update_columns(CaliperMetadataAccessInterface& db, const EntryList& list) {
+    std::vector<cali_id_t> update_columns(CaliperMetadataAccessInterface& db, const EntryList& list) {
         std::lock_guard<std::mutex>
             g(m_col_lock);
 
@@ -145,89 +146,52 @@ struct Table::TableImpl
 
         // Check if we can look up attribute object from name
 
-        for (Column& col : m_cols)
+        std::vector<cali_id_t> ids;
+        ids.reserve(m_cols.size());
+
+        for (Column& col : m_cols) {
             if (col.attr == Attribute::invalid)
                 col.attr = db.get_attribute(col.name);
 
-        return m_cols;
+            ids.push_back(col.attr.id());
+        }
+
+        return ids;
     }
 
     void add(CaliperMetadataAccessInterface& db, const EntryList& list) {
-        std::vector<Column> cols = update_columns(db, list);
-        std::vector<std::string> row(cols.size());
+        m_rows.append(list, update_columns(db, list));
+    }
 
-        bool active = false;
-        bool update_max_width = false;
+    void flush(std::ostream& os) {
+        // NOTE: No locking, assume flush() runs serially
 
-        for (std::vector<Column>::size_type c = 0; c < cols.size(); ++c) {
-            if (cols[c].attr == Attribute::invalid)
-                continue;
+        // Sort rows. Sorting by each sort column in turn with a stable sort
+        // made the last sort column the primary key: keep that order.
 
-            std::string val;
-            std::size_t width = 0;
+        std::vector<std::size_t> keys(m_num_sort_columns);
+        std::iota(keys.rbegin(), keys.rend(), 0);
 
-            for (Entry e : list) {
-                if (e.node()) {
-                    std::string str;
-
-                    for (const Node* node = e.node(); node; node = node->parent())
-                        if (node->attribute() == cols[c].attr.id())
-                            str = node->data().to_string().append(str.empty() ? "" : "/").append(str);
-
-                    width = std::max(str.size(), width);
-
-                    if (!str.empty()) {
-                        val = str;
-                        break;
-                    }
-                } else if (e.attribute() == cols[c].attr.id()) {
-                    val = e.value().to_string();
-                    break;
-                }
-            }
+        std::vector<std::size_t> rows = m_rows.sort(keys);
 
-            if (!val.empty()) {
-                active = true;
-                row[c] = val;
+        // Determine column widths
 
-                if (width > cols[c].max_width) {
-                    cols[c].max_width = width;
-                    update_max_width  = true;
-                }
-            }
-        }
+        for (std::vector<Column>::size_type c = m_num_sort_columns; c < m_cols.size(); ++c) {
+            if (!m_cols[c].print)
+                continue;
 
-        if (active) {
-            std::lock_guard<std::mutex>
-                g(m_row_lock);
+            for (std::size_t row : rows) {
+                Variant v = m_rows.get(row, c);
 
-            m_rows.push_back(std::move(row));
-        }
+                if (v.empty())
+                    continue;
 
-        if (update_max_width) {
-            std::lock_guard<std::mutex>
-                g(m_col_lock);
+                // dictionary strings can be measured without conversion
+                std::size_t len = (v.type() == CALI_TYPE_STRING ? v.size() : v.to_string().size());
 
-            for (std::vector<Column>::size_type c = 0; c < cols.size(); ++c)
-                if (cols[c].max_width > m_cols[c].max_width)
-                    m_cols[c].max_width = cols[c].max_width;
+                m_cols[c].max_width = std::max(m_cols[c].max_width, len);
+            }
         }
-    }
-
-    void flush(std::ostream& os) {
-        // NOTE: No locking, assume flush() runs serially
-
-        // sort rows
-        // NOTE: This is REALLY slow (potentially converts strings to numbers on every comparison)
-
-        for (std::vector<Column>::size_type c = 0; c < m_num_sort_columns; ++c)
-            std::stable_sort(m_rows.begin(), m_rows.end(),
-                             [c,this](const std::vector<std::string>& lhs, const std::vector<std::string>& rhs){
-                                 if (c >= lhs.size() || c >= rhs.size())
-                                     return lhs.size() < rhs.size();
-                                 cali_attr_type type = this->m_cols[c].attr.type();
-                                 return Variant::from_string(type, lhs[c].c_str()) < Variant::from_string(type, rhs[c].c_str());
-                             });
 
         const char whitespace[120+1] =
             "                                        "
@@ -244,12 +208,15 @@ struct Table::TableImpl
 
         // print rows
 
-        for (auto row : m_rows) {
-            for (std::vector<Column>::size_type c = m_num_sort_columns; c < row.size(); ++c) {
+        for (std::size_t row : rows) {
+            std::size_t row_size = m_rows.row_size(row);
+
+            for (std::vector<Column>::size_type c = m_num_sort_columns; c < row_size; ++c) {
                 if (!m_cols[c].print)
                     continue;
 
-                std::string    str = row[c];
+                Variant        v   = m_rows.get(row, c);
+                std::string    str = v.to_string();
                 cali_attr_type t   = m_cols[c].attr.type();
                 bool           align_right = (t == CALI_TYPE_INT || t == CALI_TYPE_UINT || t == CALI_TYPE_DOUBLE);
                 std::size_t    len = m_cols[c].max_width-str.size();
@@ -0,0 +1,241 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// @file TopK.cpp
+/// TopK snapshot filter implementation
+
+#include "TopK.h"
+
+#include "CaliperMetadataAccessInterface.h"
+
+#include "Attribute.h"
+#include "Node.h"
+
+#include "util/split.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+using namespace cali;
+
+struct TopK::TopKImpl
+{
+    struct Item {
+        std::vector<Variant> key;
+        EntryList            list;
+    };
+
+    struct Heap {
+        std::vector<Item>    items;
+    };
+
+    uint64_t                 m_id;
+    unsigned                 m_k;
+
+    std::vector<std::string> m_key_names;
+    std::vector<cali_id_t>   m_key_ids;
+    std::atomic<bool>        m_keys_resolved;
+    std::mutex               m_key_lock;
+
+    std::vector<Heap*>       m_heaps;
+    std::mutex               m_heaps_lock;
+
+    // Per-thread heap cache. Identifies the owner by a unique instance id
+    // rather than its address, which could be re-used.
+
+    struct ThreadHeap {
+        uint64_t  owner_id;
+        Heap*     heap;
+    };
+
+    static std::atomic<uint64_t>   s_next_id;
+    static thread_local ThreadHeap s_thread_heap;
+
+    TopKImpl(unsigned k, const std::string& sort_fields)
+        : m_id(++s_next_id), m_k(k), m_keys_resolved(false)
+        {
+            util::split(sort_fields, ':', std::back_inserter(m_key_names));
+
+            m_key_names.erase(std::remove(m_key_names.begin(), m_key_names.end(), std::string()),
+                              m_key_names.end());
+            m_key_ids.assign(m_key_names.size(), CALI_INV_ID);
+        }
+
+    ~TopKImpl() {
+        for (Heap* heap : m_heaps)
+            delete heap;
+    }
+
+    /// Compare keys in Table sort order, i.e., the last key is the primary key
+    static bool greater(const Item& lhs, const Item& rhs) {
+        for (std::size_t i = lhs.key.size(); i > 0; --i) {
+            if (rhs.key[i-1] < lhs.key[i-1])
+                return true;
+            if (lhs.key[i-1] < rhs.key[i-1])
+                return false;
+        }
+
+        return false;
+    }
+
+    std::vector<cali_id_t> key_ids(CaliperMetadataAccessInterface& db) {
+        if (m_keys_resolved.load())
+            return m_key_ids;
+
+        std::lock_guard<std::mutex>
+            g(m_key_lock);
+
+        bool resolved = true;
+
+        for (std::size_t i = 0; i < m_key_names.size(); ++i)
+            if (m_key_ids[i] == CALI_INV_ID) {
+                Attribute attr = db.get_attribute(m_key_names[i]);
+
+                if (attr != Attribute::invalid)
+                    m_key_ids[i] = attr.id();
+                else
+                    resolved = false;
+            }
+
+        m_keys_resolved.store(resolved);
+
+        return m_key_ids;
+    }
+
+    Heap* thread_heap() {
+        if (s_thread_heap.owner_id == m_id)
+            return s_thread_heap.heap;
+
+        Heap* heap = new Heap;
+
+        {
+            std::lock_guard<std::mutex>
+                g(m_heaps_lock);
+
+            m_heaps.push_back(heap);
+        }
+
+        heap->items.reserve(m_k);
+        s_thread_heap = { m_id, heap };
+
+        return heap;
+    }
+
+    void process(CaliperMetadataAccessInterface& db, const EntryList& list) {
+        if (m_k == 0)
+            return;
+
+        std::vector<cali_id_t> ids = key_ids(db);
+
+        Item item { std::vector<Variant>(ids.size()), EntryList() };
+        bool found = false;
+
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+            if (ids[i] == CALI_INV_ID)
+                continue;
+
+            for (const Entry& e : list) {
+                Variant v = e.value(ids[i]);
+
+                if (!v.empty()) {
+                    item.key[i] = v;
+                    found = true;
+                    break;
+                }
+            }
+        }
+
+        if (!found)
+            return;
+
+        // Min-heap of the k largest items seen by this thread
+
+        Heap* heap = thread_heap();
+        auto  cmp  = [](const Item& lhs, const Item& rhs) { return greater(lhs, rhs); };
+
+        if (heap->items.size() < m_k) {
+            item.list = list;
+            heap->items.push_back(std::move(item));
+            std::push_heap(heap->items.begin(), heap->items.end(), cmp);
+        } else if (greater(item, heap->items.front())) {
+            std::pop_heap(heap->items.begin(), heap->items.end(), cmp);
+            item.list = list;
+            heap->items.back() = std::move(item);
+            std::push_heap(heap->items.begin(), heap->items.end(), cmp);
+        }
+    }
+
+    void flush(CaliperMetadataAccessInterface& db, SnapshotProcessFn push) {
+        std::vector<Item> items;
+
+        for (Heap* heap : m_heaps) {
+            std::move(heap->items.begin(), heap->items.end(), std::back_inserter(items));
+            heap->items.clear();
+        }
+
+        std::stable_sort(items.begin(), items.end(), greater);
+
+        if (items.size() > m_k)
+            items.resize(m_k);
+
+        for (const Item& item : items)
+            push(db, item.list);
+    }
+};
+
+std::atomic<uint64_t>   TopK::TopKImpl::s_next_id(0);
+thread_local TopK::TopKImpl::ThreadHeap TopK::TopKImpl::s_thread_heap = { 0, nullptr };
+
+
+TopK::TopK(unsigned k, const std::string& sort_fields)
+    : mP { new TopKImpl(k, sort_fields) }
+{ }
+
+TopK::~TopK()
+{
+    mP.reset();
+}
+
+void
+TopK::operator()(CaliperMetadataAccessInterface& db, const EntryList& list)
+{
+    mP->process(db, list);
+}
+
+void
+TopK::flush(CaliperMetadataAccessInterface& db, SnapshotProcessFn push)
+{
+    mP->flush(db, push);
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+///@file TopK.h
+/// TopK snapshot filter declarations
+
+#ifndef CALI_TOPK_H
+#define CALI_TOPK_H
+
+#include "RecordProcessor.h"
+
+#include <memory>
+#include <string>
+
+namespace cali
+{
+
+class CaliperMetadataAccessInterface;
+
+/// \brief Keep only the \a k snapshots with the largest values of the given
+///   sort attributes.
+///
+/// Snapshots are kept in bounded per-thread heaps, so memory use is O(k) per
+/// thread regardless of the number of snapshots. Precedence of the sort
+/// attributes is the same as for Table: the last attribute is the primary
+/// key. Snapshots that have none of the sort attributes are dropped.
+
+class TopK
+{
+    struct TopKImpl;
+    std::shared_ptr<TopKImpl> mP;
+
+public:
+
+    TopK(unsigned k, const std::string& sort_fields);
+
+    ~TopK();
+
+    void operator()(CaliperMetadataAccessInterface&, const EntryList&);
+
+    /// \brief Merge the per-thread results and push the top \a k snapshots
+    ///   in descending order. Not thread-safe.
+    void flush(CaliperMetadataAccessInterface&, SnapshotProcessFn push);
+};
+
+} // namespace cali
+
+#endif
@@ -0,0 +1,135 @@
+#include "../CaliIndex.h"
+#include "../CaliperMetadataDB.h"
+#include "../RecordSelector.h"
+
+#include "gtest/gtest.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+using namespace cali;
+
+namespace
+{
+
+// Attribute "x" of type double (node 5), and two snapshot records
+const char* testfile_contents =
+    "__rec=node,attr=10,data=21,id=289,parent=5\n"
+    "__rec=node,attr=8,data=x,id=290,parent=289\n"
+    "__rec=ctx,attr=290,data=1.0000004\n"
+    "__rec=ctx,attr=290,data=0.5\n";
+
+void write_file(const std::string& filename, const char* contents, long nsec)
+{
+    {
+        std::ofstream os(filename.c_str());
+        os << contents;
+    }
+
+    // Set the modification time explicitly: file systems may not update it
+    // at nanosecond resolution
+    struct timespec times[2];
+
+    times[0].tv_sec  = 1500000000;
+    times[0].tv_nsec = nsec;
+    times[1]         = times[0];
+
+    utimensat(AT_FDCWD, filename.c_str(), times, 0);
+}
+
+/// Read \a filename through its index using the same block filter as cali-query.
+/// Returns the number of snapshot records read.
+std::size_t read_with_filter(CaliIndex& index, const RecordSelector& selector, std::size_t* skipped)
+{
+    std::size_t num_snapshots = 0;
+
+    index.read([&selector](const CaliIndex::RangeMap& ranges) {
+            return selector.may_pass([&ranges](const std::string& name, Variant& min, Variant& max) {
+                    auto it = ranges.find(name);
+
+                    if (it == ranges.end())
+                        return false;
+
+                    if (!it->second.min.empty()) {
+                        min = Variant::from_string(it->second.type, it->second.min.c_str());
+                        max = Variant::from_string(it->second.type, it->second.max.c_str());
+                    }
+
+                    return true;
+                });
+        },
+        [&num_snapshots](const RecordMap& rec) {
+            if (get_record_type(rec) == "ctx")
+                ++num_snapshots;
+        },
+        skipped);
+
+    return num_snapshots;
+}
+
+} // namespace [anonymous]
+
+TEST(CaliIndex_Test, FloatBounds) {
+    std::string filename = "test_caliindex_float." + std::to_string(getpid()) + ".cali";
+
+    write_file(filename, testfile_contents, 100);
+
+    CaliIndex index(filename);
+
+    ASSERT_TRUE(index.build(1));
+    ASSERT_TRUE(index.load());
+    EXPECT_EQ(index.num_blocks(), 2u);
+
+    // The first block's max is 1.0000004. It must not be rounded to 1.0,
+    // or the block would be skipped.
+    {
+        RecordSelector selector("x>1.0000001");
+        std::size_t    skipped = 0;
+
+        EXPECT_EQ(read_with_filter(index, selector, &skipped), 1u);
+        EXPECT_EQ(skipped, 1u);
+    }
+
+    {
+        RecordSelector selector("x>1.0000005");
+        std::size_t    skipped = 0;
+
+        EXPECT_EQ(read_with_filter(index, selector, &skipped), 0u);
+        EXPECT_EQ(skipped, 2u);
+    }
+
+    std::remove(CaliIndex::index_filename(filename).c_str());
+    std::remove(filename.c_str());
+}
+
+TEST(CaliIndex_Test, StaleIndex) {
+    std::string filename = "test_caliindex_stale." + std::to_string(getpid()) + ".cali";
+
+    write_file(filename, testfile_contents, 100);
+
+    {
+        CaliIndex index(filename);
+
+        ASSERT_TRUE(index.build(1));
+        EXPECT_TRUE(index.load());
+    }
+
+    // Rewrite the file with the same size within the same second
+    std::string modified(testfile_contents);
+    modified.replace(modified.find("0.5"), 3, "0.7");
+
+    write_file(filename, modified.c_str(), 200);
+
+    {
+        CaliIndex index(filename);
+        EXPECT_FALSE(index.load());
+    }
+
+    std::remove(CaliIndex::index_filename(filename).c_str());
+    std::remove(filename.c_str());
+}
@@ -0,0 +1,189 @@
+#include "../CaliperMetadataDB.h"
+#include "../ColumnStore.h"
+#include "../Json.h"
+#include "../Table.h"
+
+#include "Node.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace cali;
+
+namespace
+{
+
+std::vector<std::string> split_lines(const std::string& str)
+{
+    std::vector<std::string> lines;
+    std::istringstream is(str);
+    std::string line;
+
+    while (std::getline(is, line))
+        lines.push_back(line);
+
+    return lines;
+}
+
+/// Return the whitespace-separated words of \a line
+std::vector<std::string> split_words(const std::string& line)
+{
+    std::vector<std::string> words;
+    std::istringstream is(line);
+    std::string word;
+
+    while (is >> word)
+        words.push_back(word);
+
+    return words;
+}
+
+/// Create a tree entry for the path \a n values of \a attr in \a db
+const Node* make_path(CaliperMetadataDB& db, const Attribute& attr, std::size_t n, const char* vals[], const Node* parent = nullptr)
+{
+    std::vector< std::unique_ptr<Node> > nodes;
+    std::vector<const Node*> list;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        nodes.emplace_back(new Node(CALI_INV_ID, attr.id(), Variant(CALI_TYPE_STRING, vals[i], strlen(vals[i]))));
+        list.push_back(nodes.back().get());
+    }
+
+    return db.make_tree_entry(n, list.data(), const_cast<Node*>(parent));
+}
+
+} // namespace [anonymous]
+
+TEST(ColumnStore_Test, TypedSort) {
+    CaliperMetadataDB db;
+
+    Attribute i_attr = db.create_attribute("i", CALI_TYPE_INT,    CALI_ATTR_ASVALUE);
+    Attribute d_attr = db.create_attribute("d", CALI_TYPE_DOUBLE, CALI_ATTR_ASVALUE);
+
+    const struct { int i; double d; } rows[] = {
+        { 10, 1.5 }, { -2, 0.25 }, { 9, 100.0 }, { 10, -1.0 }
+    };
+
+    ColumnStore store;
+    std::vector<cali_id_t> ids { i_attr.id(), d_attr.id() };
+
+    for (const auto& r : rows) {
+        EntryList list { Entry(i_attr, Variant(r.i)), Entry(d_attr, Variant(r.d)) };
+        EXPECT_TRUE(store.append(list, ids));
+    }
+
+    // rows without any of the columns are not stored
+    EXPECT_FALSE(store.append(EntryList(), ids));
+    ASSERT_EQ(store.num_rows(), 4u);
+
+    // numeric, not lexicographic order: -2 < 9 < 10
+    std::vector<std::size_t> by_i_then_d = store.sort({ 0, 1 });
+
+    ASSERT_EQ(by_i_then_d.size(), 4u);
+    EXPECT_EQ(by_i_then_d[0], 1u);
+    EXPECT_EQ(by_i_then_d[1], 2u);
+    EXPECT_EQ(by_i_then_d[2], 3u);
+    EXPECT_EQ(by_i_then_d[3], 0u);
+
+    std::vector<std::size_t> by_d = store.sort({ 1 });
+
+    EXPECT_EQ(by_d[0], 3u);
+    EXPECT_EQ(by_d[1], 1u);
+    EXPECT_EQ(by_d[2], 0u);
+    EXPECT_EQ(by_d[3], 2u);
+
+    EXPECT_EQ(store.get(2, 0).to_int(), 9);
+    EXPECT_DOUBLE_EQ(store.get(2, 1).to_double(), 100.0);
+}
+
+TEST(ColumnStore_Test, MissingValuesAndPaths) {
+    CaliperMetadataDB db;
+
+    Attribute fn_attr  = db.create_attribute("function", CALI_TYPE_STRING, CALI_ATTR_DEFAULT);
+    Attribute val_attr = db.create_attribute("val",      CALI_TYPE_INT,    CALI_ATTR_ASVALUE);
+
+    const char* path[] = { "main", "foo" };
+    const Node* node   = make_path(db, fn_attr, 2, path);
+
+    ColumnStore store;
+    std::vector<cali_id_t> ids { fn_attr.id(), val_attr.id() };
+
+    store.append(EntryList { Entry(node) }, ids);
+    store.append(EntryList { Entry(val_attr, Variant(1)) }, ids);
+
+    ASSERT_EQ(store.num_rows(), 2u);
+
+    EXPECT_EQ(store.get(0, 0).to_string(), std::string("main/foo"));
+    EXPECT_TRUE(store.get(0, 1).empty());
+    EXPECT_TRUE(store.get(1, 0).empty());
+
+    // missing values sort first
+    std::vector<std::size_t> rows = store.sort({ 0 });
+
+    EXPECT_EQ(rows[0], 1u);
+    EXPECT_EQ(rows[1], 0u);
+}
+
+TEST(ColumnStore_Test, TableSortOrder) {
+    CaliperMetadataDB db;
+
+    Attribute a_attr = db.create_attribute("a", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+    Attribute b_attr = db.create_attribute("b", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+
+    // The last sort column is the primary sort key
+    Table table("a:b", "a:b");
+
+    const int rows[][2] = { { 2, 1 }, { 1, 2 }, { 10, 1 }, { 1, 1 } };
+
+    for (const auto& r : rows)
+        table(db, EntryList { Entry(a_attr, Variant(r[0])), Entry(b_attr, Variant(r[1])) });
+
+    std::ostringstream os;
+    table.flush(db, os);
+
+    std::vector<std::string> lines = split_lines(os.str());
+
+    ASSERT_EQ(lines.size(), 5u);
+
+    const int expected[][2] = { { 1, 1 }, { 2, 1 }, { 10, 1 }, { 1, 2 } };
+
+    for (int i = 0; i < 4; ++i) {
+        std::vector<std::string> words = split_words(lines[i+1]);
+
+        ASSERT_EQ(words.size(), 2u) << lines[i+1];
+        EXPECT_EQ(std::stoi(words[0]), expected[i][0]) << "row " << i;
+        EXPECT_EQ(std::stoi(words[1]), expected[i][1]) << "row " << i;
+    }
+}
+
+TEST(ColumnStore_Test, JsonUsesFirstEntry) {
+    CaliperMetadataDB db;
+
+    Attribute fn_attr = db.create_attribute("function", CALI_TYPE_STRING, CALI_ATTR_DEFAULT);
+
+    const char* path1[] = { "main", "foo" };
+    const char* path2[] = { "bar" };
+
+    const Node* node1 = make_path(db, fn_attr, 2, path1);
+    const Node* node2 = make_path(db, fn_attr, 1, path2);
+
+    // If an attribute appears in several entries, only the first entry
+    // containing it is used (same as Table). Values from different
+    // entries are not concatenated.
+    Json json("function");
+
+    json(db, EntryList { Entry(node1), Entry(node2) });
+
+    std::ostringstream os;
+    json.flush(db, os);
+
+    std::string str = os.str();
+
+    EXPECT_NE(str.find("\"main/foo\""), std::string::npos) << str;
+    EXPECT_EQ(str.find("bar"), std::string::npos) << str;
+}
@@ -0,0 +1,170 @@
+#include "../CaliperMetadataDB.h"
+#include "../RecordSelector.h"
+
+#include "Node.h"
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace cali;
+
+namespace
+{
+
+bool passes(const RecordSelector& selector, CaliperMetadataDB& db, const EntryList& list)
+{
+    bool ret = false;
+
+    selector(db, list, [&ret](CaliperMetadataAccessInterface&, const EntryList&){ ret = true; });
+
+    return ret;
+}
+
+const Node* make_string_node(CaliperMetadataDB& db, const Attribute& attr, const char* val, const Node* parent = nullptr)
+{
+    Node        proto(CALI_INV_ID, attr.id(), Variant(CALI_TYPE_STRING, val, strlen(val)));
+    const Node* list[] = { &proto };
+
+    return db.make_tree_entry(1, list, const_cast<Node*>(parent));
+}
+
+} // namespace [anonymous]
+
+TEST(RecordSelector_Test, NumericCompare) {
+    CaliperMetadataDB db;
+
+    Attribute i_attr = db.create_attribute("i", CALI_TYPE_INT,    CALI_ATTR_ASVALUE);
+    Attribute d_attr = db.create_attribute("d", CALI_TYPE_DOUBLE, CALI_ATTR_ASVALUE);
+
+    RecordSelector gt("i>5");
+    RecordSelector lt("i<-1");
+    RecordSelector eq("i=7");
+    RecordSelector dgt("d>1.5");
+
+    // numeric, not lexicographic: "10" > "5"
+    EXPECT_TRUE (passes(gt, db, EntryList { Entry(i_attr, Variant(10)) }));
+    EXPECT_FALSE(passes(gt, db, EntryList { Entry(i_attr, Variant(5))  }));
+    EXPECT_TRUE (passes(lt, db, EntryList { Entry(i_attr, Variant(-3)) }));
+    EXPECT_FALSE(passes(lt, db, EntryList { Entry(i_attr, Variant(0))  }));
+    EXPECT_TRUE (passes(eq, db, EntryList { Entry(i_attr, Variant(7))  }));
+    EXPECT_FALSE(passes(eq, db, EntryList { Entry(i_attr, Variant(70)) }));
+
+    EXPECT_TRUE (passes(dgt, db, EntryList { Entry(d_attr, Variant(1.75)) }));
+    EXPECT_FALSE(passes(dgt, db, EntryList { Entry(d_attr, Variant(1.25)) }));
+
+    // a record without the attribute does not pass
+    EXPECT_FALSE(passes(gt, db, EntryList { Entry(d_attr, Variant(10.0)) }));
+}
+
+TEST(RecordSelector_Test, StringCompare) {
+    CaliperMetadataDB db;
+
+    Attribute fn_attr = db.create_attribute("function", CALI_TYPE_STRING, CALI_ATTR_DEFAULT);
+
+    const Node* main_node = make_string_node(db, fn_attr, "main");
+    const Node* foo_node  = make_string_node(db, fn_attr, "foo", main_node);
+    const Node* bar_node  = make_string_node(db, fn_attr, "bar");
+
+    RecordSelector eq("function=main");
+    RecordSelector gt("function>c");
+
+    // matches anywhere on the path
+    EXPECT_TRUE (passes(eq, db, EntryList { Entry(foo_node) }));
+    EXPECT_TRUE (passes(eq, db, EntryList { Entry(main_node) }));
+    EXPECT_FALSE(passes(eq, db, EntryList { Entry(bar_node) }));
+
+    EXPECT_TRUE (passes(gt, db, EntryList { Entry(foo_node) }));
+    EXPECT_FALSE(passes(gt, db, EntryList { Entry(bar_node) }));
+
+    // memoized results are stable
+    EXPECT_TRUE (passes(eq, db, EntryList { Entry(foo_node) }));
+    EXPECT_FALSE(passes(eq, db, EntryList { Entry(bar_node) }));
+}
+
+TEST(RecordSelector_Test, Negation) {
+    CaliperMetadataDB db;
+
+    Attribute i_attr = db.create_attribute("i", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+
+    RecordSelector not_three("-i=3");
+
+    EXPECT_FALSE(passes(not_three, db, EntryList { Entry(i_attr, Variant(3)) }));
+    EXPECT_TRUE (passes(not_three, db, EntryList { Entry(i_attr, Variant(4)) }));
+    EXPECT_TRUE (passes(not_three, db, EntryList { }));
+}
+
+TEST(RecordSelector_Test, UnknownAttribute) {
+    CaliperMetadataDB db;
+
+    Attribute i_attr = db.create_attribute("i", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+
+    RecordSelector not_foo("-foo");
+    RecordSelector foo("foo");
+
+    // "foo" is unknown: treated as absent
+    EXPECT_TRUE (passes(not_foo, db, EntryList { Entry(i_attr, Variant(1)) }));
+    EXPECT_FALSE(passes(foo,     db, EntryList { Entry(i_attr, Variant(1)) }));
+
+    // "foo" shows up later in the stream
+    Attribute foo_attr = db.create_attribute("foo", CALI_TYPE_STRING, CALI_ATTR_DEFAULT);
+
+    const Node* node = make_string_node(db, foo_attr, "x");
+
+    EXPECT_FALSE(passes(not_foo, db, EntryList { Entry(node) }));
+    EXPECT_TRUE (passes(foo,     db, EntryList { Entry(node) }));
+    EXPECT_TRUE (passes(not_foo, db, EntryList { Entry(i_attr, Variant(1)) }));
+
+    Attribute bar_attr = db.create_attribute("bar", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+    RecordSelector bar("bar>1");
+
+    EXPECT_FALSE(passes(bar, db, EntryList { Entry(i_attr, Variant(2)) }));
+    EXPECT_TRUE (passes(bar, db, EntryList { Entry(bar_attr, Variant(2)) }));
+}
+
+TEST(RecordSelector_Test, ManyFilters) {
+    // Up to 63 filters use the path memo, more than that use the plain path walk
+
+    for (int nfilters : { 10, 63, 64, 70 }) {
+        CaliperMetadataDB db;
+
+        std::vector<std::string> names;
+        std::vector<std::string> vals;
+
+        for (int i = 0; i < nfilters; ++i) {
+            names.push_back(std::string("a") + std::to_string(i));
+            vals.push_back(std::string("v") + std::to_string(i));
+        }
+
+        const Node* node = nullptr;
+        const Node* last = nullptr;
+        const Node* prnt = nullptr;
+
+        for (int i = 0; i < nfilters; ++i) {
+            Attribute attr = db.create_attribute(names[i], CALI_TYPE_STRING, CALI_ATTR_DEFAULT);
+
+            prnt = node;
+            node = make_string_node(db, attr, vals[i].c_str(), node);
+
+            if (i == nfilters-1)
+                last = make_string_node(db, attr, "other", prnt);
+        }
+
+        std::string filter;
+
+        for (int i = 0; i < nfilters; ++i)
+            filter.append(i > 0 ? ":" : "").append(names[i]).append("=").append(vals[i]);
+
+        RecordSelector all(filter);
+        RecordSelector none(std::string("-") + names[nfilters-1]);
+
+        for (int rep = 0; rep < 2; ++rep) {
+            EXPECT_TRUE (passes(all,  db, EntryList { Entry(node) })) << nfilters << " filters";
+            EXPECT_FALSE(passes(all,  db, EntryList { Entry(last) })) << nfilters << " filters";
+            EXPECT_FALSE(passes(none, db, EntryList { Entry(node) })) << nfilters << " filters";
+        }
+    }
+}
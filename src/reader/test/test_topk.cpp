@@ -0,0 +1,113 @@
+#include "../CaliperMetadataDB.h"
+#include "../TopK.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace cali;
+
+namespace
+{
+
+std::vector<int> collect(TopK& topk, CaliperMetadataDB& db, const Attribute& attr)
+{
+    std::vector<int> vals;
+
+    topk.flush(db, [&](CaliperMetadataAccessInterface&, const EntryList& list){
+            for (const Entry& e : list)
+                if (e.attribute() == attr.id())
+                    vals.push_back(e.value().to_int());
+        });
+
+    return vals;
+}
+
+} // namespace [anonymous]
+
+TEST(TopK_Test, Ties) {
+    CaliperMetadataDB db;
+
+    Attribute v_attr = db.create_attribute("v", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+    Attribute n_attr = db.create_attribute("n", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+
+    TopK topk(3, "v");
+
+    const int vals[] = { 5, 1, 5, 9, 5, 5, 2 };
+
+    for (int v : vals)
+        topk(db, EntryList { Entry(v_attr, Variant(v)) });
+
+    // records without the sort attribute are dropped
+    topk(db, EntryList { Entry(n_attr, Variant(100)) });
+
+    std::vector<int> result = collect(topk, db, v_attr);
+
+    ASSERT_EQ(result.size(), 3u);
+    EXPECT_EQ(result[0], 9);
+    EXPECT_EQ(result[1], 5);
+    EXPECT_EQ(result[2], 5);
+
+    // flush empties the heaps
+    EXPECT_TRUE(collect(topk, db, v_attr).empty());
+}
+
+TEST(TopK_Test, KeyPrecedence) {
+    CaliperMetadataDB db;
+
+    Attribute a_attr = db.create_attribute("a", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+    Attribute b_attr = db.create_attribute("b", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+
+    // last attribute is the primary key, as in Table
+    TopK topk(2, "a:b");
+
+    const int rows[][2] = { { 9, 1 }, { 1, 5 }, { 2, 5 }, { 8, 4 } };
+
+    for (const auto& r : rows)
+        topk(db, EntryList { Entry(a_attr, Variant(r[0])), Entry(b_attr, Variant(r[1])) });
+
+    std::vector<int> a = collect(topk, db, a_attr);
+
+    ASSERT_EQ(a.size(), 2u);
+    EXPECT_EQ(a[0], 2);
+    EXPECT_EQ(a[1], 1);
+}
+
+TEST(TopK_Test, MultipleThreads) {
+    CaliperMetadataDB db;
+
+    Attribute v_attr = db.create_attribute("v", CALI_TYPE_INT, CALI_ATTR_ASVALUE);
+
+    const int k        = 25;
+    const int nthreads = 4;
+    const int nrecords = 10000;
+
+    // many ties: values repeat every 1000 records
+    auto value = [](int i) { return (i * 7919) % 1000; };
+
+    TopK topk(k, "v");
+
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < nthreads; ++t)
+        threads.emplace_back([&,t](){
+                for (int i = t; i < nrecords; i += nthreads)
+                    topk(db, EntryList { Entry(v_attr, Variant(value(i))) });
+            });
+
+    for (auto& t : threads)
+        t.join();
+
+    std::vector<int> expected;
+
+    for (int i = 0; i < nrecords; ++i)
+        expected.push_back(value(i));
+
+    std::sort(expected.begin(), expected.end(), std::greater<int>());
+    expected.resize(k);
+
+    EXPECT_EQ(collect(topk, db, v_attr), expected);
+}
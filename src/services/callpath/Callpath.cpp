@@ -41,6 +41,7 @@
 #include <RuntimeConfig.h>
 #include <Log.h>
 
+#include <atomic>
 #include <cstring>
 #include <string>
 #include <type_traits>
@@ -51,6 +52,16 @@
 #define MAX_PATH 40
 #define NAMELEN  100
 
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+#define CALI_CALLPATH_HAVE_FP_UNWIND
+#endif
+
 using namespace cali;
 using namespace std;
 
@@ -64,6 +75,7 @@ ConfigSet config;
 
 bool      use_name { false };
 bool      use_addr { false };
+bool      use_fp   { false };
 
 unsigned  skip_frames { 0 };
 
@@ -76,6 +88,12 @@ static const ConfigSet::Entry s_configdata[] = {
       "Record region addresses for call path",
       "Record region addresses for call path"
     },
+    { "use_frame_pointers", CALI_TYPE_BOOL, "false",
+      "Unwind address call paths with frame pointers",
+      "Unwind address call paths by walking the frame pointer chain instead of using libunwind.\n"
+      "Much faster, but only correct if the program and Caliper are built with frame pointers\n"
+      "(e.g., -fno-omit-frame-pointer). Not used for region names."
+    },
     { "skip_frames", CALI_TYPE_UINT, "0",
       "Skip this number of stack frames",
       "Skip this number of stack frames.\n"
@@ -84,13 +102,90 @@ static const ConfigSet::Entry s_configdata[] = {
     ConfigSet::Terminator
 };
 
-void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord*)
+//
+// --- Region name cache
+//
+
+/// A cached region name for a call site address. The cache is lock-free so
+/// it can be used in signal handlers: a thread claims an entry by setting
+/// \a addr, and the entry can be read once \a ready is set.
+struct NameCacheEntry {
+    std::atomic<uint64_t> addr;
+    std::atomic<bool>     ready;
+    char                  name[NAMELEN];
+};
+
+const size_t NameCacheBits  = 12;
+const size_t NameCacheSize  = 1 << NameCacheBits;
+const size_t NameCacheProbe = 8;
+
+NameCacheEntry* name_cache = nullptr;
+
+/// Get the region name for the current frame of \a cursor, with return
+/// address \a addr. Returns either a cached name, or the name copied into
+/// \a buf.
+const char* lookup_name(unw_cursor_t* cursor, uint64_t addr, char* buf)
 {
-    Variant v_addr[MAX_PATH];
-    Variant v_name[MAX_PATH];
+    NameCacheEntry* slot = nullptr;
+    size_t          hash = (addr * 0x9E3779B97F4A7C15ull) >> (64 - NameCacheBits);
 
-    char    strbuf[MAX_PATH][NAMELEN];
+    for (size_t i = 0; i < NameCacheProbe; ++i) {
+        NameCacheEntry* e = name_cache + ((hash + i) & (NameCacheSize - 1));
+        uint64_t        a = e->addr.load(std::memory_order_acquire);
 
+        if (a == 0 && e->addr.compare_exchange_strong(a, addr, std::memory_order_acq_rel)) {
+            slot = e;
+            break;
+        }
+        if (a == addr) {
+            if (e->ready.load(std::memory_order_acquire))
+                return e->name;
+
+            break; // another thread is resolving this address right now
+        }
+    }
+
+    unw_word_t offs;
+
+    if (unw_get_proc_name(cursor, buf, NAMELEN, &offs) < 0)
+        strncpy(buf, "UNKNOWN", NAMELEN);
+
+    buf[NAMELEN-1] = '\0';
+
+    if (slot) {
+        memcpy(slot->name, buf, NAMELEN);
+        slot->ready.store(true, std::memory_order_release);
+    }
+
+    return buf;
+}
+
+//
+// --- Per-thread path cache
+//
+
+/// The calling thread's most recent call path, to reuse the context tree
+/// nodes of the common prefix with the next one. The address and name
+/// paths keep separate node lists; they are updated independently in
+/// separate blackboard entries.
+struct PathCache {
+    size_t   n;
+    uint64_t addr[MAX_PATH];        ///< return addresses, root to leaf
+    Node*    addr_nodes[MAX_PATH];
+    Node*    name_nodes[MAX_PATH];
+};
+
+thread_local PathCache* t_path_cache CALI_TLS_INITIAL_EXEC = nullptr;
+
+//
+// --- Unwinding
+//
+
+/// Unwind with libunwind. Stores up to MAX_PATH return addresses (and
+/// names, if \a names is given) in \a addr, innermost first.
+__attribute__((noinline))
+size_t unwind(uint64_t addr[], const char* names[], char strbuf[][NAMELEN])
+{
     // Init unwind context
     unw_context_t unw_ctx;
     unw_cursor_t  unw_cursor;
@@ -99,46 +194,157 @@ void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord*)
 
     if (unw_init_local(&unw_cursor, &unw_ctx) < 0) {
         Log(0).stream() << "callpath::measure_cb: error: unable to init libunwind cursor" << endl;
-        return;
+        return 0;
     }
 
-    // skip n frames
+    // skip n frames, plus the one for snapshot_cb()
 
     size_t n = 0;
 
-    for (n = skip_frames; n > 0 && unw_step(&unw_cursor) > 0; --n)
+    for (n = skip_frames + 1; n > 0 && unw_step(&unw_cursor) > 0; --n)
         ;
 
     if (n > 0)
-        return;
+        return 0;
 
     while (n < MAX_PATH && unw_step(&unw_cursor) > 0) {
-        // store path from top to bottom
+        unw_word_t ip;
+        unw_get_reg(&unw_cursor, UNW_REG_IP, &ip);
 
-        if (use_addr) {
-            unw_word_t ip;
-            unw_get_reg(&unw_cursor, UNW_REG_IP, &ip);
+        addr[n] = ip;
 
-            uint64_t uint = ip;
-            v_addr[MAX_PATH-(n+1)] = Variant(CALI_TYPE_ADDR, &uint, sizeof(uint64_t));
-        }
-        if (use_name) {
-            unw_word_t offs;
+        if (names)
+            names[n] = lookup_name(&unw_cursor, ip, strbuf[n]);
+
+        ++n;
+    }
+
+    return n;
+}
+
+#ifdef CALI_CALLPATH_HAVE_FP_UNWIND
+/// Unwind by walking the frame pointer chain. Stores up to MAX_PATH return
+/// addresses in \a addr, innermost first. Only correct for code compiled
+/// with frame pointers; stops at the first implausible frame pointer.
+__attribute__((noinline))
+size_t unwind_fp(uint64_t addr[])
+{
+    const uintptr_t MaxFrameSize = 1 << 20;
 
-            if (unw_get_proc_name(&unw_cursor, strbuf[n], NAMELEN, &offs) < 0)
-                strncpy(strbuf[n], "UNKNOWN", NAMELEN);
+    void** fp   = static_cast<void**>(__builtin_frame_address(0));
+    size_t skip = skip_frames + 1; // + snapshot_cb()
+    size_t n    = 0;
 
-            v_name[MAX_PATH-(n+1)] = Variant(CALI_TYPE_STRING, strbuf[n], strlen(strbuf[n]));
+    while (fp && n < MAX_PATH) {
+        void**   next = static_cast<void**>(fp[0]);
+        uint64_t ret  = reinterpret_cast<uint64_t>(fp[1]);
+
+        if (ret == 0)
+            break;
+
+        if (skip > 0)
+            --skip;
+        else
+            addr[n++] = ret;
+
+        // The stack grows down: the caller's frame must be above ours
+        uintptr_t f = reinterpret_cast<uintptr_t>(fp);
+        uintptr_t g = reinterpret_cast<uintptr_t>(next);
+
+        if (g <= f || g - f > MaxFrameSize || (g & (sizeof(void*) - 1)))
+            break;
+
+        fp = next;
+    }
+
+    return n;
+}
+#endif
+
+void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord*)
+{
+    uint64_t    addr[MAX_PATH];
+    const char* names[MAX_PATH];
+    char        strbuf[MAX_PATH][NAMELEN];
+
+    size_t n = 0;
+
+#ifdef CALI_CALLPATH_HAVE_FP_UNWIND
+    if (use_fp)
+        n = unwind_fp(addr);
+    else
+#endif
+        n = unwind(addr, use_name ? names : nullptr, strbuf);
+
+    if (n == 0)
+        return;
+
+    // store path from top to bottom
+
+    uint64_t path_addr[MAX_PATH];
+    Variant  v_addr[MAX_PATH];
+    Variant  v_name[MAX_PATH];
+
+    for (size_t i = 0; i < n; ++i)
+        path_addr[i] = addr[n-(i+1)];
+
+    // reuse nodes of the common prefix with this thread's previous path
+
+    PathCache* pc     = t_path_cache;
+    size_t     n_same = 0;
+
+    if (pc)
+        while (n_same < n && n_same < pc->n && pc->addr[n_same] == path_addr[n_same])
+            ++n_same;
+
+    if (use_addr) {
+        for (size_t i = 0; i < n; ++i)
+            v_addr[i] = Variant(CALI_TYPE_ADDR, &path_addr[i], sizeof(uint64_t));
+
+        if (pc)
+            c->set_path(callpath_addr_attr, n, v_addr, n_same, pc->addr_nodes);
+        else
+            c->set_path(callpath_addr_attr, n, v_addr);
+    }
+    if (use_name) {
+        for (size_t i = 0; i < n; ++i) {
+            const char* name = names[n-(i+1)];
+            v_name[i] = Variant(CALI_TYPE_STRING, name, strlen(name));
         }
 
-        ++n;
+        if (pc)
+            c->set_path(callpath_name_attr, n, v_name, n_same, pc->name_nodes);
+        else
+            c->set_path(callpath_name_attr, n, v_name);
     }
 
-    if (n > 0) {
-        if (use_addr)
-            c->set_path(callpath_addr_attr, n, v_addr+(MAX_PATH-n));
-        if (use_name)
-            c->set_path(callpath_name_attr, n, v_name+(MAX_PATH-n));
+    if (pc) {
+        std::copy_n(path_addr, n, pc->addr);
+        pc->n = n;
+    }
+}
+
+void create_path_cache()
+{
+    if (!t_path_cache)
+        t_path_cache = new PathCache { 0 };
+}
+
+void create_scope_cb(Caliper* c, cali_context_scope_t scope)
+{
+    if (scope == CALI_SCOPE_THREAD)
+        create_path_cache();
+}
+
+void release_scope_cb(Caliper* c, cali_context_scope_t scope)
+{
+    if (scope == CALI_SCOPE_THREAD) {
+        PathCache* pc = t_path_cache;
+
+        t_path_cache = nullptr;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+
+        delete pc;
     }
 }
 
@@ -149,18 +355,43 @@ void callpath_service_register(Caliper* c)
     use_name    = config.get("use_name").to_bool();
     use_addr    = config.get("use_address").to_bool();
     skip_frames = config.get("skip_frames").to_uint();
+    use_fp      = config.get("use_frame_pointers").to_bool();
+
+#ifndef CALI_CALLPATH_HAVE_FP_UNWIND
+    if (use_fp)
+        Log(0).stream() << "callpath: frame pointer unwinding is not supported on this platform, using libunwind" << endl;
+#endif
+    if (use_fp && use_name) {
+        Log(1).stream() << "callpath: region names require libunwind, not using frame pointers" << endl;
+        use_fp = false;
+    }
+
+    if (use_name)
+        name_cache = new NameCacheEntry[NameCacheSize] { };
 
     Attribute symbol_class_attr = c->get_attribute("class.symboladdress");
     Variant v_true(true);
 
+    // Keep each path in its own blackboard entry (no auto-merge): the
+    // incremental set_path() update only reuses the cached prefix if
+    // the attribute's path is still at the end of its blackboard entry.
+    // In a shared entry, the address and name paths (and any region
+    // update in between snapshots) would always invalidate each other.
+
     callpath_addr_attr = 
-        c->create_attribute("callpath.address", CALI_TYPE_ADDR,   CALI_ATTR_SKIP_EVENTS,
+        c->create_attribute("callpath.address", CALI_TYPE_ADDR,   
+                            CALI_ATTR_SKIP_EVENTS | CALI_ATTR_NOMERGE,
                             1, &symbol_class_attr, &v_true);
     callpath_name_attr = 
-        c->create_attribute("callpath.regname", CALI_TYPE_STRING, CALI_ATTR_SKIP_EVENTS);    
+        c->create_attribute("callpath.regname", CALI_TYPE_STRING, 
+                            CALI_ATTR_SKIP_EVENTS | CALI_ATTR_NOMERGE);    
 
+    c->events().create_scope_evt.connect(&create_scope_cb);
+    c->events().release_scope_evt.connect(&release_scope_cb);
     c->events().snapshot.connect(&snapshot_cb);
 
+    create_path_cache();
+
     Log(1).stream() << "Registered callpath service" << endl;
 }
 
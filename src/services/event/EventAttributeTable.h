@@ -0,0 +1,149 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file  EventAttributeTable.h
+/// \brief EventAttributeTable class definition
+
+#pragma once
+
+#include <cali_types.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace event
+{
+
+/// Lock-free table of per-attribute data of type \a T, indexed by
+/// attribute id. Entries are allocated in chunks on demand and never
+/// removed, so readers only need an acquire load on the chunk pointer and
+/// the entry's valid flag. Attributes with very large ids (beyond 
+/// ChunkSize * MaxChunks) fall back to a locked map.
+template<class T>
+class EventAttributeTable 
+{
+public:
+
+    static const size_t  ChunkSize = 1024;
+    static const size_t  MaxChunks = 4096;
+
+private:
+
+    struct Entry {
+        T                  data;
+        std::atomic<bool>  valid;
+    };
+
+    std::atomic<Entry*>  m_chunks[MaxChunks];
+
+    typedef std::map<cali_id_t, T> FallbackMap;
+
+    std::mutex           m_fallback_lock;
+    FallbackMap          m_fallback_map;
+
+    Entry* get_chunk(size_t n) {
+        Entry* chunk = m_chunks[n].load(std::memory_order_acquire);
+
+        if (!chunk) {
+            Entry* new_chunk = new Entry[ChunkSize];
+
+            for (size_t i = 0; i < ChunkSize; ++i)
+                new_chunk[i].valid.store(false, std::memory_order_relaxed);
+
+            if (m_chunks[n].compare_exchange_strong(chunk, new_chunk, std::memory_order_acq_rel))
+                chunk = new_chunk;
+            else
+                delete[] new_chunk; // another thread was faster
+        }
+
+        return chunk;
+    }
+
+public:
+
+    EventAttributeTable() {
+        for (size_t n = 0; n < MaxChunks; ++n)
+            m_chunks[n].store(nullptr, std::memory_order_relaxed);
+    }
+
+    // Entries are never freed in the event service: the table lives until 
+    // program exit and may still be accessed from other threads' end-of-run 
+    // events. Deleting the table itself releases everything.
+
+    ~EventAttributeTable() {
+        for (size_t n = 0; n < MaxChunks; ++n)
+            delete[] m_chunks[n].load();
+    }
+
+    void insert(cali_id_t id, const T& data) {
+        size_t n = id / ChunkSize;
+
+        if (n < MaxChunks) {
+            Entry* entry = get_chunk(n) + (id % ChunkSize);
+
+            entry->data = data;
+            entry->valid.store(true, std::memory_order_release);
+        } else {
+            std::lock_guard<std::mutex>
+                g(m_fallback_lock);
+
+            m_fallback_map.insert(std::make_pair(id, data));
+        }
+    }
+
+    const T* find(cali_id_t id) {
+        size_t n = id / ChunkSize;
+
+        if (n < MaxChunks) {
+            Entry* chunk = m_chunks[n].load(std::memory_order_acquire);
+
+            if (!chunk)
+                return nullptr;
+
+            Entry* entry = chunk + (id % ChunkSize);
+
+            return entry->valid.load(std::memory_order_acquire) ? &(entry->data) : nullptr;
+        }
+
+        std::lock_guard<std::mutex>
+            g(m_fallback_lock);
+
+        auto it = m_fallback_map.find(id);
+
+        // map entries are stable and never erased
+        return it == m_fallback_map.end() ? nullptr : &(it->second);
+    }
+};
+
+} // namespace event
@@ -35,6 +35,8 @@
 
 #include "../CaliperService.h"
 
+#include "EventAttributeTable.h"
+
 #include <Caliper.h>
 #include <SnapshotRecord.h>
 
@@ -44,9 +46,8 @@
 #include <util/split.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <iterator>
-#include <map>
-#include <mutex>
 #include <string>
 #include <vector>
 
@@ -79,13 +80,88 @@ struct EventAttributes {
     Attribute begin_attr;
     Attribute set_attr;
     Attribute end_attr;
-    Attribute lvl_attr;
+
+    /// Nesting level of process-scope attributes; nullptr otherwise
+    std::atomic<uint64_t>* process_lvl;
+    /// Hidden blackboard entry holding the nesting level of task-scope
+    /// attributes, which may move between threads; invalid otherwise
+    Attribute              task_lvl_attr;
+    /// Index into the per-thread level array for thread-scope attributes
+    size_t                 lvl_slot;
 };
 
-typedef std::map<cali_id_t, EventAttributes> AttributeMap;
+/// Event attributes, indexed by trigger attribute id
+event::EventAttributeTable<EventAttributes>* event_attributes_table = nullptr;
+
+std::atomic<size_t>      next_lvl_slot { 0 };
+
+/// Nesting levels of thread-scope trigger attributes on this thread,
+/// indexed by EventAttributes::lvl_slot
+thread_local std::vector<uint64_t> t_levels;
+
+inline uint64_t& thread_level(size_t slot)
+{
+    if (slot >= t_levels.size())
+        t_levels.resize(std::max<size_t>(slot + 1, 2 * t_levels.size()), 0);
+
+    return t_levels[slot];
+}
+
+/// Increment the nesting level of a trigger attribute; return the new level
+uint64_t push_level(Caliper* c, const EventAttributes& event_attr)
+{
+    if (event_attr.process_lvl)
+        return event_attr.process_lvl->fetch_add(1) + 1;
+
+    if (event_attr.task_lvl_attr != Attribute::invalid) {
+        uint64_t lvl = c->get(event_attr.task_lvl_attr).value().to_uint() + 1;
+        c->set(event_attr.task_lvl_attr, Variant(lvl));
+        return lvl;
+    }
+
+    return ++thread_level(event_attr.lvl_slot);
+}
+
+/// Set the nesting level of a trigger attribute
+void set_level(Caliper* c, const EventAttributes& event_attr, uint64_t lvl)
+{
+    if (event_attr.process_lvl)
+        event_attr.process_lvl->store(lvl);
+    else if (event_attr.task_lvl_attr != Attribute::invalid)
+        c->set(event_attr.task_lvl_attr, Variant(lvl));
+    else
+        thread_level(event_attr.lvl_slot) = lvl;
+}
+
+/// Decrement the nesting level of a trigger attribute, but don't go below 0.
+/// Return the previous level, or 0 if it was 0 already.
+uint64_t pop_level(Caliper* c, const EventAttributes& event_attr)
+{
+    uint64_t lvl = 0;
+
+    if (event_attr.process_lvl) {
+        lvl = event_attr.process_lvl->load();
+
+        do {
+            if (lvl == 0)
+                return 0;
+        } while (!event_attr.process_lvl->compare_exchange_weak(lvl, lvl - 1));
+    } else if (event_attr.task_lvl_attr != Attribute::invalid) {
+        lvl = c->get(event_attr.task_lvl_attr).value().to_uint();
 
-std::mutex               event_attributes_lock;
-AttributeMap             event_attributes_map;
+        if (lvl > 1)
+            c->set(event_attr.task_lvl_attr, Variant(lvl - 1));
+        else if (lvl == 1)
+            c->end(event_attr.task_lvl_attr);
+    } else {
+        uint64_t& t_lvl = thread_level(event_attr.lvl_slot);
+
+        if (t_lvl > 0)
+            lvl = t_lvl--;
+    }
+
+    return lvl;
+}
 
 std::vector<std::string> trigger_attr_names;
 
@@ -134,151 +210,129 @@ void create_attribute_cb(Caliper* c, const Attribute& attr)
             c->create_attribute(name, attr.type(), attr.properties() | CALI_ATTR_SKIP_EVENTS);
     }
         
-    std::string name = "cali.lvl.";
-    name.append(std::to_string(attr.id()));
-
-    event_attributes.lvl_attr = 
-        c->create_attribute(name, CALI_TYPE_INT, 
-                            CALI_ATTR_ASVALUE     | 
-                            CALI_ATTR_HIDDEN      | 
-                            CALI_ATTR_SKIP_EVENTS | 
-                            (attr.properties() & CALI_ATTR_SCOPE_MASK));
-
-    std::lock_guard<std::mutex>
-        g(event_attributes_lock);
-        
-    event_attributes_map.insert(std::make_pair(attr.id(), event_attributes));
+    event_attributes.process_lvl   = nullptr;
+    event_attributes.task_lvl_attr = Attribute::invalid;
+    event_attributes.lvl_slot      = 0;
+
+    switch (attr.properties() & CALI_ATTR_SCOPE_MASK) {
+    case CALI_ATTR_SCOPE_PROCESS:
+        event_attributes.process_lvl = new std::atomic<uint64_t>(0);
+        break;
+    case CALI_ATTR_SCOPE_TASK:
+        event_attributes.task_lvl_attr = 
+            c->create_attribute(std::string("cali.lvl.") + std::to_string(attr.id()), CALI_TYPE_UINT,
+                                CALI_ATTR_ASVALUE     | 
+                                CALI_ATTR_HIDDEN      | 
+                                CALI_ATTR_SKIP_EVENTS | 
+                                CALI_ATTR_SCOPE_TASK);
+        break;
+    default:
+        event_attributes.lvl_slot = next_lvl_slot.fetch_add(1);
+    }
+
+    event_attributes_table->insert(attr.id(), event_attributes);
 }
 
-bool get_event_attributes(const Attribute& attr, EventAttributes& evt_attr)
+inline const EventAttributes* get_event_attributes(const Attribute& attr)
 {
-    std::lock_guard<std::mutex>
-        g(event_attributes_lock);
-
-    auto it = event_attributes_map.find(attr.id());
-
-    if (it != event_attributes_map.end()) {
-        evt_attr = it->second;
-        return true;
-    }
-
-    return false;
+    return event_attributes_table->find(attr.id());
 }
 
 void event_begin_cb(Caliper* c, const Attribute& attr, const Variant& value)
 {
-    EventAttributes event_attr;
+    const EventAttributes* p = get_event_attributes(attr);
 
-    if (!get_event_attributes(attr, event_attr))
+    if (!p)
         return;
 
-    if (enable_snapshot_info) {
-        uint64_t  lvl = 1;
-        Variant v_lvl(lvl), v_p_lvl;
-
-        // Use Caliper::exchange() to accelerate common-case of setting new hierarchy level to 1.
-        // If previous level was > 0, we need to increment it further
+    const EventAttributes& event_attr(*p);
 
-        // FIXME: There may be a race condition between c->exchange() and c->set()
-        // when two threads update a process-scope attribute.
-        // Can fix that with a more general c->update(update_fn) function
-
-        v_p_lvl = c->exchange(event_attr.lvl_attr, v_lvl);
-        lvl     = v_p_lvl.to_uint();
-
-        if (lvl > 0) {
-            v_lvl = Variant(++lvl);
-            c->set(event_attr.lvl_attr, v_lvl);
-        }
+    if (enable_snapshot_info) {
+        uint64_t lvl = push_level(c, event_attr);
 
         // Construct the trigger info entry
 
         Attribute attrs[3] = { trigger_level_attr, trigger_begin_attr, event_attr.begin_attr };
-        Variant   vals[3]  = { v_lvl, Variant(attr.id()), value };
+        Variant   vals[3]  = { Variant(lvl), Variant(attr.id()), value };
 
         SnapshotRecord::FixedSnapshotRecord<3> trigger_info_data;
         SnapshotRecord trigger_info(trigger_info_data);
 
         c->make_entrylist(3, attrs, vals, trigger_info);
-        c->push_snapshot(CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, &trigger_info);
+        c->push_snapshot(CALI_SCOPE_TASK | CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, &trigger_info);
     } else {
-        c->push_snapshot(CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, nullptr);
+        c->push_snapshot(CALI_SCOPE_TASK | CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, nullptr);
     }
 }
 
 void event_set_cb(Caliper* c, const Attribute& attr, const Variant& value)
 {
-    EventAttributes event_attr;
+    const EventAttributes* p = get_event_attributes(attr);
 
-    if (!get_event_attributes(attr, event_attr))
+    if (!p)
         return;
 
+    const EventAttributes& event_attr(*p);
+
     if (enable_snapshot_info) {
-        uint64_t  lvl(1);
-        Variant v_lvl(lvl);
+        uint64_t lvl = 1;
 
         // The level for set() is always 1
         // FIXME: ... except for set_path()??
-        c->set(event_attr.lvl_attr, v_lvl);
+        set_level(c, event_attr, lvl);
 
         // Construct the trigger info entry
 
         Attribute attrs[3] = { trigger_level_attr, trigger_set_attr, event_attr.set_attr };
-        Variant   vals[3]  = { v_lvl, Variant(attr.id()), value };
+        Variant   vals[3]  = { Variant(lvl), Variant(attr.id()), value };
 
         SnapshotRecord::FixedSnapshotRecord<3> trigger_info_data;
         SnapshotRecord trigger_info(trigger_info_data);
 
         c->make_entrylist(3, attrs, vals, trigger_info);
-        c->push_snapshot(CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, &trigger_info);
+        c->push_snapshot(CALI_SCOPE_TASK | CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, &trigger_info);
     } else {
-        c->push_snapshot(CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, nullptr);
+        c->push_snapshot(CALI_SCOPE_TASK | CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, nullptr);
     }
 }
 
 void event_end_cb(Caliper* c, const Attribute& attr, const Variant& value)
 {
-    EventAttributes event_attr;
+    const EventAttributes* p = get_event_attributes(attr);
 
-    if (!get_event_attributes(attr, event_attr))
+    if (!p)
         return;
 
-    if (enable_snapshot_info) {
-        uint64_t  lvl = 0;
-        Variant v_lvl(lvl), v_p_lvl;
+    const EventAttributes& event_attr(*p);
 
-        // Use Caliper::exchange() to accelerate common-case of setting new level to 0.
-        // If previous level was > 1, we need to update it again
+    if (enable_snapshot_info) {
+        // An end without matching begin/set does not trigger a snapshot.
 
-        v_p_lvl = c->exchange(event_attr.lvl_attr, v_lvl);
+        uint64_t lvl = pop_level(c, event_attr);
 
-        if (v_p_lvl.empty())
+        if (lvl == 0)
             return;
-        
-        lvl     = v_p_lvl.to_uint();
-
-        if (lvl > 1)
-            c->set(event_attr.lvl_attr, Variant(--lvl));
 
         // Construct the trigger info entry with previous level
 
         Attribute attrs[3] = { trigger_level_attr, trigger_end_attr, event_attr.end_attr };
-        Variant   vals[3]  = { v_p_lvl, Variant(attr.id()), value };
+        Variant   vals[3]  = { Variant(lvl), Variant(attr.id()), value };
 
         SnapshotRecord::FixedSnapshotRecord<3> trigger_info_data;
         SnapshotRecord trigger_info(trigger_info_data);
 
         c->make_entrylist(3, attrs, vals, trigger_info);
-        c->push_snapshot(CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, &trigger_info);
+        c->push_snapshot(CALI_SCOPE_TASK | CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, &trigger_info);
     } else {
-        c->push_snapshot(CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, nullptr);
+        c->push_snapshot(CALI_SCOPE_TASK | CALI_SCOPE_THREAD | CALI_SCOPE_PROCESS, nullptr);
     }
 }
 
 void event_trigger_register(Caliper* c)
 {
-    event_attributes_lock.unlock();
-    
+    if (!event_attributes_table)
+        event_attributes_table = new event::EventAttributeTable<EventAttributes>;
+
     // parse the configuration & set up triggers
 
     config = RuntimeConfig::init("event", configdata);
@@ -0,0 +1,106 @@
+#include "../EventAttributeTable.h"
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+using namespace event;
+
+namespace
+{
+
+typedef EventAttributeTable<cali_id_t> Table;
+
+// first id handled by the fallback map
+const cali_id_t FallbackId = Table::ChunkSize * Table::MaxChunks;
+
+} // namespace [anonymous]
+
+TEST(EventAttributeTableTest, ChunkedIds) {
+    Table* table = new Table;
+
+    EXPECT_EQ(table->find(0), nullptr);
+    EXPECT_EQ(table->find(FallbackId - 1), nullptr);
+
+    table->insert(0, 100);
+    table->insert(Table::ChunkSize, 200);
+    table->insert(FallbackId - 1, 300);
+
+    ASSERT_NE(table->find(0), nullptr);
+    EXPECT_EQ(*table->find(0), 100);
+    ASSERT_NE(table->find(Table::ChunkSize), nullptr);
+    EXPECT_EQ(*table->find(Table::ChunkSize), 200);
+    ASSERT_NE(table->find(FallbackId - 1), nullptr);
+    EXPECT_EQ(*table->find(FallbackId - 1), 300);
+
+    // other ids in an allocated chunk are not valid
+    EXPECT_EQ(table->find(1), nullptr);
+    EXPECT_EQ(table->find(FallbackId - 2), nullptr);
+
+    delete table;
+}
+
+TEST(EventAttributeTableTest, FallbackIds) {
+    Table* table = new Table;
+
+    EXPECT_EQ(table->find(FallbackId), nullptr);
+
+    table->insert(FallbackId - 1, 1);
+    table->insert(FallbackId,     2);
+    table->insert(FallbackId + 1, 3);
+    table->insert(CALI_INV_ID - 1, 4);
+
+    ASSERT_NE(table->find(FallbackId - 1), nullptr);
+    EXPECT_EQ(*table->find(FallbackId - 1), 1);
+    ASSERT_NE(table->find(FallbackId), nullptr);
+    EXPECT_EQ(*table->find(FallbackId), 2);
+    ASSERT_NE(table->find(FallbackId + 1), nullptr);
+    EXPECT_EQ(*table->find(FallbackId + 1), 3);
+    ASSERT_NE(table->find(CALI_INV_ID - 1), nullptr);
+    EXPECT_EQ(*table->find(CALI_INV_ID - 1), 4);
+
+    EXPECT_EQ(table->find(FallbackId + 2), nullptr);
+
+    // fallback entries are stable
+    const cali_id_t* p = table->find(FallbackId);
+
+    for (cali_id_t i = 2; i < 1000; ++i)
+        table->insert(FallbackId + i, i);
+
+    EXPECT_EQ(table->find(FallbackId), p);
+    EXPECT_EQ(*p, 2);
+
+    delete table;
+}
+
+TEST(EventAttributeTableTest, MultipleThreads) {
+    Table* table = new Table;
+
+    const size_t NumThreads = 8;
+    const size_t NumIds     = 2000;
+
+    std::vector<std::thread> threads;
+
+    // each thread inserts ids in the chunked range and in the fallback 
+    // range, some in chunks shared with other threads
+    for (size_t t = 0; t < NumThreads; ++t)
+        threads.emplace_back([table,t,NumThreads,NumIds](){
+                for (cali_id_t i = t; i < NumIds; i += NumThreads) {
+                    table->insert(i, i);
+                    table->insert(FallbackId + i, i);
+                }
+            });
+
+    for (auto& t : threads)
+        t.join();
+
+    for (cali_id_t i = 0; i < NumIds; ++i) {
+        ASSERT_NE(table->find(i), nullptr);
+        EXPECT_EQ(*table->find(i), i);
+        ASSERT_NE(table->find(FallbackId + i), nullptr);
+        EXPECT_EQ(*table->find(FallbackId + i), i);
+    }
+
+    delete table;
+}
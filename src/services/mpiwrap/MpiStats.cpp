@@ -0,0 +1,352 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+///@file  MpiStats.cpp
+///@brief Caliper MPI message statistics service
+
+#include "../CaliperService.h"
+
+#include <Caliper.h>
+#include <SnapshotRecord.h>
+
+#include <Log.h>
+#include <Node.h>
+#include <RuntimeConfig.h>
+
+#include <util/spinlock.hpp>
+
+#include <climits>
+#include <mutex>
+#include <vector>
+
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
+using namespace cali;
+using namespace std;
+
+namespace cali
+{
+    bool mpistats_enabled      { false };
+    int  mpistats_peer_buckets { 16 };
+}
+
+namespace
+{
+
+ConfigSet        config;
+
+ConfigSet::Entry configdata[] = {
+    { "table_size", CALI_TYPE_UINT, "4096",
+      "Number of entries in each per-thread statistics table",
+      "Number of entries in each per-thread statistics table.\n"
+      "Calls that do not fit into the table are counted as dropped."
+    },
+    { "peer_buckets", CALI_TYPE_INT, "16",
+      "Number of peer rank buckets per communicator",
+      "Number of peer rank buckets per communicator. Peer ranks are grouped\n"
+      "into this many contiguous ranges."
+    },
+    ConfigSet::Terminator
+};
+
+const int MAX_REGION_NODES = 4;
+
+Attribute comm_attr  { Attribute::invalid };
+Attribute peer_attr  { Attribute::invalid };
+Attribute count_attr { Attribute::invalid };
+Attribute bytes_attr { Attribute::invalid };
+Attribute time_attr  { Attribute::invalid };
+
+size_t    table_size { 4096 };
+
+/// Per-thread, fixed-size statistics table. Accumulates calls, bytes, and
+/// time per (region, MPI function, communicator, peer bucket) key.
+/// Open addressing with linear probing; never grows.
+struct StatsTable {
+    struct Key {
+        Node* region[MAX_REGION_NODES];
+        Node* fn;
+        int   comm;
+        int   peer;
+
+        bool operator == (const Key& k) const {
+            return fn == k.fn && comm == k.comm && peer == k.peer 
+                && std::equal(region, region+MAX_REGION_NODES, k.region);
+        }
+    };
+
+    struct Entry {
+        Key      key;
+        bool     used;
+        uint64_t count;
+        uint64_t bytes;
+        uint64_t time_ns;
+    };
+
+    std::vector<Entry> entries;
+    size_t             num_used;
+    uint64_t           num_dropped;
+
+    util::spinlock     lock;
+    StatsTable*        next;
+
+    StatsTable(size_t size)
+        : entries(size, Entry()), num_used(0), num_dropped(0), next(nullptr)
+        { }
+
+    static size_t hash(const Key& k) {
+        size_t h = std::hash<Node*>()(k.fn);
+
+        for (int i = 0; i < MAX_REGION_NODES; ++i)
+            h = h * 31 + std::hash<Node*>()(k.region[i]);
+
+        h = h * 31 + static_cast<size_t>(k.comm);
+        h = h * 31 + static_cast<size_t>(k.peer);
+
+        return h;
+    }
+
+    Entry* find_or_insert(const Key& k) {
+        size_t n = entries.size();
+        size_t i = hash(k) % n;
+
+        // Stop inserting at 3/4 fill to keep probe sequences short
+        for (size_t p = 0; p < n; ++p, i = (i+1) % n) {
+            Entry& e = entries[i];
+
+            if (e.used && e.key == k)
+                return &e;
+            if (!e.used) {
+                if (4 * num_used >= 3 * n)
+                    return nullptr;
+
+                e.key  = k;
+                e.used = true;
+                ++num_used;
+
+                return &e;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void clear() {
+        std::fill(entries.begin(), entries.end(), Entry());
+        num_used    = 0;
+        num_dropped = 0;
+    }
+};
+
+StatsTable*     table_list { nullptr };
+util::spinlock  table_list_lock;
+
+thread_local StatsTable* t_table CALI_TLS_INITIAL_EXEC = nullptr;
+
+StatsTable* acquire_table()
+{
+    if (t_table)
+        return t_table;
+
+    StatsTable* t = new StatsTable(table_size);
+
+    std::lock_guard<util::spinlock>
+        g(table_list_lock);
+
+    t->next    = table_list;
+    table_list = t;
+    t_table    = t;
+
+    return t;
+}
+
+void write_entry(Caliper* c, const StatsTable::Entry& e)
+{
+    SnapshotRecord::FixedSnapshotRecord<MAX_REGION_NODES+8> snapshot_data;
+    SnapshotRecord snapshot(snapshot_data);
+
+    for (int i = 0; i < MAX_REGION_NODES && e.key.region[i]; ++i)
+        snapshot.append(e.key.region[i]);
+
+    snapshot.append(e.key.fn);
+
+    uint64_t time_us = e.time_ns / 1000;
+
+    snapshot.append(comm_attr.id(),  Variant(e.key.comm));
+    if (e.key.peer != INT_MIN)
+        snapshot.append(peer_attr.id(), Variant(e.key.peer));
+    snapshot.append(count_attr.id(), Variant(CALI_TYPE_UINT, &e.count,  sizeof(uint64_t)));
+    snapshot.append(bytes_attr.id(), Variant(CALI_TYPE_UINT, &e.bytes,  sizeof(uint64_t)));
+    snapshot.append(time_attr.id(),  Variant(CALI_TYPE_UINT, &time_us,  sizeof(uint64_t)));
+
+    c->flush_snapshot(nullptr, &snapshot);
+}
+
+void flush_cb(Caliper* c, const SnapshotRecord*)
+{
+    StatsTable* t = nullptr;
+
+    {
+        std::lock_guard<util::spinlock>
+            g(table_list_lock);
+
+        t = table_list;
+    }
+
+    size_t   num_written = 0;
+    uint64_t num_dropped = 0;
+
+    for ( ; t; t = t->next) {
+        std::vector<StatsTable::Entry> entries;
+
+        // copy the used entries out, so we don't hold the lock during the flush
+        {
+            std::lock_guard<util::spinlock>
+                g(t->lock);
+
+            entries.reserve(t->num_used);
+
+            for (const StatsTable::Entry& e : t->entries)
+                if (e.used)
+                    entries.push_back(e);
+
+            num_dropped += t->num_dropped;
+            t->clear();
+        }
+
+        for (const StatsTable::Entry& e : entries)
+            write_entry(c, e);
+
+        num_written += entries.size();
+    }
+
+    Log(1).stream() << "mpistats: Flushed " << num_written << " records." << endl;
+
+    if (num_dropped > 0)
+        Log(1).stream() << "mpistats: " << num_dropped 
+                        << " MPI calls were not recorded because the statistics table was full."
+                        << " Consider increasing CALI_MPISTATS_TABLE_SIZE." << endl;
+}
+
+void mpistats_register(Caliper* c)
+{
+    config = RuntimeConfig::init("mpistats", configdata);
+
+    table_size            = std::max<size_t>(config.get("table_size").to_uint(), 1);
+    mpistats_peer_buckets = std::max(config.get("peer_buckets").to_int(), 1);
+
+    comm_attr  = 
+        c->create_attribute("mpistats.comm",  CALI_TYPE_INT,
+                            CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+    peer_attr  = 
+        c->create_attribute("mpistats.peer",  CALI_TYPE_INT,
+                            CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+    count_attr = 
+        c->create_attribute("mpistats.count", CALI_TYPE_UINT,
+                            CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+    bytes_attr = 
+        c->create_attribute("mpistats.bytes", CALI_TYPE_UINT,
+                            CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+    time_attr  = 
+        c->create_attribute("mpistats.time",  CALI_TYPE_UINT,
+                            CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+
+    c->events().flush_evt.connect(&flush_cb);
+
+    mpistats_enabled = true;
+
+    Log(1).stream() << "Registered mpistats service" << endl;
+}
+
+} // anonymous namespace
+
+
+namespace cali
+{
+
+/// \brief Account an MPI call in the calling thread's statistics table
+///
+/// The current process, thread, and task context identifies the region.
+///
+/// \param c       Caliper instance
+/// \param fn      Context tree node of the MPI function
+/// \param comm    Communicator id (Fortran handle), or -1
+/// \param peer    First rank of the peer bucket, or INT_MIN for calls
+///   without a peer
+/// \param bytes   Message size in bytes
+/// \param time_ns Time spent in the call in nanoseconds
+
+void mpistats_record(Caliper* c, Node* fn, int comm, int peer, uint64_t bytes, uint64_t time_ns)
+{
+    SnapshotRecord::FixedSnapshotRecord<MAX_REGION_NODES+4> context_data;
+    SnapshotRecord context(context_data);
+
+    c->pull_context(CALI_SCOPE_PROCESS | CALI_SCOPE_THREAD | CALI_SCOPE_TASK, &context);
+
+    StatsTable::Key key;
+
+    std::fill_n(key.region, MAX_REGION_NODES, nullptr);
+
+    SnapshotRecord::Data  data  = context.data();
+    SnapshotRecord::Sizes sizes = context.size();
+
+    for (size_t i = 0; i < std::min<size_t>(sizes.n_nodes, MAX_REGION_NODES); ++i)
+        key.region[i] = const_cast<Node*>(data.node_entries[i]);
+
+    key.fn   = fn;
+    key.comm = comm;
+    key.peer = peer;
+
+    StatsTable* t = acquire_table();
+
+    std::lock_guard<util::spinlock>
+        g(t->lock);
+
+    StatsTable::Entry* e = t->find_or_insert(key);
+
+    if (!e) {
+        ++t->num_dropped;
+        return;
+    }
+
+    ++e->count;
+    e->bytes   += bytes;
+    e->time_ns += time_ns;
+}
+
+CaliperService mpistats_service = { "mpistats", ::mpistats_register };
+
+} // namespace cali
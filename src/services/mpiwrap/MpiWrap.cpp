@@ -38,7 +38,20 @@
 #include <Caliper.h>
 
 #include <Log.h>
+#include <Node.h>
 #include <RuntimeConfig.h>
+#include <SnapshotRecord.h>
+
+#include <util/spinlock.hpp>
+
+#include <mutex>
+#include <unordered_map>
+
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
 
 using namespace cali;
 using namespace std;
@@ -49,7 +62,12 @@ namespace cali
     Attribute mpirank_attr { Attribute::invalid };
     Attribute mpisize_attr { Attribute::invalid };
 
+    Attribute mpimsg_peer_attr  { Attribute::invalid };
+    Attribute mpimsg_count_attr { Attribute::invalid };
+    Attribute mpimsg_bytes_attr { Attribute::invalid };
+
     bool      mpi_enabled  { false };
+    bool      mpi_msg_stats_enabled { false };
 
     string    mpi_whitelist_string;
     string    mpi_blacklist_string;
@@ -71,15 +89,122 @@ ConfigSet::Entry configdata[] = {
       "List of MPI functions to filter",
       "Colon-separated list of functions to blacklist." 
     },
+    { "msg_stats", CALI_TYPE_BOOL, "false",
+      "Accumulate message counts and sizes per MPI function and peer",
+      "Accumulate message counts and sizes per MPI function and peer rank\n"
+      "for point-to-point operations in per-thread tables.\n"
+      "The tables are written out as snapshot records on flush."
+    },
     ConfigSet::Terminator
 };
 
+/// Per-thread message statistics, keyed by MPI function node and peer rank
+struct MsgStatsTable {
+    struct Key {
+        Node* fn;
+        int   peer;
+
+        bool operator == (const Key& k) const {
+            return fn == k.fn && peer == k.peer;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            return std::hash<Node*>()(k.fn) ^ (std::hash<int>()(k.peer) << 1);
+        }
+    };
+
+    struct Stats {
+        uint64_t count;
+        uint64_t bytes;
+    };
+
+    typedef std::unordered_map<Key, Stats, KeyHash> map_t;
+
+    map_t          table;
+    util::spinlock lock;
+
+    MsgStatsTable* next;
+};
+
+MsgStatsTable*  msg_stats_list { nullptr };
+util::spinlock  msg_stats_list_lock;
+
+thread_local MsgStatsTable* t_msg_stats CALI_TLS_INITIAL_EXEC = nullptr;
+
+MsgStatsTable* acquire_msg_stats_table()
+{
+    if (t_msg_stats)
+        return t_msg_stats;
+
+    MsgStatsTable* t = new MsgStatsTable;
+
+    std::lock_guard<util::spinlock>
+        g(msg_stats_list_lock);
+
+    t->next        = msg_stats_list;
+    msg_stats_list = t;
+    t_msg_stats    = t;
+
+    return t;
+}
+
+void flush_msg_stats_cb(Caliper* c, const SnapshotRecord*)
+{
+    MsgStatsTable* t = nullptr;
+
+    {
+        std::lock_guard<util::spinlock>
+            g(msg_stats_list_lock);
+
+        t = msg_stats_list;
+    }
+
+    size_t num_written = 0;
+
+    for ( ; t; t = t->next) {
+        MsgStatsTable::map_t table;
+
+        // take the table contents, so we don't hold the lock during the flush
+        {
+            std::lock_guard<util::spinlock>
+                g(t->lock);
+
+            table.swap(t->table);
+        }
+
+        for (const auto& p : table) {
+            SnapshotRecord::FixedSnapshotRecord<4> snapshot_data;
+            SnapshotRecord snapshot(snapshot_data);
+
+            snapshot.append(p.first.fn);
+
+            const cali_id_t attr[3] = {
+                mpimsg_peer_attr.id(), mpimsg_count_attr.id(), mpimsg_bytes_attr.id()
+            };
+            const Variant   data[3] = {
+                Variant(p.first.peer),
+                Variant(CALI_TYPE_UINT, &p.second.count, sizeof(uint64_t)),
+                Variant(CALI_TYPE_UINT, &p.second.bytes, sizeof(uint64_t))
+            };
+
+            snapshot.append(3, attr, data);
+
+            c->flush_snapshot(nullptr, &snapshot);
+            ++num_written;
+        }
+    }
+
+    Log(1).stream() << "mpi: Flushed " << num_written << " message statistics records." << endl;
+}
+
 void mpi_register(Caliper* c)
 {
     config = RuntimeConfig::init("mpi", configdata);
 
     mpifn_attr   = 
-        c->create_attribute("mpi.function", CALI_TYPE_STRING);
+        c->create_attribute("mpi.function", CALI_TYPE_STRING, CALI_ATTR_NOMERGE);
     mpirank_attr = 
         c->create_attribute("mpi.rank", CALI_TYPE_INT, 
                             CALI_ATTR_SCOPE_PROCESS | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
@@ -88,6 +213,21 @@ void mpi_register(Caliper* c)
                             CALI_ATTR_SCOPE_PROCESS | CALI_ATTR_SKIP_EVENTS);
 
     mpi_enabled = true;
+    mpi_msg_stats_enabled = config.get("msg_stats").to_bool();
+
+    if (mpi_msg_stats_enabled) {
+        mpimsg_peer_attr  =
+            c->create_attribute("mpi.msg.peer",  CALI_TYPE_INT,
+                                CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+        mpimsg_count_attr =
+            c->create_attribute("mpi.msg.count", CALI_TYPE_UINT,
+                                CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+        mpimsg_bytes_attr =
+            c->create_attribute("mpi.msg.bytes", CALI_TYPE_UINT,
+                                CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS | CALI_ATTR_ASVALUE);
+
+        c->events().flush_evt.connect(&flush_msg_stats_cb);
+    }
 
     mpi_whitelist_string = config.get("whitelist").to_string();
     mpi_blacklist_string = config.get("blacklist").to_string();
@@ -98,6 +238,32 @@ void mpi_register(Caliper* c)
 } // anonymous namespace 
 
 
+namespace cali
+{
+
+/// \brief Account a point-to-point message in the calling thread's
+///   message statistics table
+///
+/// \param fn    Context tree node of the MPI function
+/// \param peer  Peer rank (destination or source argument)
+/// \param bytes Message size in bytes
+
+void mpi_record_message(Node* fn, int peer, uint64_t bytes)
+{
+    MsgStatsTable* t = acquire_msg_stats_table();
+
+    std::lock_guard<util::spinlock>
+        g(t->lock);
+
+    MsgStatsTable::Stats& s = t->table[MsgStatsTable::Key { fn, peer }];
+
+    ++s.count;
+    s.bytes += bytes;
+}
+
+} // namespace cali
+
+
 namespace cali 
 {
     CaliperService mpi_service = { "mpi", ::mpi_register };
@@ -2,6 +2,7 @@
 #include <Caliper.h>
 
 #include <Log.h>
+#include <Node.h>
 #include <Variant.h>
 
 #include <util/split.hpp>
@@ -9,6 +10,8 @@
 #include <mpi.h>
 
 #include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cstring>
 #include <iterator>
 #include <string>
@@ -21,9 +24,16 @@ namespace cali
     extern Attribute   mpisize_attr;
 
     extern bool        mpi_enabled;
+    extern bool        mpi_msg_stats_enabled;
+
+    extern bool        mpistats_enabled;
+    extern int         mpistats_peer_buckets;
 
     extern std::string mpi_whitelist_string;
     extern std::string mpi_blacklist_string;
+
+    void mpi_record_message(Node* fn, int peer, uint64_t bytes);
+    void mpistats_record(Caliper* c, Node* fn, int comm, int peer, uint64_t bytes, uint64_t time_ns);
 }
 
 using namespace cali;
@@ -31,11 +41,15 @@ using namespace std;
 
 namespace 
 {
+    // Pre-created mpi.function context tree node for each MPI function.
+    // The node is null if the function is not instrumented. Wrappers push
+    // the node through the node cache, which skips the context tree lookup.
+
     {{forallfn foo}}
-    bool enable_{{foo}} = true;
+    Caliper::NodeCacheEntry fn_{{foo}} = { nullptr, nullptr };
     {{endforallfn}}
 
-    void setup_filter() {
+    void setup_filter(Caliper& c) {
         std::vector<std::string> whitelist;
         std::vector<std::string> blacklist;
 
@@ -45,21 +59,19 @@ namespace
         bool have_whitelist = whitelist.size() > 0;
         bool have_blacklist = blacklist.size() > 0;
 
-        if (!have_whitelist && !have_blacklist)
-            return;
-
         const struct fntable_elem {
-            const char* name;
-            bool*       enableptr; 
+            const char*              name;
+            Caliper::NodeCacheEntry* entry; 
         } table[] = {
             {{forallfn foo}}
-            { "{{foo}}", &enable_{{foo}} },
+            { "{{foo}}", &fn_{{foo}} },
             {{endforallfn}}
             { 0, 0 }
         };
 
-        for (const fntable_elem* e = table; e->name && e->enableptr; ++e) {
+        for (const fntable_elem* e = table; e->name && e->entry; ++e) {
             std::string fnstr(e->name);
+            bool        enable = true;
 
             if (have_whitelist) {
                 vector<string>::iterator it = std::find(whitelist.begin(), whitelist.end(), fnstr);
@@ -67,16 +79,23 @@ namespace
                 if (it != whitelist.end())
                     whitelist.erase(it);
                 else
-                    *(e->enableptr) = false;
+                    enable = false;
             }
             if (have_blacklist) {
                 vector<string>::iterator it = std::find(blacklist.begin(), blacklist.end(), fnstr);
 
                 if (it != blacklist.end()) {
                     blacklist.erase(it);
-                    *(e->enableptr) = false;
+                    enable = false;
                 }
             }
+
+            if (enable) {
+                Entry node = c.make_entry(mpifn_attr, Variant(CALI_TYPE_STRING, e->name, strlen(e->name)));
+
+                if (!node.is_empty())
+                    e->entry->node = c.node(node.node()->id());
+            }
         }
 
         for (vector<string>::const_iterator it = whitelist.begin(); it != whitelist.end(); ++it)
@@ -84,6 +103,96 @@ namespace
         for (vector<string>::const_iterator it = blacklist.begin(); it != blacklist.end(); ++it)
             Log(1).stream() << "Unknown MPI function " << *it << " in MPI function blacklist" << endl;
     }
+
+    inline void record_message(Node* fn, int count, MPI_Datatype type, int peer) {
+        int size = 0;
+        PMPI_Type_size(type, &size);
+
+        mpi_record_message(fn, peer, static_cast<uint64_t>(count) * static_cast<uint64_t>(size));
+    }
+
+    inline void record_received_message(Node* fn, MPI_Status* status) {
+        int bytes = 0;
+        PMPI_Get_count(status, MPI_BYTE, &bytes);
+
+        if (bytes == MPI_UNDEFINED)
+            bytes = 0;
+
+        mpi_record_message(fn, status->MPI_SOURCE, static_cast<uint64_t>(bytes));
+    }
+
+    /// Collects the mpistats data for one MPI call
+    class MpiStatsCall {
+        Node*    m_fn;
+        int      m_comm;
+        int      m_peer;
+        uint64_t m_bytes;
+
+        std::chrono::steady_clock::time_point m_start;
+        uint64_t m_time_ns;
+
+    public:
+
+        MpiStatsCall(Node* fn)
+            : m_fn(fn), m_comm(-1), m_peer(INT_MIN), m_bytes(0), m_time_ns(0)
+            { }
+
+        void set_comm(MPI_Comm comm) {
+            if (mpistats_enabled && comm != MPI_COMM_NULL)
+                m_comm = PMPI_Comm_c2f(comm);
+        }
+
+        void set_peer(int peer, MPI_Comm comm) {
+            m_peer = peer;
+
+            if (peer >= 0) {
+                int commsize = 1;
+                PMPI_Comm_size(comm, &commsize);
+
+                int width = (commsize + mpistats_peer_buckets - 1) / mpistats_peer_buckets;
+                m_peer    = (peer / width) * width;
+            }
+        }
+
+        void set_message(int count, MPI_Datatype type, int peer, MPI_Comm comm) {
+            if (!mpistats_enabled)
+                return;
+
+            int size = 0;
+            PMPI_Type_size(type, &size);
+
+            m_bytes = static_cast<uint64_t>(count) * static_cast<uint64_t>(size);
+            set_peer(peer, comm);
+        }
+
+        /// Take message size and peer of a completed receive from its status
+        void set_received_message(MPI_Status* status, MPI_Comm comm) {
+            if (!mpistats_enabled)
+                return;
+
+            int bytes = 0;
+            PMPI_Get_count(status, MPI_BYTE, &bytes);
+
+            m_bytes = bytes == MPI_UNDEFINED ? 0 : static_cast<uint64_t>(bytes);
+            set_peer(status->MPI_SOURCE, comm);
+        }
+
+        void start() {
+            if (mpistats_enabled)
+                m_start = std::chrono::steady_clock::now();
+        }
+
+        void stop() {
+            if (mpistats_enabled)
+                m_time_ns = 
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+        }
+
+        void record(Caliper& c) {
+            if (mpistats_enabled)
+                mpistats_record(&c, m_fn, m_comm, m_peer, m_bytes, m_time_ns);
+        }
+    };
 }
 
 {{fn func MPI_Init MPI_Init_thread}}{
@@ -105,25 +214,103 @@ namespace
     Caliper c;    
 
     if (mpi_enabled) {
-        ::setup_filter();
+        ::setup_filter(c);
 
         int size;
         PMPI_Comm_size(MPI_COMM_WORLD, &size);
 
         c.set(mpisize_attr, Variant(size));
         c.set(mpirank_attr, Variant(rank));
+    } else if (mpistats_enabled) {
+        Log(1).stream() << "mpistats: The mpistats service requires the mpi service" << endl;
     }
 }{{endfn}}
 
 // Wrap all MPI functions
 
-{{fnall func MPI_Init MPI_Init_thread}}{
-    if (mpi_enabled && ::enable_{{func}}) {
+{{fnall func MPI_Init MPI_Init_thread MPI_Send MPI_Bsend MPI_Ssend MPI_Rsend MPI_Isend MPI_Ibsend MPI_Issend MPI_Irsend MPI_Recv MPI_Irecv}}{
+    if (::fn_{{func}}.node) {
         Caliper c;
-        c.begin(mpifn_attr, Variant(CALI_TYPE_STRING, "{{func}}", strlen("{{func}}")));
+        Caliper::NodeCacheEntry cache = ::fn_{{func}};
+        ::MpiStatsCall stats(cache.node);
+        {{apply_to_type MPI_Comm stats.set_comm}}
+        c.begin(mpifn_attr, cache.node->data(), &cache);
+        stats.start();
         {{callfn}}
-        c.end(mpifn_attr);
+        stats.stop();
+        c.end(mpifn_attr, &cache);
+        stats.record(c);
     } else {
         {{callfn}}
     }
 }{{endfnall}}
+
+// Point-to-point send operations: also account message size and peer
+
+{{fn func MPI_Send MPI_Bsend MPI_Ssend MPI_Rsend MPI_Isend MPI_Ibsend MPI_Issend MPI_Irsend}}{
+    if (::fn_{{func}}.node) {
+        Caliper c;
+        Caliper::NodeCacheEntry cache = ::fn_{{func}};
+        ::MpiStatsCall stats(cache.node);
+        stats.set_comm({{args 5}});
+        stats.set_message({{args 1}}, {{args 2}}, {{args 3}}, {{args 5}});
+        c.begin(mpifn_attr, cache.node->data(), &cache);
+        stats.start();
+        {{callfn}}
+        stats.stop();
+        if (mpi_msg_stats_enabled)
+            ::record_message(::fn_{{func}}.node, {{args 1}}, {{args 2}}, {{args 3}});
+        c.end(mpifn_attr, &cache);
+        stats.record(c);
+    } else {
+        {{callfn}}
+    }
+}{{endfn}}
+
+// Blocking receive: account the received message size and its actual
+// source from the status, which can differ from the posted count and 
+// source (e.g., with MPI_ANY_SOURCE)
+
+{{fn func MPI_Recv}}{
+    if (::fn_{{func}}.node) {
+        Caliper c;
+        Caliper::NodeCacheEntry cache = ::fn_{{func}};
+        ::MpiStatsCall stats(cache.node);
+        MPI_Status tmp_status;
+        if ({{args 6}} == MPI_STATUS_IGNORE)
+            {{args 6}} = &tmp_status;
+        stats.set_comm({{args 5}});
+        c.begin(mpifn_attr, cache.node->data(), &cache);
+        stats.start();
+        {{callfn}}
+        stats.stop();
+        stats.set_received_message({{args 6}}, {{args 5}});
+        if (mpi_msg_stats_enabled)
+            ::record_received_message(::fn_{{func}}.node, {{args 6}});
+        c.end(mpifn_attr, &cache);
+        stats.record(c);
+    } else {
+        {{callfn}}
+    }
+}{{endfn}}
+
+// Non-blocking receive: the message size and source are only known at
+// completion, so MPI_Irecv is not included in the message statistics, 
+// and mpistats only accounts the call
+
+{{fn func MPI_Irecv}}{
+    if (::fn_{{func}}.node) {
+        Caliper c;
+        Caliper::NodeCacheEntry cache = ::fn_{{func}};
+        ::MpiStatsCall stats(cache.node);
+        stats.set_comm({{args 5}});
+        c.begin(mpifn_attr, cache.node->data(), &cache);
+        stats.start();
+        {{callfn}}
+        stats.stop();
+        c.end(mpifn_attr, &cache);
+        stats.record(c);
+    } else {
+        {{callfn}}
+    }
+}{{endfn}}
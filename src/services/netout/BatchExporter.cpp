@@ -0,0 +1,548 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file  BatchExporter.cpp
+/// \brief BatchExporter implementation
+
+#include "caliper-config.h"
+
+#include "BatchExporter.h"
+
+#include <Caliper.h>
+#include <SnapshotRecord.h>
+
+#include <Log.h>
+#include <NetBatch.h>
+#include <Node.h>
+
+#include <util/spinlock.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef CALIPER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
+using namespace cali;
+using namespace std;
+
+namespace
+{
+
+struct ThreadBuffer {
+    util::spinlock             lock;
+    std::vector<unsigned char> data;
+    size_t                     num_records;
+
+    ThreadBuffer*              next;
+};
+
+thread_local ThreadBuffer* t_buffer CALI_TLS_INITIAL_EXEC = nullptr;
+
+/// Connect to "tcp:host:port" or "unix:path" endpoint. Returns socket or -1.
+int connect_endpoint(const std::string& endpoint)
+{
+    if (endpoint.compare(0, 5, "unix:") == 0) {
+        std::string path = endpoint.substr(5);
+        struct sockaddr_un addr;
+
+        if (path.size() >= sizeof(addr.sun_path))
+            return -1;
+
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+        if (sock < 0)
+            return -1;
+        if (connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+            close(sock);
+            return -1;
+        }
+
+        return sock;
+    }
+
+    if (endpoint.compare(0, 4, "tcp:") == 0) {
+        std::string hostport = endpoint.substr(4);
+        auto        p        = hostport.rfind(':');
+
+        if (p == std::string::npos)
+            return -1;
+
+        std::string host = hostport.substr(0, p);
+        std::string port = hostport.substr(p+1);
+
+        struct addrinfo hints;
+        struct addrinfo *res = nullptr;
+
+        std::memset(&hints, 0, sizeof(hints));
+        hints.ai_family   = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        if (getaddrinfo(host.empty() ? "localhost" : host.c_str(), port.c_str(), &hints, &res) != 0)
+            return -1;
+
+        int sock = -1;
+
+        for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+            sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+            if (sock < 0)
+                continue;
+            if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+                break;
+
+            close(sock);
+            sock = -1;
+        }
+
+        freeaddrinfo(res);
+
+        return sock;
+    }
+
+    return -1;
+}
+
+bool send_all(int sock, const unsigned char* buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = send(sock, buf, size, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+
+        buf  += n;
+        size -= n;
+    }
+
+    return true;
+}
+
+} // namespace
+
+
+struct BatchExporter::BatchExporterImpl
+{
+    struct Batch {
+        std::vector<unsigned char> data;
+        size_t                     num_records;
+    };
+
+    Config                  config;
+
+    // --- queue (shared between application threads and sender)
+
+    std::mutex              queue_lock;
+    std::condition_variable queue_cv;
+    std::deque<Batch>       queue;
+    bool                    stop_flag;
+
+    std::atomic<bool>       running;
+    std::thread             sender;
+
+    ThreadBuffer*           buffer_list;
+    util::spinlock          buffer_list_lock;
+
+    std::atomic<uint64_t>   snapshots_sent;
+    std::atomic<uint64_t>   snapshots_dropped;
+    std::atomic<uint64_t>   batches_sent;
+    std::atomic<uint64_t>   bytes_sent;
+
+    // --- sender thread state
+
+    int                     sock;
+    std::unordered_set<cali_id_t> sent_nodes;
+    std::chrono::steady_clock::time_point next_connect;
+
+    //
+    // --- application thread side
+    //
+
+    ThreadBuffer* acquire_buffer() {
+        if (t_buffer)
+            return t_buffer;
+
+        ThreadBuffer* tb = new ThreadBuffer;
+
+        tb->data.reserve(config.batch_size);
+        tb->num_records = 0;
+
+        std::lock_guard<util::spinlock>
+            g(buffer_list_lock);
+
+        tb->next    = buffer_list;
+        buffer_list = tb;
+        t_buffer    = tb;
+
+        return tb;
+    }
+
+    /// Move thread buffer contents into the queue. Called with tb->lock held.
+    /// Unless \a force is set, gives up if the queue lock is taken or the
+    /// queue is full.
+    bool enqueue(ThreadBuffer* tb, bool force) {
+        {
+            std::unique_lock<std::mutex>
+                lk(queue_lock, std::defer_lock);
+
+            if (force)
+                lk.lock();
+            else if (!lk.try_lock() || queue.size() >= config.queue_size)
+                return false;
+
+            queue.emplace_back();
+            queue.back().data.swap(tb->data);
+            queue.back().num_records = tb->num_records;
+        }
+
+        queue_cv.notify_one();
+
+        tb->data.reserve(config.batch_size);
+        tb->num_records = 0;
+
+        return true;
+    }
+
+    void push(const SnapshotRecord* snapshot) {
+        if (!running.load())
+            return;
+
+        SnapshotRecord::Sizes sizes = snapshot->size();
+        SnapshotRecord::Data  addr  = snapshot->data();
+
+        cali_id_t              node_ids_buf[64];
+        std::vector<cali_id_t> node_ids_vec;
+        cali_id_t*             node_ids = node_ids_buf;
+
+        if (sizes.n_nodes > 64) {
+            node_ids_vec.resize(sizes.n_nodes);
+            node_ids = node_ids_vec.data();
+        }
+
+        for (size_t i = 0; i < sizes.n_nodes; ++i)
+            node_ids[i] = addr.node_entries[i]->id();
+
+        ThreadBuffer* tb = acquire_buffer();
+
+        std::lock_guard<util::spinlock>
+            g(tb->lock);
+
+        // Backpressure: the sender can't keep up, so shed load instead of blocking
+        if (tb->data.size() >= 4 * config.batch_size) {
+            ++snapshots_dropped;
+            return;
+        }
+
+        netbatch::append_snapshot(sizes.n_nodes, node_ids,
+                                  sizes.n_immediate, addr.immediate_attr, addr.immediate_data,
+                                  tb->data);
+        ++tb->num_records;
+
+        if (tb->data.size() >= config.batch_size)
+            enqueue(tb, false);
+    }
+
+    void collect_buffers(bool force) {
+        ThreadBuffer* tb = nullptr;
+
+        {
+            std::lock_guard<util::spinlock>
+                g(buffer_list_lock);
+
+            tb = buffer_list;
+        }
+
+        for ( ; tb; tb = tb->next) {
+            std::lock_guard<util::spinlock>
+                g(tb->lock);
+
+            if (tb->num_records > 0)
+                enqueue(tb, force);
+        }
+    }
+
+    //
+    // --- sender thread side
+    //
+
+    bool connect() {
+        if (sock >= 0)
+            return true;
+
+        auto now = std::chrono::steady_clock::now();
+
+        if (now < next_connect)
+            return false;
+
+        sock = connect_endpoint(config.endpoint);
+
+        if (sock < 0) {
+            Log(1).stream() << "netout: Could not connect to " << config.endpoint 
+                            << ", will retry" << std::endl;
+
+            next_connect = now + std::chrono::seconds(1);
+            return false;
+        }
+
+        // a new connection needs all node definitions again
+        sent_nodes.clear();
+
+        return true;
+    }
+
+    void disconnect() {
+        if (sock >= 0)
+            close(sock);
+
+        sock = -1;
+    }
+
+    void define_node(Node* node, std::vector<unsigned char>& buf) {
+        if (!node || node->id() == CALI_INV_ID)
+            return;
+        if (!sent_nodes.insert(node->id()).second)
+            return;
+
+        Node* parent = node->parent();
+
+        if (parent && parent->id() != CALI_INV_ID)
+            define_node(parent, buf);
+        else
+            parent = nullptr;
+
+        define_node(Caliper::scopeless_node(node->attribute()), buf);
+
+        netbatch::append_node(node->id(), node->attribute(), 
+                              parent ? parent->id() : CALI_INV_ID, node->data(), buf);
+    }
+
+    void send_batch(Batch& batch) {
+        if (!connect()) {
+            snapshots_dropped += batch.num_records;
+            return;
+        }
+
+        // Don't use a Caliper instance here: it would register the sender
+        // thread with Caliper, and services would start instrumenting it.
+
+        std::vector<unsigned char> raw;
+
+        raw.reserve(batch.data.size() + 1024);
+
+        netbatch::decode(batch.data.data(), batch.data.size(), nullptr,
+                         [this,&raw](size_t n, const cali_id_t ids[], size_t m, const cali_id_t attr[], const Variant*){
+                             for (size_t i = 0; i < n; ++i)
+                                 define_node(Caliper::scopeless_node(ids[i]), raw);
+                             for (size_t i = 0; i < m; ++i)
+                                 define_node(Caliper::scopeless_node(attr[i]), raw);
+                         });
+
+        raw.insert(raw.end(), batch.data.begin(), batch.data.end());
+
+        netbatch::Header header = { 0, static_cast<uint32_t>(raw.size()), static_cast<uint32_t>(raw.size()) };
+        std::vector<unsigned char> frame(netbatch::HeaderSize);
+
+#ifdef CALIPER_HAVE_ZLIB
+        if (config.compress) {
+            uLongf len = compressBound(raw.size());
+
+            frame.resize(netbatch::HeaderSize + len);
+
+            if (compress2(frame.data() + netbatch::HeaderSize, &len, raw.data(), raw.size(), Z_BEST_SPEED) == Z_OK
+                && len < raw.size()) {
+                header.flags        = netbatch::Compressed;
+                header.payload_size = static_cast<uint32_t>(len);
+
+                frame.resize(netbatch::HeaderSize + len);
+            }
+        }
+#endif
+        if (!(header.flags & netbatch::Compressed)) {
+            frame.resize(netbatch::HeaderSize);
+            frame.insert(frame.end(), raw.begin(), raw.end());
+        }
+
+        netbatch::write_header(header, frame.data());
+
+        if (!send_all(sock, frame.data(), frame.size())) {
+            Log(1).stream() << "netout: Lost connection to " << config.endpoint << std::endl;
+
+            disconnect();
+            snapshots_dropped += batch.num_records;
+
+            return;
+        }
+
+        snapshots_sent += batch.num_records;
+        ++batches_sent;
+        bytes_sent     += frame.size();
+    }
+
+    void run() {
+        while (true) {
+            Batch batch;
+            bool  have_batch = false;
+
+            {
+                std::unique_lock<std::mutex>
+                    lk(queue_lock);
+
+                if (queue.empty() && !stop_flag)
+                    queue_cv.wait_for(lk, std::chrono::milliseconds(config.interval_ms));
+
+                if (!queue.empty()) {
+                    batch = std::move(queue.front());
+                    queue.pop_front();
+                    have_batch = true;
+                } else if (stop_flag)
+                    break;
+            }
+
+            if (have_batch)
+                send_batch(batch);
+            else
+                collect_buffers(false);
+        }
+
+        disconnect();
+    }
+
+    BatchExporterImpl(const Config& cfg)
+        : config(cfg),
+          stop_flag(false),
+          running(false),
+          buffer_list(nullptr),
+          snapshots_sent(0),
+          snapshots_dropped(0),
+          batches_sent(0),
+          bytes_sent(0),
+          sock(-1)
+        { 
+#ifndef CALIPER_HAVE_ZLIB
+            if (config.compress)
+                Log(1).stream() << "netout: zlib not available, sending uncompressed batches" << std::endl;
+#endif
+        }
+
+    ~BatchExporterImpl() {
+        for (ThreadBuffer* tb = buffer_list; tb; ) {
+            ThreadBuffer* tmp = tb->next;
+            delete tb;
+            tb = tmp;
+        }
+    }
+};
+
+
+BatchExporter::BatchExporter(const Config& config)
+    : mP(new BatchExporterImpl(config))
+{ }
+
+BatchExporter::~BatchExporter()
+{
+    stop();
+}
+
+void 
+BatchExporter::start()
+{
+    if (mP->running.exchange(true))
+        return;
+
+    mP->stop_flag = false;
+    mP->sender    = std::thread(&BatchExporterImpl::run, mP.get());
+}
+
+void
+BatchExporter::stop()
+{
+    if (!mP->running.exchange(false))
+        return;
+
+    mP->collect_buffers(true);
+
+    {
+        std::lock_guard<std::mutex>
+            g(mP->queue_lock);
+
+        mP->stop_flag = true;
+    }
+
+    mP->queue_cv.notify_one();
+    mP->sender.join();
+}
+
+void
+BatchExporter::push(const SnapshotRecord* snapshot)
+{
+    mP->push(snapshot);
+}
+
+BatchExporter::Statistics
+BatchExporter::statistics() const
+{
+    Statistics s = { 
+        mP->snapshots_sent.load(), 
+        mP->snapshots_dropped.load(),
+        mP->batches_sent.load(),
+        mP->bytes_sent.load() 
+    };
+
+    return s;
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// \file  BatchExporter.h
+/// \brief BatchExporter class definition
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace cali
+{
+
+class Caliper;
+class SnapshotRecord;
+
+/// \brief Streams snapshot records in binary batches to a socket endpoint.
+///
+/// Application threads encode snapshots into per-thread buffers and hand
+/// full buffers to a bounded queue. A background thread adds context tree
+/// node definitions, optionally compresses the batch, and sends it. 
+/// Application threads never wait for the network: if the queue is full,
+/// they keep buffering up to a limit, and then drop snapshots.
+
+class BatchExporter
+{
+    struct BatchExporterImpl;
+
+    std::unique_ptr<BatchExporterImpl> mP;
+
+public:
+
+    struct Config {
+        std::string endpoint;      ///< "tcp:host:port" or "unix:path"
+        size_t      batch_size;    ///< Target batch size in bytes
+        size_t      queue_size;    ///< Max. number of queued batches
+        bool        compress;      ///< Compress batches (requires zlib)
+        unsigned    interval_ms;   ///< Max. time before partial batches are sent
+    };
+
+    BatchExporter(const Config& config);
+
+    ~BatchExporter();
+
+    /// \brief Start the background sender thread
+    void start();
+    /// \brief Send all buffered data and stop the sender thread
+    void stop();
+
+    /// \brief Add \a snapshot to the calling thread's buffer. Does not block.
+    void push(const SnapshotRecord* snapshot);
+
+    struct Statistics {
+        uint64_t snapshots_sent;
+        uint64_t snapshots_dropped;
+        uint64_t batches_sent;
+        uint64_t bytes_sent;
+    };
+
+    Statistics statistics() const;
+};
+
+} // namespace cali
@@ -1,9 +1,16 @@
 /// \file  NetOut.cpp
-/// \brief Caliper text log service
+/// \brief Caliper network output service
+
+#include "caliper-config.h"
 
 #include "../CaliperService.h"
 
+#include "BatchExporter.h"
+
+#ifdef CALIPER_HAVE_LIBCURL
 #include <curl/curl.h>
+#endif
+
 #include <Caliper.h>
 #include <SnapshotRecord.h>
 #include <SnapshotTextFormatter.h>
@@ -47,8 +54,42 @@ const ConfigSet::Entry   configdata[] = {
       "   none:   No output,\n"
       " or a file name. The default is stdout\n"
     },
-    { "posturl" , CALI_TYPE_STRING, "https://lc.llnl.gov",
-      "URL to issue requests to"
+    { "posturl" , CALI_TYPE_STRING, "",
+      "URL to post text records to",
+      "URL to post formatted text records to (requires libcurl).\n"
+      "Note: each record is posted synchronously in the application thread."
+    },
+    { "endpoint", CALI_TYPE_STRING, "",
+      "Socket endpoint for batched binary export",
+      "Socket endpoint for batched binary export. Either\n"
+      "   tcp:host:port  TCP connection, or\n"
+      "   unix:path      Unix-domain socket.\n"
+      "Snapshots are buffered in binary form and sent from a background thread."
+    },
+    { "export", CALI_TYPE_STRING, "snapshots",
+      "Records to export: snapshots or flush",
+      "Records to export to the endpoint. Either\n"
+      "   snapshots: snapshots taken at runtime (e.g., by the event service),\n"
+      "              restricted to the trigger attributes if any are given, or\n"
+      "   flush:     records written at flush (e.g., by aggregate or trace)."
+    },
+    { "batch_size", CALI_TYPE_UINT, "65536",
+      "Target batch size in bytes",
+      "Target size of per-thread batches in bytes."
+    },
+    { "queue_size", CALI_TYPE_UINT, "16",
+      "Max. number of batches waiting to be sent",
+      "Max. number of batches waiting to be sent. When the queue is full,\n"
+      "application threads keep buffering up to four times the batch size,\n"
+      "and then drop snapshots."
+    },
+    { "compress", CALI_TYPE_BOOL, "true",
+      "Compress batches",
+      "Compress batches with zlib (if available)."
+    },
+    { "interval", CALI_TYPE_UINT, "500",
+      "Max. delay for sending partial batches in milliseconds",
+      "Max. delay for sending partial batches in milliseconds."
     },
     ConfigSet::Terminator
 };
@@ -61,7 +102,15 @@ class NetOutService
     typedef std::map<cali_id_t, Attribute> TriggerAttributeMap;
     TriggerAttributeMap         trigger_attr_map;
 
-    CURL*                        m_curl;
+#ifdef CALIPER_HAVE_LIBCURL
+    CURL*                       m_curl;
+#endif
+
+    unique_ptr<BatchExporter>   m_exporter;
+
+    enum class Export { Snapshots, Flush };
+
+    Export                      m_export;
 
     std::vector<std::string>    trigger_attr_names;
 
@@ -146,6 +195,14 @@ class NetOutService
     }
 
     void process_snapshot_cb(Caliper* c, const SnapshotRecord* trigger_info, const SnapshotRecord* snapshot) {
+        // without trigger attributes, export all snapshots
+        if (trigger_attr_names.empty()) {
+            if (m_exporter && m_export == Export::Snapshots)
+                m_exporter->push(snapshot);
+
+            return;
+        }
+
         // operate only on cali.snapshot.event.end attributes for now
         if (!trigger_info)
             return;
@@ -172,6 +229,13 @@ class NetOutService
         if (trigger_attr == Attribute::invalid || snapshot->get(trigger_attr).is_empty())
             return;
 
+        if (m_exporter && m_export == Export::Snapshots)
+            m_exporter->push(snapshot);
+
+#ifdef CALIPER_HAVE_LIBCURL
+        if (m_output_url.empty())
+            return;
+
         std::vector<Entry> entrylist;
 
         SnapshotRecord::Sizes size = snapshot->size();
@@ -197,15 +261,69 @@ class NetOutService
         else{
             fprintf(stderr, "curl_easy_perform() success\n");
         }
-        
+#endif
+    }
+
+    void flush_snapshot_cb(Caliper* c, const SnapshotRecord* snapshot) {
+        if (m_exporter && m_export == Export::Flush)
+            m_exporter->push(snapshot);
+    }
+
+    void finish_cb(Caliper* c) {
+        if (!m_exporter)
+            return;
+
+        m_exporter->stop();
+
+        BatchExporter::Statistics stats = m_exporter->statistics();
+
+        Log(1).stream() << "NetOut: Sent " << stats.snapshots_sent << " snapshots in " 
+                        << stats.batches_sent << " batches (" << stats.bytes_sent << " bytes)"
+                        << std::endl;
+
+        if (stats.snapshots_dropped > 0)
+            Log(1).stream() << "NetOut: Dropped " << stats.snapshots_dropped << " snapshots" << std::endl;
+    }
+
+    void init_exporter() {
+        std::string exportstr = config.get("export").to_string();
+
+        if (exportstr == "flush")
+            m_export = Export::Flush;
+        else {
+            if (exportstr != "snapshots")
+                Log(0).stream() << "NetOut: Unknown export mode \"" << exportstr
+                                << "\", exporting snapshots" << std::endl;
+
+            m_export = Export::Snapshots;
+        }
+
+        BatchExporter::Config cfg;
+
+        cfg.endpoint    = config.get("endpoint").to_string();
+        cfg.batch_size  = std::min<size_t>(std::max<size_t>(config.get("batch_size").to_uint(), 64), 64*1024*1024);
+        cfg.queue_size  = std::max<size_t>(config.get("queue_size").to_uint(), 1);
+        cfg.compress    = config.get("compress").to_bool();
+        cfg.interval_ms = std::max<unsigned>(config.get("interval").to_uint(), 1);
+
+        m_exporter.reset(new BatchExporter(cfg));
+        m_exporter->start();
     }
 
     void post_init_cb(Caliper* c) {
         std::string formatstr = config.get("formatstring").to_string();
-        curl_global_init(CURL_GLOBAL_ALL); 
         m_output_url = config.get("posturl").to_string();
+#ifdef CALIPER_HAVE_LIBCURL
+        curl_global_init(CURL_GLOBAL_ALL); 
         // DZPOLIA OPTIONS HERE
         m_curl = curl_easy_init();
+#else
+        if (!m_output_url.empty())
+            Log(0).stream() << "NetOut: posturl requires libcurl support" << std::endl;
+#endif
+        if (!config.get("endpoint").to_string().empty())
+            init_exporter();
+
         if (formatstr.size() == 0)
             formatstr = create_default_formatstring(trigger_attr_names);
 
@@ -230,14 +348,25 @@ class NetOutService
         s_netout->process_snapshot_cb(c, trigger_info, snapshot);
     }
 
+    static void s_flush_snapshot_cb(Caliper* c, const SnapshotRecord*, const SnapshotRecord* snapshot) {
+        s_netout->flush_snapshot_cb(c, snapshot);
+    }
+
+    static void s_finish_cb(Caliper* c) {
+        s_netout->finish_cb(c);
+    }
+
     static void s_post_init_cb(Caliper* c) { 
         s_netout->post_init_cb(c);
     }
+#ifdef CALIPER_HAVE_LIBCURL
     decltype(m_curl) getCurl(){
         return m_curl;
     }
+#endif
     NetOutService(Caliper* c)
         : config(RuntimeConfig::init("netout", configdata)),
+          m_export(Export::Snapshots),
           set_event_attr(Attribute::invalid),
           end_event_attr(Attribute::invalid)
         { 
@@ -249,8 +378,10 @@ class NetOutService
             c->events().create_attr_evt.connect(&NetOutService::s_create_attribute_cb);
             c->events().post_init_evt.connect(&NetOutService::s_post_init_cb);
             c->events().process_snapshot.connect(&NetOutService::s_process_snapshot_cb);
+            c->events().flush_snapshot.connect(&NetOutService::s_flush_snapshot_cb);
+            c->events().finish_evt.connect(&NetOutService::s_finish_cb);
 
-            Log(1).stream() << "Registered text log service" << std::endl;
+            Log(1).stream() << "Registered netout service" << std::endl;
         }
 
 public:
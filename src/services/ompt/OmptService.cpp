@@ -40,15 +40,22 @@
 #include <Log.h>
 #include <RuntimeConfig.h>
 
+#include <atomic>
 #include <map>
-#include <mutex>
+#include <string>
 
-#include <ompt.h>
+#include <omp-tools.h>
 
 
 using namespace cali;
 using namespace std;
 
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
 namespace 
 {
 
@@ -75,15 +82,20 @@ const ConfigSet::Entry configdata[] = {
 
 volatile bool                    finished    { false };
 bool                             enable_ompt { false };
-bool				 perm_off    { false };
+bool                             perm_off    { false };
+bool                             env_mapping { false };
 Attribute                        thread_attr { Attribute::invalid };
 Attribute                        state_attr  { Attribute::invalid };
-Attribute			 region_attr { Attribute::invalid };
+Attribute                        region_attr { Attribute::invalid };
+
+/// Caliper thread scope of the calling OpenMP thread, set in thread_begin.
+/// The scope is also stored in the OMPT thread data as lock-free fallback
+/// for threads whose TLS cache was not set up by us.
+thread_local Caliper::Scope*     t_thread_scope CALI_TLS_INITIAL_EXEC = nullptr;
 
-std::mutex                       thread_env_lock;
-map<ompt_thread_id_t, Caliper::Scope*> thread_env; ///< Thread ID -> Environment
+std::atomic<int>                 next_thread_id { 0 };
 
-map<ompt_state_t, string>        runtime_states;
+map<int, string>                 runtime_states;
 
 ConfigSet                        config;
 
@@ -91,19 +103,19 @@ ConfigSet                        config;
 // The OMPT interface function pointers
 
 struct OmptAPI {
-    ompt_set_callback_t    set_callback    { nullptr };
-    ompt_get_thread_id_t   get_thread_id   { nullptr };
-    ompt_get_state_t       get_state       { nullptr };
-    ompt_enumerate_state_t enumerate_state { nullptr };
+    ompt_set_callback_t     set_callback    { nullptr };
+    ompt_get_thread_data_t  get_thread_data { nullptr };
+    ompt_get_state_t        get_state       { nullptr };
+    ompt_enumerate_states_t enumerate_state { nullptr };
 
     bool
     init(ompt_function_lookup_t lookup) {
-        set_callback    = (ompt_set_callback_t)    (*lookup)("ompt_set_callback");
-        get_thread_id   = (ompt_get_thread_id_t)   (*lookup)("ompt_get_thread_id");
-        get_state       = (ompt_get_state_t)       (*lookup)("ompt_get_state");
-        enumerate_state = (ompt_enumerate_state_t) (*lookup)("ompt_enumerate_state");
+        set_callback    = (ompt_set_callback_t)     (*lookup)("ompt_set_callback");
+        get_thread_data = (ompt_get_thread_data_t)  (*lookup)("ompt_get_thread_data");
+        get_state       = (ompt_get_state_t)        (*lookup)("ompt_get_state");
+        enumerate_state = (ompt_enumerate_states_t) (*lookup)("ompt_enumerate_states");
 
-        if (!set_callback || !get_thread_id || !get_state || !enumerate_state)
+        if (!set_callback || !get_thread_data || !get_state || !enumerate_state)
             return false;
 
         return true;
@@ -115,16 +127,20 @@ struct OmptAPI {
 // --- OMPT Callbacks
 //
 
-// ompt_event_thread_begin
+// ompt_callback_thread_begin
 
 void
-cb_event_thread_begin(ompt_thread_type_t type, ompt_thread_id_t thread_id)
+cb_event_thread_begin(ompt_thread_t type, ompt_data_t* thread_data)
 {
     Caliper c;
 
-    if (config.get("environment_mapping").to_bool() == true) {
+    // Set the thread id
+
+    c.set(thread_attr, Variant(next_thread_id.fetch_add(1)));
+
+    if (env_mapping) {
         // Create a new Caliper environment for each thread. 
-        // Record thread id -> environment id mapping for later use in get_environment()
+        // Record thread -> environment mapping for later use in get_thread_scope()
 
         Caliper::Scope* ctx;
 
@@ -133,145 +149,113 @@ cb_event_thread_begin(ompt_thread_type_t type, ompt_thread_id_t thread_id)
         else
             ctx = c.create_scope(CALI_SCOPE_THREAD);
 
-        std::lock_guard<std::mutex>
-            g(thread_env_lock);
-        
-        thread_env.insert(make_pair(thread_id, ctx));
+        t_thread_scope    = ctx;
+        thread_data->ptr  = ctx;
     }
-
-    // Set the thread id in the new environment
-
-    c.set(thread_attr, Variant(static_cast<int>(thread_id)));
 }
 
-// ompt_event_thread_end
+// ompt_callback_thread_end
 
 void
-cb_event_thread_end(ompt_thread_type_t type, ompt_thread_id_t thread_id)
+cb_event_thread_end(ompt_data_t* thread_data)
 {
-    if (finished || config.get("environment_mapping").to_bool() == false)
+    if (finished || !env_mapping)
         return;
 
-    Caliper::Scope* ctx { nullptr };
+    Caliper::Scope* ctx = static_cast<Caliper::Scope*>(thread_data->ptr);
 
-    thread_env_lock.lock();
-    auto it = thread_env.find(thread_id);
-    
-    if (it != thread_env.end()) {
-        ctx = it->second;
-        thread_env.erase(it);
-    }
-    thread_env_lock.unlock();
+    thread_data->ptr = nullptr;
+    t_thread_scope   = nullptr;
 
     if (ctx)
         Caliper().release_scope(ctx);
 }
 
-// ompt_event_parallel_begin
+// ompt_callback_parallel_begin
 
 void
-cb_event_parallel_begin(ompt_thread_type_t type)
+cb_event_parallel_begin(ompt_data_t*, const ompt_frame_t*, ompt_data_t*, unsigned int, int, const void*)
 {
-	if ( enable_ompt == true && !finished ) {
-		Caliper c;
-		c.begin(region_attr, Variant(CALI_TYPE_STRING, "parallel", 8));
-	}	
-}
-
-// ompt_event_parallel_end
-
-void
-cb_event_parallel_end(ompt_thread_type_t type)
-{
-	if ( enable_ompt == true && !finished ) {
-		Caliper c;
-		c.end(region_attr);
-	}
-}
-
-// ompt_event_idle_begin
-
-void
-cb_event_idle_begin(ompt_thread_type_t type)
-{
-	if ( enable_ompt == true && !finished ) {
-		Caliper c;
-		c.begin(region_attr, Variant(CALI_TYPE_STRING, "idle", 4));
-	}	
+    if ( enable_ompt == true && !finished ) {
+        Caliper c;
+        c.begin(region_attr, Variant(CALI_TYPE_STRING, "parallel", 8));
+    }
 }
 
-// ompt_event_idle_end
+// ompt_callback_parallel_end
 
 void
-cb_event_idle_end(ompt_thread_type_t type)
+cb_event_parallel_end(ompt_data_t*, ompt_data_t*, int, const void*)
 {
-	if ( enable_ompt == true && !finished ) {
-		Caliper c;
-		c.end(region_attr);
-	}
+    if ( enable_ompt == true && !finished ) {
+        Caliper c;
+        c.end(region_attr);
+    }
 }
 
-
-// ompt_event_wait_barrier_begin
+// ompt_callback_sync_region_wait
 
 void
-cb_event_wait_barrier_begin(ompt_thread_type_t type, ompt_thread_id_t thread_id)
+cb_event_sync_region_wait(ompt_sync_region_t kind, ompt_scope_endpoint_t endpoint, ompt_data_t*, ompt_data_t*, const void*)
 {
-	if ( enable_ompt == true && !finished) {
-		Caliper c;
-		c.begin(region_attr, Variant(CALI_TYPE_STRING,"barrier",7));
-	}	
-}
+    if ( enable_ompt == false || finished )
+        return;
 
-// ompt_event_wait_barrier_end
+    Caliper c;
 
-void
-cb_event_wait_barrier_end(ompt_thread_type_t type, ompt_thread_id_t thread_id)
-{
-	if ( enable_ompt == true && !finished) {
-		Caliper c;
-		c.end(region_attr);
-	}
+    if (endpoint == ompt_scope_begin) {
+        std::string name;
+
+        switch (kind) {
+        case ompt_sync_region_taskwait:
+            name = "taskwait";
+            break;
+        case ompt_sync_region_taskgroup:
+            name = "taskgroup";
+            break;
+        case ompt_sync_region_reduction:
+            name = "reduction";
+            break;
+        default:
+            name = "barrier";
+        }
+
+        c.begin(region_attr, Variant(CALI_TYPE_STRING, name.data(), name.size()));
+    } else if (endpoint == ompt_scope_end) {
+        c.end(region_attr);
+    }
 }
 
-// ompt_event_control
+// ompt_callback_control_tool
 
-void
-cb_event_control(uint64_t command, uint64_t modifier)
+int
+cb_event_control(uint64_t command, uint64_t modifier, void*, const void*)
 {
     // Should react to enable / disable measurement commands.
     switch (command)
     {
-	    case 1 : // Start or restart monitoring
-		if ( perm_off == false && enable_ompt == false) {
-			enable_ompt = true;
-		}
-		break;
-	    case 2 : // Pause monitoring
-		if ( enable_ompt == true ) {
-			enable_ompt = false;
-		}
-		break;
-	    case 3 : // Flush buffers and continue monitoring
-		// To be iplemented if a case arises where we would want to do this.
-		break;
-	    case 4 : // Permanently turn off monitoring
-	    	perm_off = true;
-		enable_ompt = false;
-		break;
-	    default :
-		break;
+    case 1 : // Start or restart monitoring
+        if ( perm_off == false && enable_ompt == false) {
+            enable_ompt = true;
+        }
+        break;
+    case 2 : // Pause monitoring
+        if ( enable_ompt == true ) {
+            enable_ompt = false;
+        }
+        break;
+    case 3 : // Flush buffers and continue monitoring
+        // To be iplemented if a case arises where we would want to do this.
+        break;
+    case 4 : // Permanently turn off monitoring
+        perm_off = true;
+        enable_ompt = false;
+        break;
+    default :
+        return 1; // omp_control_tool_ignored
     }
-		    
-}
 
-// ompt_event_runtime_shutdown
-
-void
-cb_event_runtime_shutdown(void)
-{
-    // This seems to be called after the Caliper static object has been destroyed.
-    // Hence, we can't do much here.
+    return 0; // omp_control_tool_success
 }
 
 
@@ -288,20 +272,18 @@ finish_cb(Caliper*)
 Caliper::Scope*
 get_thread_scope(Caliper* c, bool alloc) 
 {
-    Caliper::Scope* ctx = c->default_scope(CALI_SCOPE_THREAD);
+    // Fast path: scope was recorded for this thread in thread_begin
+    if (t_thread_scope)
+        return t_thread_scope;
 
-    if (!api.get_thread_id)
-        return ctx;
+    if (api.get_thread_data) {
+        ompt_data_t* thread_data = (*api.get_thread_data)();
 
-    ompt_thread_id_t thread_id = (*api.get_thread_id)();
-
-    thread_env_lock.lock();
-    auto it = thread_env.find(thread_id);
-    if (it != thread_env.end())
-        ctx = it->second;
-    thread_env_lock.unlock();
+        if (thread_data && thread_data->ptr)
+            return (t_thread_scope = static_cast<Caliper::Scope*>(thread_data->ptr));
+    }
 
-    return ctx;
+    return c->default_scope(CALI_SCOPE_THREAD);
 }
 
 void
@@ -330,30 +312,27 @@ register_ompt_callbacks(bool capture_events)
         return false;
 
     struct callback_info_t { 
-        ompt_event_t    event;
-        ompt_callback_t cbptr;
+        ompt_callbacks_t event;
+        ompt_callback_t  cbptr;
     } basic_callbacks[] = {
-        { ompt_event_thread_begin,       (ompt_callback_t) &cb_event_thread_begin       },
-        { ompt_event_thread_end,         (ompt_callback_t) &cb_event_thread_end         },
-        { ompt_event_control,            (ompt_callback_t) &cb_event_control            }
-//        { ompt_event_runtime_shutdown, (ompt_callback_t) &cb_event_runtime_shutdown }
+        { ompt_callback_thread_begin,     (ompt_callback_t) &cb_event_thread_begin     },
+        { ompt_callback_thread_end,       (ompt_callback_t) &cb_event_thread_end       },
+        { ompt_callback_control_tool,     (ompt_callback_t) &cb_event_control          }
     }, event_callbacks[] = {
-	{ ompt_event_idle_begin,         (ompt_callback_t) &cb_event_idle_begin         },
-	{ ompt_event_idle_end,           (ompt_callback_t) &cb_event_idle_end           },
-	{ ompt_event_wait_barrier_begin, (ompt_callback_t) &cb_event_wait_barrier_begin },
-	{ ompt_event_wait_barrier_end,   (ompt_callback_t) &cb_event_wait_barrier_end   },
-	{ ompt_event_parallel_begin,     (ompt_callback_t) &cb_event_parallel_begin     },
-	{ ompt_event_parallel_end,       (ompt_callback_t) &cb_event_parallel_end       }
+        { ompt_callback_sync_region_wait, (ompt_callback_t) &cb_event_sync_region_wait },
+        { ompt_callback_parallel_begin,   (ompt_callback_t) &cb_event_parallel_begin   },
+        { ompt_callback_parallel_end,     (ompt_callback_t) &cb_event_parallel_end     }
     };
 
     for ( auto cb : basic_callbacks ) 
-        if ((*api.set_callback)(cb.event, cb.cbptr) == 0)
+        if ((*api.set_callback)(cb.event, cb.cbptr) <= ompt_set_never)
             return false;
-    
+
     if (capture_events)
         for ( auto cb : event_callbacks ) 
-            if ((*api.set_callback)(cb.event, cb.cbptr) == 0)
-                return false;
+            if ((*api.set_callback)(cb.event, cb.cbptr) <= ompt_set_never)
+                Log(1).stream() << "OMPT: event callback " << cb.event 
+                                << " not supported by the OpenMP runtime" << endl;
 
     return true;
 }
@@ -364,10 +343,10 @@ register_ompt_states()
     if (!api.enumerate_state)
         return false;
 
-    ompt_state_t state = ompt_state_first;
+    int          state = ompt_state_undefined;
     const char*  state_name;
 
-    while ((*api.enumerate_state)(state, (int*) &state, &state_name))
+    while ((*api.enumerate_state)(state, &state, &state_name))
         runtime_states[state] = state_name;
 
     return true;
@@ -383,6 +362,7 @@ omptservice_initialize(Caliper* c)
     config      = RuntimeConfig::init("ompt", configdata);
 
     enable_ompt = true;
+    env_mapping = config.get("environment_mapping").to_bool();
 
     thread_attr = 
         c->create_attribute("ompt.thread.id", CALI_TYPE_INT, CALI_ATTR_SCOPE_THREAD);
@@ -391,10 +371,10 @@ omptservice_initialize(Caliper* c)
         c->create_attribute("ompt.state",     CALI_TYPE_STRING, 
                             CALI_ATTR_SCOPE_THREAD | CALI_ATTR_SKIP_EVENTS);
     region_attr =
-	c->create_attribute("ompt.region",    CALI_TYPE_STRING,
-			    CALI_ATTR_SCOPE_THREAD);
+        c->create_attribute("ompt.region",    CALI_TYPE_STRING,
+                            CALI_ATTR_SCOPE_THREAD);
 
-    if (config.get("environment_mapping").to_bool() == true)
+    if (env_mapping)
         c->set_scope_callback(CALI_SCOPE_THREAD, &get_thread_scope);
 
     c->events().finish_evt.connect(&finish_cb);
@@ -402,28 +382,22 @@ omptservice_initialize(Caliper* c)
     Log(1).stream() << "Registered OMPT service" << endl;
 }
 
-}  // namespace [ anonymous ]
-
-
-extern "C" {
-
-// The OpenMP tools interface intialization function, called by the OpenMP 
-// runtime. We must register our callbacks w/ the OpenMP runtime here.
+// The OMPT initialization function, called by the OpenMP runtime 
+// through the pointer returned from ompt_start_tool(). 
+// We must register our callbacks w/ the OpenMP runtime here.
 
-void
-ompt_initialize_real(ompt_function_lookup_t lookup,
-                     const char*            runtime_version,
-                     unsigned int           /* ompt_version */)
+int
+ompt_initialize_cb(ompt_function_lookup_t lookup,
+                   int                    /* initial_device_num */,
+                   ompt_data_t*           /* tool_data */)
 {
-    Log(1).stream() << "Initializing OMPT interface with " << runtime_version << endl;
-
     Caliper c;
     
     // register callbacks
 
     if (!::api.init(lookup) || !::register_ompt_callbacks(::config.get("capture_events").to_bool())) {
         Log(0).stream() << "Callback registration error: OMPT interface disabled" << endl;
-        return;
+        return 0;
     }
 
     if (::config.get("capture_state").to_bool() == true) {
@@ -431,43 +405,42 @@ ompt_initialize_real(ompt_function_lookup_t lookup,
         c.events().snapshot.connect(&snapshot_cb);
     }
 
-    // set default thread ID
-    if (::api.get_thread_id)
-        c.set(thread_attr, Variant(static_cast<int>((*api.get_thread_id)())));
-        
     Log(1).stream() << "OMPT interface enabled." << endl;
+
+    return 1;
 }
-    
-// Old version of initialization interface. 
 
-int 
-ompt_initialize(ompt_function_lookup_t lookup,
-                const char*            runtime_version,
-                unsigned int           ompt_version)
+void
+ompt_finalize_cb(ompt_data_t* /* tool_data */)
 {
-    // Make sure Caliper is initialized & OMPT service is enabled in Caliper config
+    // This may be called after the Caliper exit handler has run.
+    // Hence, we can't do much here.
+}
 
-    Caliper c;
+}  // namespace [ anonymous ]
 
-    if (!::enable_ompt)
-        return 0;
 
-    ompt_initialize_real(lookup, runtime_version, ompt_version);
-    
-    return 1;
-}
+extern "C" {
 
-// New version of the initialization interface; returns NULL or real init fn
-// if we want to enable OMPT
+// The OpenMP 5 tool entry point. The OpenMP runtime calls this function
+// when it initializes; we return our initialize/finalize functions if
+// the OMPT service is enabled, or NULL otherwise.
 
-// The tech report calls it ompt_initialize_fn_t, but the Intel header does not ...
-ompt_initialize_t
-ompt_tool(void)
+ompt_start_tool_result_t*
+ompt_start_tool(unsigned int /* omp_version */, const char* runtime_version)
 {
+    static ompt_start_tool_result_t result = 
+        { ::ompt_initialize_cb, ::ompt_finalize_cb, { 0 } };
+
     // Make sure Caliper is initialized & OMPT service is enabled    
     Caliper::instance();
+
+    if (!::enable_ompt)
+        return NULL;
+
+    Log(1).stream() << "Initializing OMPT interface with " << runtime_version << endl;
     
-    return ::enable_ompt ? ompt_initialize_real : NULL;
+    return &result;
 }
     
 } // extern "C"
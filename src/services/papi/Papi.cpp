@@ -46,6 +46,7 @@
 
 #include <pthread.h>
 
+#include <algorithm>
 #include <vector>
 
 using namespace cali;
@@ -53,6 +54,12 @@ using namespace std;
 
 #include <papi.h>
 
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
 namespace 
 {
 
@@ -64,15 +71,21 @@ struct PapiGlobalInfo {
     std::vector<int>       counter_events;
     bool                   record_delta;
     bool                   record_accum;
+    bool                   multiplex;
+    bool                   boundaries_only;
 } global_info;
 
 struct ThreadInfo {
-    long long* accum_values;
+    int        eventset;
+    long long  prev_values[MAX_COUNTERS]; ///< counter values at the previous snapshot
     bool       active;
 };
 
 pthread_key_t threadinfo_key;
 size_t        num_failed = 0;
+
+/// The calling thread's ThreadInfo. Also kept in threadinfo_key for cleanup
+thread_local ThreadInfo* t_thread_info CALI_TLS_INITIAL_EXEC = nullptr;
     
 static const ConfigSet::Entry s_configdata[] = {
     { "counters", CALI_TYPE_STRING, "",
@@ -89,42 +102,94 @@ static const ConfigSet::Entry s_configdata[] = {
       "Record accumulated counter values.\n"
       "Values will be saved in papi.accum.EVENT_NAME attributes"
     },
+    { "multiplex", CALI_TYPE_BOOL, "false",
+      "Multiplex counters.",
+      "Multiplex counters. Allows more counters than the hardware supports\n"
+      "at once. Counter values are estimates scaled by PAPI."
+    },
+    { "boundaries_only", CALI_TYPE_BOOL, "false",
+      "Only read counters at region boundaries.",
+      "Only read counters in snapshots taken at region boundaries,\n"
+      "not in snapshots taken in signal handlers (e.g., by the sampler)."
+    },
     ConfigSet::Terminator
 };
 
     
 void destroy_thread_info(void* data)
 {
+    ThreadInfo* info = static_cast<ThreadInfo*>(data);
+
+    if (info && info->eventset != PAPI_NULL) {
+        long long values[MAX_COUNTERS];
+
+        PAPI_stop(info->eventset, values);
+        PAPI_cleanup_eventset(info->eventset);
+        PAPI_destroy_eventset(&info->eventset);
+    }
+
     PAPI_unregister_thread();
 
-    if (!data)
-        return;
+    if (info == t_thread_info)
+        t_thread_info = nullptr;
 
-    ThreadInfo* info = static_cast<ThreadInfo*>(data);
-    
-    delete[] info->accum_values;
-    delete   info;
+    delete info;
+}
+
+/// Create and start an event set with the configured counters on the
+/// calling thread
+bool start_eventset(ThreadInfo* info, size_t num_counters)
+{
+    if (PAPI_create_eventset(&info->eventset) != PAPI_OK) {
+        Log(0).stream() << "papi: PAPI_create_eventset() failed" << endl;
+        return false;
+    }
+
+    if (global_info.multiplex) {
+        // multiplexed event sets must be bound to a component first
+        if (PAPI_assign_eventset_component(info->eventset, 0) != PAPI_OK ||
+            PAPI_set_multiplex(info->eventset)                != PAPI_OK) {
+            Log(0).stream() << "papi: Unable to enable multiplexing" << endl;
+            return false;
+        }
+    }
+
+    int ret = PAPI_add_events(info->eventset, global_info.counter_events.data(), num_counters);
+
+    if (ret != PAPI_OK) {
+        Log(0).stream() << "papi: Unable to add counters to event set: " << PAPI_strerror(ret)
+                        << (global_info.multiplex ? "" : " (try CALI_PAPI_MULTIPLEX=true)") << endl;
+        return false;
+    }
+
+    if (PAPI_start(info->eventset) != PAPI_OK) {
+        Log(0).stream() << "papi: PAPI_start() failed" << endl;
+        return false;
+    }
+
+    return true;
 }
     
 ThreadInfo* get_thread_info(bool alloc, size_t num_counters)
 {
-    ThreadInfo* info = static_cast<ThreadInfo*>(pthread_getspecific(threadinfo_key));
+    ThreadInfo* info = t_thread_info;
 
     if (!info && alloc && num_counters > 0) {
         info = new ThreadInfo;
 
-        info->accum_values = new long long[num_counters];
-        info->active       = false;
+        info->eventset = PAPI_NULL;
+        info->active   = false;
+
+        std::fill_n(info->prev_values, MAX_COUNTERS, 0);
 
         pthread_setspecific(threadinfo_key, info);
+        t_thread_info = info;
 
         // Register thread and start counters on new thread
         
         PAPI_register_thread();
 
-        if (PAPI_start_counters(global_info.counter_events.data(), num_counters) == PAPI_OK &&
-            PAPI_read_counters(info->accum_values, num_counters)                 == PAPI_OK)
-            info->active = true;
+        info->active = start_eventset(info, num_counters);
     }
     
     return info;
@@ -135,6 +200,8 @@ void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord* s
     
     if (num_counters < 1)
         return;
+    if (global_info.boundaries_only && c->is_signal())
+        return;
 
     ThreadInfo* thread_info = get_thread_info(!c->is_signal(), num_counters);
 
@@ -143,9 +210,13 @@ void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord* s
         return;
     }
 
+    // PAPI_read() returns the counter values since PAPI_start(); 
+    // compute the difference to the previous snapshot ourselves to 
+    // avoid a PAPI_reset() call
+
     long long counter_values[MAX_COUNTERS];
 
-    if (PAPI_read_counters(counter_values, num_counters) != PAPI_OK) {
+    if (PAPI_read(thread_info->eventset, counter_values) != PAPI_OK) {
         ++num_failed;
         return;
     }
@@ -154,19 +225,19 @@ void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord* s
 
     if (global_info.record_delta) {
         for (int i = 0; i < num_counters; ++i)
-            data[i] = Variant(static_cast<uint64_t>(counter_values[i]));
+            data[i] = Variant(static_cast<uint64_t>(counter_values[i] - thread_info->prev_values[i]));
 
         snapshot->append(num_counters, global_info.counter_delta_attrs.data(), data);
     }
 
     if (global_info.record_accum) {
-        for (int i = 0; i < num_counters; ++i) {
-            thread_info->accum_values[i] += counter_values[i];
-            data[i] = Variant(static_cast<uint64_t>(thread_info->accum_values[i]));
-        }
+        for (int i = 0; i < num_counters; ++i)
+            data[i] = Variant(static_cast<uint64_t>(counter_values[i]));
 
         snapshot->append(num_counters, global_info.counter_accum_attrs.data(), data);
     }
+
+    std::copy_n(counter_values, num_counters, thread_info->prev_values);
 }
 
 void papi_init(Caliper* c) {
@@ -243,6 +314,14 @@ void papi_register(Caliper* c) {
 
     ConfigSet config = RuntimeConfig::init("papi", s_configdata);
 
+    global_info.multiplex       = config.get("multiplex").to_bool();
+    global_info.boundaries_only = config.get("boundaries_only").to_bool();
+
+    if (global_info.multiplex && PAPI_multiplex_init() != PAPI_OK) {
+        Log(0).stream() << "papi: PAPI_multiplex_init() failed, disabling multiplexing" << endl;
+        global_info.multiplex = false;
+    }
+
     setup_events(c, config.get("counters").to_string());
 
     if (global_info.counter_events.size() < 1) {
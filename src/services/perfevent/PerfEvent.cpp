@@ -0,0 +1,431 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+///@file  PerfEvent.cpp
+///@brief Linux perf_event counter provider for caliper records
+
+#include "../CaliperService.h"
+
+#include <Caliper.h>
+#include <SnapshotRecord.h>
+
+#include <RuntimeConfig.h>
+#include <Log.h>
+
+#include <util/split.hpp>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace cali;
+using namespace std;
+
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
+namespace 
+{
+
+#define MAX_COUNTERS 32
+
+struct EventInfo {
+    const char* name;
+    uint32_t    type;
+    uint64_t    config;
+};
+
+const EventInfo s_event_table[] = {
+    { "cycles",                  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES              },
+    { "cpu-cycles",              PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES              },
+    { "instructions",            PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS            },
+    { "cache-references",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES        },
+    { "cache-misses",            PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES            },
+    { "branches",                PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS     },
+    { "branch-instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS     },
+    { "branch-misses",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES           },
+    { "bus-cycles",              PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES              },
+    { "stalled-cycles-frontend", PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND },
+    { "stalled-cycles-backend",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND  },
+    { "ref-cycles",              PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES          },
+    { "cpu-clock",               PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_CLOCK               },
+    { "task-clock",              PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK              },
+    { "page-faults",             PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS             },
+    { "context-switches",        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES        },
+    { "cpu-migrations",          PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS          },
+    { "minor-faults",            PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MIN         },
+    { "major-faults",            PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS_MAJ         },
+    { "alignment-faults",        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS        },
+    { "emulation-faults",        PERF_TYPE_SOFTWARE, PERF_COUNT_SW_EMULATION_FAULTS        }
+};
+
+struct PerfGlobalInfo {
+    std::vector<cali_id_t> counter_delta_attrs;
+    std::vector<cali_id_t> counter_accum_attrs;
+    std::vector<EventInfo> counter_events;
+    std::vector<string>    counter_names;
+    bool                   record_delta;
+    bool                   record_accum;
+    bool                   boundaries_only;
+} global_info;
+
+/// Per-thread counter group. The group leader's file descriptor reads
+/// all counters at once.
+struct ThreadInfo {
+    int      fds[MAX_COUNTERS];
+    uint64_t prev_values[MAX_COUNTERS]; ///< scaled counter values at the previous snapshot
+    bool     active;
+};
+
+thread_local ThreadInfo* t_thread_info CALI_TLS_INITIAL_EXEC = nullptr;
+
+std::atomic<size_t> num_failed         { 0 }; ///< failed counter reads
+std::atomic<size_t> num_failed_threads { 0 }; ///< threads without counters
+std::atomic<bool>   open_error_logged  { false };
+
+static const ConfigSet::Entry s_configdata[] = {
+    { "counters", CALI_TYPE_STRING, "",
+      "List of perf events to record",
+      "List of perf events to record, separated by ','.\n"
+      "Generic event names as in the perf tool (e.g., cycles, instructions,\n"
+      "cache-misses, task-clock, page-faults) or raw events (rNNNN, hexadecimal)."
+    },
+    { "record_difference", CALI_TYPE_BOOL, "true",
+      "Record the counter value increases between subsequent snapshots.",
+      "Record the counter value increases between subsequent snapshots.\n"
+      "Stores counter increase since last snapshot in perf.EVENT_NAME."
+    },
+    { "accumulate", CALI_TYPE_BOOL, "false",
+      "Record accumulated counter values.",
+      "Record accumulated counter values.\n"
+      "Values will be saved in perf.accum.EVENT_NAME attributes"
+    },
+    { "boundaries_only", CALI_TYPE_BOOL, "false",
+      "Only read counters at region boundaries.",
+      "Only read counters in snapshots taken at region boundaries,\n"
+      "not in snapshots taken in signal handlers (e.g., by the sampler)."
+    },
+    ConfigSet::Terminator
+};
+
+bool find_event(const string& name, EventInfo& info)
+{
+    for (const EventInfo& e : s_event_table)
+        if (name == e.name) {
+            info = e;
+            return true;
+        }
+
+    // raw event
+    if (name.size() > 1 && name[0] == 'r') {
+        char* end = nullptr;
+        uint64_t config = strtoull(name.c_str() + 1, &end, 16);
+
+        if (end && *end == '\0') {
+            info.name   = nullptr;
+            info.type   = PERF_TYPE_RAW;
+            info.config = config;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int open_event(const EventInfo& event, int group_fd)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size           = sizeof(attr);
+    attr.type           = event.type;
+    attr.config         = event.config;
+    attr.disabled       = (group_fd == -1 ? 1 : 0);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = 
+        PERF_FORMAT_GROUP              | 
+        PERF_FORMAT_TOTAL_TIME_ENABLED | 
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // calling thread, any CPU
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+void close_events(ThreadInfo* info)
+{
+    for (size_t i = 0; i < global_info.counter_events.size(); ++i)
+        if (info->fds[i] >= 0)
+            close(info->fds[i]);
+}
+
+/// Open and start the counter group on the calling thread
+void create_thread_info()
+{
+    if (t_thread_info)
+        return;
+
+    size_t num_counters = global_info.counter_events.size();
+
+    ThreadInfo* info = new ThreadInfo;
+
+    std::fill_n(info->fds,         MAX_COUNTERS, -1);
+    std::fill_n(info->prev_values, MAX_COUNTERS, 0);
+
+    info->active = true;
+
+    for (size_t i = 0; i < num_counters && info->active; ++i) {
+        info->fds[i] = open_event(global_info.counter_events[i], i == 0 ? -1 : info->fds[0]);
+
+        if (info->fds[i] < 0) {
+            int err = errno;
+
+            // only report the first failure; the count is reported at finish
+            if (!open_error_logged.exchange(true))
+                Log(0).stream() << "perfevent: Unable to open counter \"" 
+                                << global_info.counter_names[i] << "\" on thread: "
+                                << strerror(err) << ". Disabling counters on this thread." << endl;
+
+            ++num_failed_threads;
+            info->active = false;
+        }
+    }
+
+    if (info->active && 
+        ioctl(info->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == -1) {
+        Log(0).stream() << "perfevent: Unable to enable counters: " << strerror(errno) << endl;
+        info->active = false;
+    }
+
+    t_thread_info = info;
+}
+
+void release_thread_info()
+{
+    ThreadInfo* info = t_thread_info;
+
+    if (!info)
+        return;
+
+    t_thread_info = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+
+    close_events(info);
+    delete info;
+}
+
+void snapshot_cb(Caliper* c, int scope, const SnapshotRecord*, SnapshotRecord* snapshot)
+{
+    size_t num_counters = global_info.counter_events.size();
+
+    if (num_counters < 1)
+        return;
+    if (global_info.boundaries_only && c->is_signal())
+        return;
+
+    ThreadInfo* info = t_thread_info;
+
+    if (!info || !info->active) {
+        num_failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Group read format: nr, time_enabled, time_running, values[nr]
+    uint64_t buf[3 + MAX_COUNTERS];
+
+    ssize_t size = read(info->fds[0], buf, sizeof(uint64_t) * (3 + num_counters));
+
+    if (size < static_cast<ssize_t>(sizeof(uint64_t) * (3 + num_counters))) {
+        num_failed.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Scale counts if the kernel had to multiplex the counter group
+    uint64_t enabled = buf[1];
+    uint64_t running = buf[2];
+    double   scale   = (running > 0 && running < enabled ? 
+                        static_cast<double>(enabled) / static_cast<double>(running) : 1.0);
+
+    uint64_t counter_values[MAX_COUNTERS];
+
+    for (size_t i = 0; i < num_counters; ++i)
+        counter_values[i] = static_cast<uint64_t>(buf[3+i] * scale);
+
+    Variant data[MAX_COUNTERS];
+
+    if (global_info.record_delta) {
+        for (size_t i = 0; i < num_counters; ++i)
+            data[i] = Variant(counter_values[i] - std::min(counter_values[i], info->prev_values[i]));
+
+        snapshot->append(num_counters, global_info.counter_delta_attrs.data(), data);
+    }
+
+    if (global_info.record_accum) {
+        for (size_t i = 0; i < num_counters; ++i)
+            data[i] = Variant(counter_values[i]);
+
+        snapshot->append(num_counters, global_info.counter_accum_attrs.data(), data);
+    }
+
+    std::copy_n(counter_values, num_counters, info->prev_values);
+}
+
+void create_scope_cb(Caliper* c, cali_context_scope_t scope)
+{
+    if (scope == CALI_SCOPE_THREAD)
+        create_thread_info();
+}
+
+void release_scope_cb(Caliper* c, cali_context_scope_t scope)
+{
+    if (scope == CALI_SCOPE_THREAD)
+        release_thread_info();
+}
+
+void finish_cb(Caliper* c)
+{
+    if (num_failed_threads.load() > 0)
+        Log(1).stream() << "perfevent: Unable to open counters on " << num_failed_threads.load()
+                        << " threads." << std::endl;
+    if (num_failed.load() > 0)
+        Log(1).stream() << "perfevent: Failed to read counters " << num_failed.load()
+                        << " times." << std::endl;
+}
+
+void setup_events(Caliper* c, const string& eventstring)
+{
+    vector<string> events;
+
+    util::split(eventstring, ',', back_inserter(events));
+
+    Attribute aggr_class_attr = c->get_attribute("class.aggregatable");
+    Variant   v_true(true);
+
+    for (string& event : events) {
+        EventInfo info;
+
+        if (!find_event(event, info)) {
+            Log(0).stream() << "perfevent: Unknown event \"" << event << '"' << endl;
+            continue;
+        }
+
+        // check if the event is available
+        int fd = open_event(info, -1);
+
+        if (fd < 0) {
+            Log(0).stream() << "perfevent: Unable to open event \"" << event << "\": " 
+                            << strerror(errno) << endl;
+            continue;
+        }
+
+        close(fd);
+
+        // check if we have this event already
+        if (std::find_if(global_info.counter_events.begin(), global_info.counter_events.end(), 
+                         [&info](const EventInfo& e){
+                             return e.type == info.type && e.config == info.config;
+                         }) != global_info.counter_events.end())
+            continue;
+
+        if (global_info.counter_events.size() < MAX_COUNTERS) {
+            Attribute delta_attr =
+                c->create_attribute(string("perf.")+event, CALI_TYPE_UINT,
+                                    CALI_ATTR_ASVALUE      | 
+                                    CALI_ATTR_SCOPE_THREAD | 
+                                    CALI_ATTR_SKIP_EVENTS,
+                                    1, &aggr_class_attr, &v_true);
+            Attribute accum_attr = 
+                c->create_attribute(string("perf.accum.")+event, CALI_TYPE_UINT,
+                                    CALI_ATTR_ASVALUE      | 
+                                    CALI_ATTR_SCOPE_THREAD | 
+                                    CALI_ATTR_SKIP_EVENTS);
+
+            global_info.counter_events.push_back(info);
+            global_info.counter_names.push_back(event);
+            global_info.counter_delta_attrs.push_back(delta_attr.id());
+            global_info.counter_accum_attrs.push_back(accum_attr.id());
+        } else
+            Log(0).stream() << "Maximum number of perf event counters exceeded; dropping \"" 
+                            << event << '"' << endl;
+    }
+}
+
+// Initialization handler
+void perfevent_register(Caliper* c)
+{
+    ConfigSet config = RuntimeConfig::init("perfevent", s_configdata);
+
+    setup_events(c, config.get("counters").to_string());
+
+    if (global_info.counter_events.size() < 1) {
+        Log(1).stream() << "No perf event counters registered, dropping perfevent service" << endl;
+        return;
+    }
+
+    global_info.record_delta    = config.get("record_difference").to_bool();
+    global_info.record_accum    = config.get("accumulate").to_bool();
+    global_info.boundaries_only = config.get("boundaries_only").to_bool();
+
+    c->events().create_scope_evt.connect(&create_scope_cb);
+    c->events().release_scope_evt.connect(&release_scope_cb);
+    c->events().finish_evt.connect(&finish_cb);
+    c->events().snapshot.connect(&snapshot_cb);
+
+    // start counters on the initial thread
+    create_thread_info();
+
+    Log(1).stream() << "Registered perfevent service" << endl;
+}
+
+} // namespace
+
+
+namespace cali 
+{
+    CaliperService perfevent_service = { "perfevent", ::perfevent_register };
+} // namespace cali
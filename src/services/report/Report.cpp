@@ -39,6 +39,7 @@
 #include <Caliper.h>
 #include <SnapshotRecord.h>
 
+#include <Aggregator.h>
 #include <Format.h>
 #include <RecordSelector.h>
 #include <Table.h>
@@ -48,6 +49,9 @@
 #include <RuntimeConfig.h>
 #include <SnapshotTextFormatter.h>
 
+#include <util/split.hpp>
+
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -66,6 +70,51 @@ namespace
         Table          m_table_writer;
         RecordSelector m_selector;
 
+        bool           m_aggregate;
+        Aggregator     m_aggregator;
+
+        /// Aggregation key: the print and sort columns, except for
+        /// aggregation results and the attributes being aggregated
+        static std::string make_aggregation_key(const std::string& aggr_config,
+                                                const std::string& attributes,
+                                                const std::string& sort_by) {
+            std::vector<std::string> names;
+
+            util::split(sort_by,    ':', std::back_inserter(names));
+            util::split(attributes, ':', std::back_inserter(names));
+
+            std::string key;
+            std::vector<std::string> used;
+
+            // skip the arguments of aggregation operations, e.g. "x" in "sum(x)"
+            {
+                std::vector<std::string> ops;
+                util::split(aggr_config, ':', std::back_inserter(ops));
+
+                for (const std::string& op : ops) {
+                    std::string::size_type b = op.find('(');
+                    std::string::size_type e = op.rfind(')');
+
+                    if (b != std::string::npos && e != std::string::npos && e > b+1)
+                        used.push_back(op.substr(b+1, e-b-1));
+                }
+            }
+
+            for (const std::string& name : names) {
+                if (name.empty() || name.compare(0, 10, "aggregate.") == 0)
+                    continue;
+                if (std::find(used.begin(), used.end(), name) != used.end())
+                    continue;
+
+                used.push_back(name);
+
+                key.append(key.empty() ? "" : ":");
+                key.append(name);
+            }
+
+            return key;
+        }
+
         std::vector<Entry> make_entrylist(Caliper* c, const SnapshotRecord* snapshot) {
             std::vector<Entry> list;
 
@@ -86,16 +135,31 @@ namespace
         void process_snapshot(Caliper* c, const SnapshotRecord* snapshot) {
             SnapshotProcessFn fn(m_table_writer);
 
+            if (m_aggregate)
+                fn = m_aggregator;
+
             m_selector(*c, make_entrylist(c, snapshot), fn);
         }
 
+        void write(Caliper* c, std::ostream& os) {
+            if (m_aggregate) {
+                // Only the aggregated rows go into the table
+                Table table(m_config.get("attributes").to_string(),
+                            m_config.get("sort_by").to_string());
+
+                m_aggregator.flush(*c, table);
+                table.flush(*c, os);
+            } else
+                m_table_writer.flush(*c, os);
+        }
+
         void flush(Caliper* c, const SnapshotRecord* flush_info) {
             std::string filename = m_config.get("filename").to_string();
 
             if (filename == "stdout")
-                m_table_writer.flush(*c, std::cout);
+                write(c, std::cout);
             else if (filename == "stderr")
-                m_table_writer.flush(*c, std::cerr);
+                write(c, std::cerr);
             else {
                 SnapshotTextFormatter formatter(filename);
                 std::ostringstream    fnamestr;
@@ -109,7 +173,7 @@ namespace
                     return;
                 }
 
-                m_table_writer.flush(*c, fs);
+                write(c, fs);
             }
         }
 
@@ -117,7 +181,12 @@ namespace
             : m_config( RuntimeConfig::init("report", s_configdata) ),
               m_table_writer(m_config.get("attributes").to_string(),
                              m_config.get("sort_by").to_string()),
-              m_selector(m_config.get("filter").to_string())  
+              m_selector(m_config.get("filter").to_string()),
+              m_aggregate(!m_config.get("aggregate").to_string().empty()),
+              m_aggregator(m_config.get("aggregate").to_string(),
+                           make_aggregation_key(m_config.get("aggregate").to_string(),
+                                                m_config.get("attributes").to_string(),
+                                                m_config.get("sort_by").to_string()))
             { }
 
         //
@@ -176,6 +245,13 @@ namespace
           "List of attributes to sort by.",
           "List of attributes to sort by. Default: empty (undefined order)"
         },
+        { "aggregate", CALI_TYPE_STRING, "",
+          "Aggregate records on the fly with these operations.",
+          "Aggregate records on the fly as they are flushed, using the given\n"
+          "operations, e.g. count:sum(time.duration). Records are aggregated\n"
+          "by the attributes in the \"attributes\" and \"sort_by\" lists, and\n"
+          "only the aggregated rows are kept. Default: empty (keep all records)."
+        },
         ConfigSet::Terminator
     };
 
@@ -41,8 +41,12 @@
 #include <Log.h>
 #include <RuntimeConfig.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <vector>
 #include <signal.h>
 #include <time.h>
 #include <sys/time.h>
@@ -57,25 +61,104 @@
 using namespace cali;
 using namespace std;
 
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
 namespace 
 {
-    Attribute timer_attr   { Attribute::invalid };
+    /// Max. number of snapshot entries kept for a buffered sample
+    const size_t SampleEntries = 40;
+
+    /// A sample taken in the signal handler, waiting to be processed
+    struct Sample {
+        uint64_t       pc;
+        bool           has_context; ///< false if the blackboard could not be read in the handler
+        SnapshotRecord rec;
+        SnapshotRecord::FixedSnapshotRecord<SampleEntries> data;
+    };
+
+    /// Per-thread sampler state.
+    ///
+    /// The signal handler on the owning thread appends samples at \a head.
+    /// The owning thread processes them from \a tail at region boundaries,
+    /// and any thread may process them in a flush. The \a processing flag
+    /// makes sure only one thread consumes samples at a time.
+    struct ThreadSampler {
+        timer_t             timer;
+        uint64_t            rng;        ///< xorshift state for jitter
+
+        Sample*             samples;
+        size_t              capacity;
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<bool>   processing;
+
+        ThreadSampler(size_t n)
+            : rng(0), samples(n > 0 ? new Sample[n] : nullptr), capacity(n),
+              head(0), tail(0), processing(false)
+            { }
+
+        ~ThreadSampler() {
+            delete[] samples;
+        }
+    };
+
+    thread_local ThreadSampler* t_sampler CALI_TLS_INITIAL_EXEC = nullptr;
+
+    /// All live thread samplers, so a flush can process every thread's samples
+    std::mutex                  sampler_list_lock;
+    std::vector<ThreadSampler*> sampler_list;
+
     Attribute sampler_attr { Attribute::invalid };
+    Attribute late_attr    { Attribute::invalid };
 
     cali_id_t sampler_attr_id    = CALI_INV_ID;
     
     ConfigSet config;
 
-    int       nsec_interval       = 0;
+    clockid_t sampler_clock       = CLOCK_MONOTONIC;
+    uint64_t  nsec_interval       = 0;
+    double    jitter              = 0.0;
+    size_t    buffer_size         = 0;
+    bool      deferred            = false;
     int       sample_contexts     = 0;
 
-    int       n_samples           = 0;
-    int       n_processed_samples = 0;
+    std::atomic<unsigned long> n_samples           { 0 };
+    std::atomic<unsigned long> n_processed_samples { 0 };
+    std::atomic<unsigned long> n_late_context      { 0 };
 
     static const ConfigSet::Entry s_configdata[] = {
-        { "frequency", CALI_TYPE_INT, "10",
+        { "frequency", CALI_TYPE_DOUBLE, "10",
           "Sampling frequency (in Hz)",
-          "Sampling frequency (in Hz)"
+          "Sampling frequency (in Hz). Can be fractional, e.g. 0.5 for one sample every two seconds."
+        },
+        { "clock", CALI_TYPE_STRING, "monotonic",
+          "Sampling clock: monotonic or thread_cputime",
+          "Sampling clock. One of\n"
+          "  monotonic:      wall-clock time (CLOCK_MONOTONIC)\n"
+          "  thread_cputime: CPU time of each thread (CLOCK_THREAD_CPUTIME_ID)"
+        },
+        { "jitter", CALI_TYPE_DOUBLE, "0",
+          "Random variation of the sampling interval (0 to 1)",
+          "Random variation of the sampling interval, as fraction of the interval (0 to 1).\n"
+          "Avoids aliasing with periodic program behavior."
+        },
+        { "buffer_size", CALI_TYPE_UINT, "32",
+          "Number of samples buffered per thread",
+          "Number of samples buffered per thread before processing.\n"
+          "Buffered samples are processed before region boundary snapshots\n"
+          "and in flushes.\n"
+          "Samples that do not fit into the buffer, or all samples with 0,\n"
+          "are processed immediately in the signal handler."
+        },
+        { "deferred", CALI_TYPE_BOOL, "false",
+          "Only record program counter and context in the signal handler",
+          "Only record program counter and blackboard contents in the signal handler.\n"
+          "Snapshot callbacks of other services (e.g., timestamp) are not invoked for samples.\n"
+          "Requires a non-zero buffer_size."
         },
         { "add_shared_context", CALI_TYPE_BOOL, "true",
           "Capture process-wide context information",
@@ -84,15 +167,57 @@ namespace
         ConfigSet::Terminator
     };
 
+    uint64_t next_interval(ThreadSampler* ts)
+    {
+        if (jitter <= 0.0)
+            return nsec_interval;
+
+        // xorshift64
+        uint64_t x = ts->rng;
+
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+
+        ts->rng = x;
+
+        double r = static_cast<double>(x >> 11) / static_cast<double>(1ull << 53); // [0,1)
+
+        return static_cast<uint64_t>(nsec_interval * (1.0 + jitter * (2.0 * r - 1.0))) + 1;
+    }
+
+    /// Arm the thread's timer. Without jitter, the timer is periodic. With
+    /// jitter, it is a one-shot timer re-armed with a new random interval
+    /// in each signal. Signal safe.
+    int arm_timer(ThreadSampler* ts)
+    {
+        uint64_t nsec = next_interval(ts);
+
+        struct itimerspec spec;
+
+        spec.it_value.tv_sec     = nsec / 1000000000;
+        spec.it_value.tv_nsec    = nsec % 1000000000;
+
+        if (jitter > 0.0) {
+            spec.it_interval.tv_sec  = 0;
+            spec.it_interval.tv_nsec = 0;
+        } else
+            spec.it_interval = spec.it_value;
+
+        return timer_settime(ts->timer, 0, &spec, NULL);
+    }
+
     void on_prof(int sig, siginfo_t *info, void *context)
     {
-        ++n_samples;
+        n_samples.fetch_add(1, std::memory_order_relaxed);
+
+        ThreadSampler* ts = t_sampler;
+
+        if (ts && jitter > 0.0)
+            arm_timer(ts);
         
         Caliper c = Caliper::sigsafe_instance();
 
-        if (!c)
-            return;
-        
         ucontext_t *ucontext = (ucontext_t *) context;
 
         uint64_t  pc = static_cast<uint64_t>(ucontext->uc_mcontext.gregs[REG_RIP]);
@@ -100,9 +225,106 @@ namespace
 
         SnapshotRecord trigger_info(1, &sampler_attr_id, &v_pc);
 
-        c.push_snapshot(sample_contexts, &trigger_info);
+        size_t head = ts ? ts->head.load(std::memory_order_relaxed) : 0;
+
+        if (!ts || head - ts->tail.load(std::memory_order_acquire) >= ts->capacity) {
+            // No buffer, or buffer full: process sample right here, unless
+            // we're in deferred mode or can't access Caliper 
+            if (c && !deferred) {
+                c.push_snapshot(sample_contexts, &trigger_info);
+                n_processed_samples.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            return;
+        }
+
+        // Take the snapshot now, but leave processing to the thread. If the
+        // thread is inside Caliper (i.e., c is invalid), record only the PC
+        // and add the context when the sample is processed.
+
+        Sample& sample = ts->samples[head % ts->capacity];
+
+        sample.pc          = pc;
+        sample.has_context = static_cast<bool>(c);
+        sample.rec         = SnapshotRecord(sample.data);
+
+        if (!c || deferred) {
+            sample.rec.append(sampler_attr_id, v_pc);
+
+            if (c)
+                c.pull_context(sample_contexts, &sample.rec);
+        } else
+            c.pull_snapshot(sample_contexts, &trigger_info, &sample.rec);
+
+        ts->head.store(head + 1, std::memory_order_release);
+    }
+
+    /// Process buffered samples of the given thread sampler. Returns
+    /// immediately if another thread is processing its samples already.
+    void process_samples(Caliper* c, ThreadSampler* ts)
+    {
+        bool expected = false;
+
+        if (!ts->processing.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return;
+
+        size_t tail = ts->tail.load(std::memory_order_relaxed);
 
-        ++n_processed_samples;
+        while (tail != ts->head.load(std::memory_order_acquire)) {
+            Sample& sample = ts->samples[tail % ts->capacity];
+
+            Variant v_pc(CALI_TYPE_ADDR, &sample.pc, sizeof(uint64_t));
+            SnapshotRecord trigger_info(1, &sampler_attr_id, &v_pc);
+
+            if (!sample.has_context) {
+                // The sample interrupted a Caliper operation on its thread,
+                // so it has no context and no snapshot callback data (e.g.,
+                // timestamps). If we're on that thread, we're at the end of
+                // the operation now: use the current context.
+                if (ts == t_sampler)
+                    c->pull_context(sample_contexts, &sample.rec);
+
+                sample.rec.append(late_attr.id(), Variant(true));
+                n_late_context.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            c->process_snapshot(&trigger_info, &sample.rec);
+            n_processed_samples.fetch_add(1, std::memory_order_relaxed);
+
+            ts->tail.store(++tail, std::memory_order_release);
+        }
+
+        ts->processing.store(false, std::memory_order_release);
+    }
+
+    /// Process the calling thread's buffered samples, unless we're in a signal
+    void process_thread_samples(Caliper* c)
+    {
+        ThreadSampler* ts = t_sampler;
+
+        if (ts && !c->is_signal() &&
+            ts->tail.load(std::memory_order_relaxed) != ts->head.load(std::memory_order_acquire))
+            process_samples(c, ts);
+    }
+
+    void process_samples_cb(Caliper* c, const Attribute&, const Variant&) {
+        process_thread_samples(c);
+    }
+
+    void snapshot_cb(Caliper* c, int, const SnapshotRecord*, SnapshotRecord*) {
+        // Process buffered samples before a (region boundary) snapshot of this 
+        // thread, so they appear in order. Samples are processed in the 
+        // pre-event callbacks as well, in case there are no snapshots at 
+        // region boundaries. 
+        process_thread_samples(c);
+    }
+
+    void pre_flush_cb(Caliper* c, const SnapshotRecord*) {
+        std::lock_guard<std::mutex>
+            g(sampler_list_lock);
+
+        for (ThreadSampler* ts : sampler_list)
+            process_samples(c, ts);
     }
 
     void setup_signal()
@@ -130,60 +352,75 @@ namespace
 
     void setup_settimer(Caliper* c)
     {
+        if (t_sampler)
+            return;
+
+        pid_t tid = syscall(SYS_gettid);
+
         struct sigevent sev;
    
         std::memset(&sev, 0, sizeof(sev));
         
         sev.sigev_notify   = SIGEV_THREAD_ID;     // Linux-specific!
-        sev._sigev_un._tid = syscall(SYS_gettid);
+        sev._sigev_un._tid = tid;
         sev.sigev_signo    = SIGPROF;
 
-        timer_t timer;
-   
-        if (timer_create(CLOCK_MONOTONIC, &sev, &timer) == -1) {
+        ThreadSampler* ts = new ThreadSampler(buffer_size);
+
+        if (timer_create(sampler_clock, &sev, &ts->timer) == -1) {
             Log(0).stream() << "sampler: timer_create() failed" << std::endl;
+            delete ts;
             return;
         }
-        
-        struct itimerspec spec;
 
-        spec.it_interval.tv_sec  = 0;
-        spec.it_interval.tv_nsec = nsec_interval;
-        spec.it_value.tv_sec     = 0;
-        spec.it_value.tv_nsec    = nsec_interval;
+        ts->rng = (static_cast<uint64_t>(tid) << 32) ^ reinterpret_cast<uintptr_t>(ts) ^ 0x9E3779B97F4A7C15ull;
+
+        t_sampler = ts;
+
+        {
+            std::lock_guard<std::mutex>
+                g(sampler_list_lock);
 
-        if (timer_settime(timer, 0, &spec, NULL) == -1) {
+            sampler_list.push_back(ts);
+        }
+        
+        if (arm_timer(ts) == -1) {
             Log(0).stream() << "sampler: timer_settime() failed" << std::endl;
             return;
         }
 
-        // FIXME: We make the assumption that timer_t is a 8-byte value
-        Variant v_timer(CALI_TYPE_ADDR, &timer, sizeof(void*));
-        
-        c->set(timer_attr, v_timer);
-
-        Log(2).stream() << "Registered timer " << v_timer << endl;
+        Log(2).stream() << "Registered sampler timer for thread " << tid << endl;
     }
 
-    void clear_timer(Caliper* c) {
-        Entry e = c->get(timer_attr);
+    /// Delete the calling thread's sampler. Process its remaining samples 
+    /// if \a process is true.
+    void clear_timer(Caliper* c, bool process) {
+        ThreadSampler* ts = t_sampler;
 
-        if (e.is_empty()) {
-            Log(2).stream() << "Timer attribute not found " << endl;
+        if (!ts) {
+            Log(2).stream() << "Sampler timer not found " << endl;
             return;
         }
         
-        Variant v_timer = e.value();
+        Log(2).stream() << "Deleting sampler timer" << endl;
 
-        if (v_timer.empty())
-            return;
+        timer_delete(ts->timer);
+
+        {
+            std::lock_guard<std::mutex>
+                g(sampler_list_lock);
 
-        timer_t timer;
-        memcpy(&timer, v_timer.data(), sizeof(void*));
+            sampler_list.erase(std::remove(sampler_list.begin(), sampler_list.end(), ts),
+                               sampler_list.end());
+        }
+
+        if (process && ts->capacity > 0)
+            process_samples(c, ts);
 
-        Log(2).stream() << "Deleting timer " << v_timer << endl;
+        t_sampler = nullptr;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
 
-        timer_delete(timer);
+        delete ts;
     }
     
     void create_scope_cb(Caliper* c, cali_context_scope_t scope) {
@@ -193,16 +430,22 @@ namespace
 
     void release_scope_cb(Caliper* c, cali_context_scope_t scope) {
         if (scope == CALI_SCOPE_THREAD)
-            clear_timer(c);
+            clear_timer(c, true);
     }
 
     void finish_cb(Caliper* c) {
-        clear_timer(c);
+        // The final flush has processed all buffered samples already.
+        // Samples taken after that can't be written anymore.
+        clear_timer(c, false);
         clear_signal();
 
-        Log(1).stream() << "Sampler: processed " << n_processed_samples << " samples ("
-                        << n_samples << " total, "
-                        << n_samples - n_processed_samples << " dropped)." << endl;
+        unsigned long total     = n_samples.load();
+        unsigned long processed = n_processed_samples.load();
+
+        Log(1).stream() << "Sampler: processed " << processed << " samples ("
+                        << total << " total, "
+                        << total - processed << " dropped, "
+                        << n_late_context.load() << " with deferred context)." << endl;
     }
     
     void sampler_register(Caliper* c)
@@ -213,12 +456,6 @@ namespace
         Attribute symbol_class_attr = c->get_attribute("class.symboladdress");
         Variant v_true(true);
 
-        timer_attr =
-            c->create_attribute("cali.sampler.timer", CALI_TYPE_ADDR,
-                                CALI_ATTR_SCOPE_THREAD |
-                                CALI_ATTR_SKIP_EVENTS  |
-                                CALI_ATTR_ASVALUE      |
-                                CALI_ATTR_HIDDEN);
         sampler_attr =
             c->create_attribute("cali.sampler.pc", CALI_TYPE_ADDR,
                                 CALI_ATTR_SCOPE_THREAD |
@@ -228,11 +465,34 @@ namespace
 
         sampler_attr_id = sampler_attr.id();
 
-        int frequency = config.get("frequency").to_int();
+        late_attr =
+            c->create_attribute("cali.sampler.late_context", CALI_TYPE_BOOL,
+                                CALI_ATTR_SCOPE_THREAD |
+                                CALI_ATTR_SKIP_EVENTS  |
+                                CALI_ATTR_ASVALUE);
+
+        double frequency = config.get("frequency").to_double();
         
         // some sanity checking
-        frequency     = std::min(std::max(frequency, 1), 10000);
-        nsec_interval = 1000000000 / frequency;
+        frequency     = std::min(std::max(frequency, 0.001), 100000.0);
+        nsec_interval = static_cast<uint64_t>(1e9 / frequency);
+
+        jitter        = std::min(std::max(config.get("jitter").to_double(), 0.0), 1.0);
+        buffer_size   = config.get("buffer_size").to_uint();
+        deferred      = config.get("deferred").to_bool();
+
+        if (deferred && buffer_size == 0) {
+            Log(0).stream() << "sampler: deferred mode requires a sample buffer, using buffer_size=32" << endl;
+            buffer_size = 32;
+        }
+
+        std::string clockname = config.get("clock").to_string();
+
+        if (clockname == "thread_cputime")
+            sampler_clock = CLOCK_THREAD_CPUTIME_ID;
+        else if (clockname != "monotonic")
+            Log(0).stream() << "sampler: unknown clock \"" << clockname
+                            << "\", using monotonic" << endl;
 
         sample_contexts = CALI_SCOPE_THREAD;
 
@@ -243,11 +503,21 @@ namespace
         c->events().release_scope_evt.connect(release_scope_cb);
         c->events().finish_evt.connect(finish_cb);
 
+        if (buffer_size > 0) {
+            c->events().snapshot.connect(snapshot_cb);
+            c->events().pre_begin_evt.connect(process_samples_cb);
+            c->events().pre_set_evt.connect(process_samples_cb);
+            c->events().pre_end_evt.connect(process_samples_cb);
+            c->events().pre_flush_evt.connect(pre_flush_cb);
+        }
+
         setup_signal();
         setup_settimer(c);
         
         Log(1).stream() << "Registered sampler service. Using "
-                        << frequency << "Hz sampling frequency." << endl;
+                        << frequency << "Hz sampling frequency on "
+                        << (sampler_clock == CLOCK_THREAD_CPUTIME_ID ? "thread CPU time" : "wall-clock time")
+                        << "." << endl;
     }
 
 } // namespace
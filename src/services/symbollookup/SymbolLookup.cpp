@@ -36,7 +36,6 @@
 #include "../CaliperService.h"
 
 #include "Caliper.h"
-#include "MemoryPool.h"
 #include "SnapshotRecord.h"
 
 #include "Log.h"
@@ -55,6 +54,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 
 using namespace cali;
 
@@ -75,12 +75,25 @@ class SymbolLookup
         Attribute func_attr;
     };
 
+    typedef std::map<Attribute, SymbolAttributes> SymbolAttributeMap;
+
+    /// Lookup result for an address
+    struct SymbolInfo {
+        bool        have_line;
+        bool        have_func;
+        std::string file;
+        uint64_t    line;
+        std::string func;
+    };
+
     ConfigSet m_config;
 
     bool m_lookup_functions;
     bool m_lookup_sourceloc;
 
-    std::map<Attribute, SymbolAttributes> m_sym_attr_map;
+    // The symbol attribute map is immutable once published; check_attributes()
+    // replaces it when new address attributes show up
+    std::shared_ptr<const SymbolAttributeMap> m_sym_attr_map;
     std::mutex m_sym_attr_mutex;
 
     std::vector<std::string> m_addr_attr_names;
@@ -88,14 +101,19 @@ class SymbolLookup
     AddressLookup* m_lookup;
     std::mutex     m_lookup_mutex;
 
+    // Resolved addresses. Protected by m_lookup_mutex, but entries are never
+    // modified or removed, so references to them remain valid without the lock.
+    std::unordered_map<uint64_t, SymbolInfo> m_sym_cache;
+
     unsigned m_num_lookups;
+    unsigned m_num_cached;
     unsigned m_num_failed;
 
     //
     // --- methods
     //
 
-    void make_symbol_attributes(Caliper* c, const Attribute& attr) {
+    SymbolAttributes make_symbol_attributes(Caliper* c, const Attribute& attr) {
         struct SymbolAttributes sym_attribs;
 
         sym_attribs.file_attr = 
@@ -108,10 +126,7 @@ class SymbolLookup
             c->create_attribute("source.function#" + attr.name(),
                                 CALI_TYPE_STRING, CALI_ATTR_DEFAULT);
 
-        std::lock_guard<std::mutex>
-            g(m_sym_attr_mutex);
-
-        m_sym_attr_map.insert(std::make_pair(attr, sym_attribs));
+        return sym_attribs;
     }
 
     void check_attributes(Caliper* c) {
@@ -135,92 +150,103 @@ class SymbolLookup
             Log(1).stream() << "Symbollookup: No address attributes found." 
                             << std::endl;
 
-        for (const Attribute& a : vec)
-            make_symbol_attributes(c, a);
-    }
-    
-    void add_symbol_attributes(const Entry& e, 
-                               const SymbolAttributes& sym_attr,
-                               MemoryPool& mempool,
-                               std::vector<Attribute>& attr, 
-                               std::vector<Variant>&   data) {
-        std::vector<Statement*> statements;
-        SymtabAPI::Function* function = 0;
-
-        bool     ret_line = false;
-        bool     ret_func = false;
-
-        uint64_t address  = e.value().to_uint();
+        std::shared_ptr<const SymbolAttributeMap> old_map;
 
         {
             std::lock_guard<std::mutex>
-                g(m_lookup_mutex);
+                g(m_sym_attr_mutex);
 
-            if (!m_lookup)
-                return;
+            old_map = m_sym_attr_map;
+        }
 
-            Symtab* symtab;
-            Offset  offset;
+        std::shared_ptr<SymbolAttributeMap> new_map = 
+            std::make_shared<SymbolAttributeMap>();
 
-            bool ret = m_lookup->getOffset(address, symtab, offset);
+        if (old_map)
+            *new_map = *old_map;
 
-            if (ret && m_lookup_sourceloc)
-                ret_line = symtab->getSourceLines(statements, offset);
-            if (ret && m_lookup_functions)
-                ret_func = symtab->getContainingFunction(offset, function);
+        size_t old_size = new_map->size();
 
-            ++m_num_lookups;
+        for (const Attribute& a : vec)
+            if (new_map->find(a) == new_map->end())
+                new_map->insert(std::make_pair(a, make_symbol_attributes(c, a)));
+
+        if (new_map->size() != old_size) {
+            std::lock_guard<std::mutex>
+                g(m_sym_attr_mutex);
+
+            m_sym_attr_map = new_map;
         }
+    }
 
-        if (m_lookup_sourceloc) {
-            std::string filename = "UNKNOWN";
-            uint64_t    lineno   = 0;
+    /// Get symbol information for \a address, from the cache or through
+    /// Dyninst. m_lookup_mutex must be locked. 
+    const SymbolInfo& lookup(uint64_t address) {
+        auto it = m_sym_cache.find(address);
 
-            if (ret_line && statements.size() > 0) {
-                filename = statements.front()->getFile();
-                lineno   = statements.front()->getLine();
-            }
+        if (it != m_sym_cache.end()) {
+            ++m_num_cached;
+            return it->second;
+        }
 
-            char* tmp_s = static_cast<char*>(mempool.allocate(filename.size()+1));
-            std::copy(filename.begin(), filename.end(), tmp_s);
-            tmp_s[filename.size()] = '\0';
+        SymbolInfo info { false, false, "UNKNOWN", 0, "UNKNOWN" };
 
-            attr.push_back(sym_attr.file_attr);
-            attr.push_back(sym_attr.line_attr);
+        Symtab* symtab;
+        Offset  offset;
+
+        bool ret = m_lookup->getOffset(address, symtab, offset);
+
+        if (ret && m_lookup_sourceloc) {
+            std::vector<Statement*> statements;
 
-            data.push_back(Variant(CALI_TYPE_STRING, tmp_s, filename.size()));
-            data.push_back(Variant(CALI_TYPE_UINT,   &lineno, sizeof(uint64_t)));
+            if (symtab->getSourceLines(statements, offset) && statements.size() > 0) {
+                info.have_line = true;
+                info.file      = statements.front()->getFile();
+                info.line      = statements.front()->getLine();
+            }
         }
 
-        if (m_lookup_functions) {
-            std::string funcname = "UNKNOWN";
+        if (ret && m_lookup_functions) {
+            SymtabAPI::Function* function = 0;
 
-            if (ret_func && function) {
-                auto it = function->pretty_names_begin();
+            if (symtab->getContainingFunction(offset, function) && function) {
+                auto fit = function->pretty_names_begin();
 
-                if (it != function->pretty_names_end())
-                    funcname = *it;
+                info.have_func = true;
+
+                if (fit != function->pretty_names_end())
+                    info.func = *fit;
             }
+        }
 
-            char* tmp_f = static_cast<char*>(mempool.allocate(funcname.size()+1));
-            std::copy(funcname.begin(), funcname.end(), tmp_f);
-            tmp_f[funcname.size()] = '\0';
+        ++m_num_lookups;
 
-            attr.push_back(sym_attr.func_attr);
-            data.push_back(Variant(CALI_TYPE_STRING, tmp_f, funcname.size()));
-        }
+        if ((m_lookup_functions && !info.have_func) || (m_lookup_sourceloc && !info.have_line))
+            ++m_num_failed;
 
-        if ((m_lookup_functions && !ret_func) || (m_lookup_sourceloc && !ret_line))
-            ++m_num_failed; // not locked, doesn't matter too much if it's slightly off
+        return m_sym_cache.emplace(address, std::move(info)).first->second;
     }
+    
+    void add_symbol_attributes(const SymbolInfo& info,
+                               const SymbolAttributes& sym_attr,
+                               std::vector<Attribute>& attr, 
+                               std::vector<Variant>&   data) {
+        if (m_lookup_sourceloc) {
+            attr.push_back(sym_attr.file_attr);
+            attr.push_back(sym_attr.line_attr);
 
-    void process_snapshot(Caliper* c, SnapshotRecord* snapshot) {
-        if (m_sym_attr_map.empty())
-            return;
+            data.push_back(Variant(CALI_TYPE_STRING, info.file.c_str(), info.file.size()));
+            data.push_back(Variant(CALI_TYPE_UINT,   &info.line, sizeof(uint64_t)));
+        }
 
-        // make local symbol attribute map copy for threadsafe access
+        if (m_lookup_functions) {
+            attr.push_back(sym_attr.func_attr);
+            data.push_back(Variant(CALI_TYPE_STRING, info.func.c_str(), info.func.size()));
+        }
+    }
 
-        std::map<Attribute, SymbolAttributes> sym_map;
+    void process_snapshot(Caliper* c, SnapshotRecord* snapshot) {
+        std::shared_ptr<const SymbolAttributeMap> sym_map;
 
         {
             std::lock_guard<std::mutex>
@@ -229,31 +255,54 @@ class SymbolLookup
             sym_map = m_sym_attr_map;
         }
 
-        std::vector<Attribute> attr;
-        std::vector<Variant>   data;
+        if (!sym_map || sym_map->empty())
+            return;
 
-        // Bit of a hack: Use mempool to allocate temporary memory for strings.
-        // Should be fixed with string database in Caliper runtime.
-        MemoryPool mempool(64 * 1024);
+        // unpack nodes and collect the addresses to look up
 
-        // unpack nodes, check for address attributes, and perform symbol lookup
-        for (auto it : sym_map) {
+        std::vector< std::pair<const SymbolAttributes*, uint64_t> > addresses;
+
+        for (const auto &it : *sym_map) {
             Entry e = snapshot->get(it.first);
 
             if (e.node()) {
                 for (const Node* node = e.node(); node; node = node->parent()) 
                     if (node->attribute() == it.first.id())
-                        add_symbol_attributes(Entry(node), it.second, mempool, attr, data);
+                        addresses.push_back(std::make_pair(&it.second, node->data().to_uint()));
             } else if (e.is_immediate()) {
-                add_symbol_attributes(e, it.second, mempool, attr, data);
+                addresses.push_back(std::make_pair(&it.second, e.value().to_uint()));
             }
         }
 
+        if (addresses.empty())
+            return;
+
+        // resolve all addresses of this snapshot in one go
+
+        std::vector<const SymbolInfo*> infos(addresses.size(), nullptr);
+
+        {
+            std::lock_guard<std::mutex>
+                g(m_lookup_mutex);
+
+            if (!m_lookup)
+                return;
+
+            for (size_t i = 0; i < addresses.size(); ++i)
+                infos[i] = &lookup(addresses[i].second);
+        }
+
+        std::vector<Attribute> attr;
+        std::vector<Variant>   data;
+
+        for (size_t i = 0; i < addresses.size(); ++i)
+            add_symbol_attributes(*infos[i], *addresses[i].first, attr, data);
+
         // reverse vectors to restore correct hierarchical order
         std::reverse(attr.begin(), attr.end());
         std::reverse(data.begin(), data.end());
 
-        // Add entries to snapshot. Strings are copied here, temporary mempool will be free'd
+        // Add entries to snapshot. Strings are copied here.
         if (attr.size() > 0)
             c->make_entrylist(attr.size(), attr.data(), data.data(), *snapshot);
     }
@@ -261,7 +310,8 @@ class SymbolLookup
     // some final log output; print warning if we didn't find an address attribute
     void finish_log(Caliper* c) {
         Log(1).stream() << "Symbollookup: Performed " 
-                        << m_num_lookups << " address lookups, "
+                        << m_num_lookups << " address lookups ("
+                        << m_num_cached  << " cached), "
                         << m_num_failed  << " failed." 
                         << std::endl;
     }
@@ -302,7 +352,10 @@ class SymbolLookup
 
     SymbolLookup(Caliper* c)
         : m_config(RuntimeConfig::init("symbollookup", s_configdata)),
-          m_lookup(0)
+          m_lookup(0),
+          m_num_lookups(0),
+          m_num_cached(0),
+          m_num_failed(0)
         {
             util::split(m_config.get("attributes").to_string(), ':',
                         std::back_inserter(m_addr_attr_names));
@@ -7,22 +7,33 @@
 #include <SnapshotRecord.h>
 
 #include <Log.h>
+#include <Node.h>
 #include <RuntimeConfig.h>
 #include <SnapshotTextFormatter.h>
 
+#include <util/spinlock.hpp>
 #include <util/split.hpp>
 
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <fstream>
 #include <functional>
 #include <iterator>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <sstream>
 #include <vector>
 
+#if defined(__GNUC__)
+#define CALI_TLS_INITIAL_EXEC __attribute__((tls_model("initial-exec")))
+#else
+#define CALI_TLS_INITIAL_EXEC
+#endif
+
 using namespace cali;
 using namespace std;
 
@@ -46,35 +57,214 @@ const ConfigSet::Entry   configdata[] = {
       "   none:   No output,\n"
       " or a file name. The default is stdout\n"
     },
+    { "buffer_size", CALI_TYPE_UINT, "65536",
+      "Size of the per-thread output buffer in bytes",
+      "Size of the per-thread output buffer in bytes. Each thread formats log lines\n"
+      "into its own buffer, which is written out when it is full, when the thread\n"
+      "exits, and at program end. 0 writes every line immediately."
+    },
     ConfigSet::Terminator
 };
 
+/// Per-thread line buffer
+struct ThreadBuffer {
+    util::spinlock lock;
+    std::string    data;
+    bool           in_use;
+
+    ThreadBuffer*  next;
+};
+
+thread_local ThreadBuffer* t_buffer CALI_TLS_INITIAL_EXEC = nullptr;
+
+/// Append decimal representation of \a val to \a str
+inline void append_uint(std::string& str, uint64_t val)
+{
+    char  buf[24];
+    char* p = buf + sizeof(buf);
+
+    do {
+        *--p = '0' + static_cast<char>(val % 10);
+        val /= 10;
+    } while (val);
+
+    str.append(p, buf + sizeof(buf) - p);
+}
+
+/// Append string representation of \a v to \a str. Produces the same
+/// output as Variant::to_string(), but formats the common types in place.
+void append_variant(std::string& str, const Variant& v)
+{
+    switch (v.type()) {
+    case CALI_TYPE_UINT:
+        append_uint(str, v.to_uint());
+        break;
+    case CALI_TYPE_INT:
+    {
+        int i = v.to_int();
+
+        if (i < 0) {
+            str.push_back('-');
+            append_uint(str, -static_cast<int64_t>(i));
+        } else
+            append_uint(str, static_cast<uint64_t>(i));
+    }
+        break;
+    case CALI_TYPE_STRING:
+    {
+        const char* s   = static_cast<const char*>(v.data());
+        size_t      len = v.size();
+
+        if (len && s[len-1] == 0)
+            --len;
+
+        str.append(s, len);
+    }
+        break;
+    case CALI_TYPE_DOUBLE:
+    {
+        char buf[64];
+        int  len = snprintf(buf, sizeof(buf), "%f", v.to_double());
+
+        if (len > 0)
+            str.append(buf, std::min<int>(len, sizeof(buf)-1));
+    }
+        break;
+    case CALI_TYPE_BOOL:
+        str.append(v.to_bool() ? "true" : "false");
+        break;
+    default:
+        str.append(v.to_string());
+    }
+}
+
+/// A format string compiled into a list of (prefix, attribute, width)
+/// instructions. Attribute ids are resolved as the attributes are
+/// created, so printing a line does not need any lookups or locks.
+class FormatProgram
+{
+    struct Op {
+        std::string            prefix;
+        std::string            attr_name;
+        std::atomic<cali_id_t> attr_id;
+        int                    width;
+    };
+
+    std::vector< std::unique_ptr<Op> > m_ops;
+
+    static const int MaxPathDepth = 64;
+
+    /// Append the value(s) of attribute \a id in the given snapshot.
+    /// Hierarchical values are written root-first and separated by '/'.
+    static void
+    append_value(std::string& str, cali_id_t id, const SnapshotRecord::Data& data, const SnapshotRecord::Sizes& size) {
+        for (size_t i = 0; i < size.n_immediate; ++i)
+            if (data.immediate_attr[i] == id) {
+                append_variant(str, data.immediate_data[i]);
+                return;
+            }
+
+        for (size_t i = 0; i < size.n_nodes; ++i) {
+            const Node* path[MaxPathDepth];
+            int         depth = 0;
+
+            for (const Node* node = data.node_entries[i]; node && depth < MaxPathDepth; node = node->parent())
+                if (node->attribute() == id)
+                    path[depth++] = node;
+
+            if (depth > 0) {
+                while (depth-- > 0) {
+                    append_variant(str, path[depth]->data());
+
+                    if (depth > 0)
+                        str.push_back('/');
+                }
+
+                return;
+            }
+        }
+    }
+
+public:
+
+    void compile(const std::string& formatstr, Caliper* c) {
+        m_ops.clear();
+
+        for (const SnapshotTextFormatter::FieldSpec& f : SnapshotTextFormatter(formatstr).fields()) {
+            std::unique_ptr<Op> op(new Op);
+
+            op->prefix    = f.prefix;
+            op->attr_name = f.attr_name;
+            op->attr_id.store(c->get_attribute(f.attr_name).id());
+            op->width     = f.width;
+
+            m_ops.push_back(std::move(op));
+        }
+    }
+
+    void update_attribute(const Attribute& attr) {
+        for (auto& op : m_ops)
+            if (op->attr_name == attr.name())
+                op->attr_id.store(attr.id());
+    }
+
+    /// Append formatted line for the given snapshot to \a str
+    void print(std::string& str, const SnapshotRecord* snapshot) const {
+        static const char whitespace[80+1] =
+            "                                        "
+            "                                        ";
+
+        SnapshotRecord::Sizes size = snapshot->size();
+        SnapshotRecord::Data  data = snapshot->data();
+
+        for (const auto& op : m_ops) {
+            str.append(op->prefix);
+
+            cali_id_t id  = op->attr_id.load(std::memory_order_relaxed);
+            size_t    pos = str.size();
+
+            if (id != CALI_INV_ID)
+                append_value(str, id, data, size);
+
+            int len = static_cast<int>(str.size() - pos);
+
+            if (len < op->width)
+                str.append(whitespace, std::min<int>(op->width - len, 80));
+        }
+
+        str.push_back('\n');
+    }
+};
+
 class TextLogService
 {
     ConfigSet                   config;
 
-    std::mutex                  trigger_attr_mutex;
-    typedef std::map<cali_id_t, Attribute> TriggerAttributeMap;
-    TriggerAttributeMap         trigger_attr_map;
-
     std::vector<std::string>    trigger_attr_names;
+    std::unique_ptr< std::atomic<cali_id_t>[] >
+                                trigger_attr_ids;
 
-    SnapshotTextFormatter       formatter;
+    FormatProgram               program;
 
     enum class Stream { None, File, StdErr, StdOut };
 
     Stream                      m_stream;
     ofstream                    m_ofstream;
 
-    Attribute                   set_event_attr;   
+    Attribute                   set_event_attr;
     Attribute                   end_event_attr;
 
     std::mutex                  stream_mutex;
-    
-    static unique_ptr<TextLogService> 
+
+    size_t                      buffer_size;
+
+    ThreadBuffer*               buffer_list;
+    util::spinlock              buffer_list_lock;
+
+    static unique_ptr<TextLogService>
                                 s_textlog;
 
-    std::string 
+    std::string
     create_default_formatstring(const std::vector<std::string>& attr_names) {
         if (attr_names.size() < 1)
             return "%time.inclusive.duration%";
@@ -99,7 +289,7 @@ class TextLogService
     void init_stream() {
         string filename = config.get("filename").to_string();
 
-        const map<string, Stream> strmap { 
+        const map<string, Stream> strmap {
             { "none",   Stream::None   },
             { "stdout", Stream::StdOut },
             { "stderr", Stream::StdErr } };
@@ -128,17 +318,102 @@ class TextLogService
         }
     }
 
+    void write(const std::string& str) {
+        if (str.empty() || m_stream == Stream::None)
+            return;
+
+        std::lock_guard<std::mutex>
+            g(stream_mutex);
+
+        get_stream().write(str.data(), str.size()).flush();
+    }
+
+    /// Get the calling thread's line buffer. Reuses buffers of exited
+    /// threads, or creates a new one.
+    ThreadBuffer* acquire_thread_buffer() {
+        std::lock_guard<util::spinlock>
+            g(buffer_list_lock);
+
+        for (ThreadBuffer* tb = buffer_list; tb; tb = tb->next) {
+            std::lock_guard<util::spinlock>
+                g(tb->lock);
+
+            if (!tb->in_use) {
+                tb->in_use = true;
+                return tb;
+            }
+        }
+
+        ThreadBuffer* tb = new ThreadBuffer;
+
+        tb->data.reserve(buffer_size + 256);
+        tb->in_use = true;
+        tb->next   = buffer_list;
+        buffer_list = tb;
+
+        return tb;
+    }
+
+    void flush_thread_buffer(ThreadBuffer* tb, bool release) {
+        std::string str;
+
+        {
+            std::lock_guard<util::spinlock>
+                g(tb->lock);
+
+            str.swap(tb->data);
+            tb->data.reserve(buffer_size + 256);
+
+            if (release)
+                tb->in_use = false;
+        }
+
+        write(str);
+    }
+
+    void flush_all_buffers() {
+        std::lock_guard<util::spinlock>
+            g(buffer_list_lock);
+
+        for (ThreadBuffer* tb = buffer_list; tb; tb = tb->next)
+            flush_thread_buffer(tb, false);
+    }
+
     void create_attribute(Caliper* c, const Attribute& attr) {
+        program.update_attribute(attr);
+
         if (attr.skip_events())
             return;
 
-        std::vector<std::string>::iterator it = 
+        std::vector<std::string>::iterator it =
             find(trigger_attr_names.begin(), trigger_attr_names.end(), attr.name());
 
-        if (it != trigger_attr_names.end()) {
-            std::lock_guard<std::mutex> lock(trigger_attr_mutex);
-            trigger_attr_map.insert(std::make_pair(attr.id(), attr));
-        }
+        if (it != trigger_attr_names.end())
+            trigger_attr_ids[it - trigger_attr_names.begin()].store(attr.id());
+    }
+
+    bool is_trigger_attribute(cali_id_t id) const {
+        for (size_t i = 0; i < trigger_attr_names.size(); ++i)
+            if (trigger_attr_ids[i].load(std::memory_order_relaxed) == id)
+                return true;
+
+        return false;
+    }
+
+    static bool contains(const SnapshotRecord* snapshot, cali_id_t id) {
+        SnapshotRecord::Sizes size = snapshot->size();
+        SnapshotRecord::Data  data = snapshot->data();
+
+        for (size_t i = 0; i < size.n_immediate; ++i)
+            if (data.immediate_attr[i] == id)
+                return true;
+
+        for (size_t i = 0; i < size.n_nodes; ++i)
+            for (const Node* node = data.node_entries[i]; node; node = node->parent())
+                if (node->attribute() == id)
+                    return true;
+
+        return false;
     }
 
     void process_snapshot(Caliper* c, const SnapshotRecord* trigger_info, const SnapshotRecord* snapshot) {
@@ -153,39 +428,28 @@ class TextLogService
         if (event.is_empty())
             return;
 
-        Attribute trigger_attr { Attribute::invalid };
+        cali_id_t trigger_id = event.value().to_id();
 
-        {
-            std::lock_guard<std::mutex> lock(trigger_attr_mutex);
-
-            TriggerAttributeMap::const_iterator it = 
-                trigger_attr_map.find(event.value().to_id());
-
-            if (it != trigger_attr_map.end())
-                trigger_attr = it->second;
-        }
-
-        if (trigger_attr == Attribute::invalid || snapshot->get(trigger_attr).is_empty())
+        if (trigger_id == CALI_INV_ID || !is_trigger_attribute(trigger_id) || !contains(snapshot, trigger_id))
             return;
 
-        std::vector<Entry> entrylist;
+        ThreadBuffer* tb = t_buffer;
 
-        SnapshotRecord::Sizes size = snapshot->size();
-        SnapshotRecord::Data  data = snapshot->data();
+        if (!tb)
+            tb = t_buffer = acquire_thread_buffer();
 
-        for (size_t n = 0; n < size.n_nodes; ++n)
-            entrylist.push_back(Entry(data.node_entries[n]));
-        for (size_t n = 0; n < size.n_immediate; ++n)
-            entrylist.push_back(Entry(data.immediate_attr[n], data.immediate_data[n]));
+        bool full = false;
 
-        ostringstream os;
-        
-        formatter.print(os, c, entrylist) << std::endl;
+        {
+            std::lock_guard<util::spinlock>
+                g(tb->lock);
 
-        std::lock_guard<std::mutex>
-            g(stream_mutex);
+            program.print(tb->data, snapshot);
+            full = tb->data.size() >= buffer_size;
+        }
 
-        get_stream() << os.str();
+        if (full)
+            flush_thread_buffer(tb, false);
     }
 
     void post_init(Caliper* c) {
@@ -194,7 +458,14 @@ class TextLogService
         if (formatstr.size() == 0)
             formatstr = create_default_formatstring(trigger_attr_names);
 
-        formatter.reset(formatstr);
+        program.compile(formatstr, c);
+
+        for (size_t i = 0; i < trigger_attr_names.size(); ++i) {
+            Attribute attr = c->get_attribute(trigger_attr_names[i]);
+
+            if (attr != Attribute::invalid && !attr.skip_events())
+                trigger_attr_ids[i].store(attr.id());
+        }
 
         set_event_attr = c->get_attribute("cali.snapshot.event.set");
         end_event_attr = c->get_attribute("cali.snapshot.event.end");
@@ -205,6 +476,19 @@ class TextLogService
                 "    disabling text log.\n" << std::endl;
     }
 
+    void release_scope(Caliper* c, cali_context_scope_t scope) {
+        // release_scope for a thread is invoked from the exiting thread
+        if (!(scope & CALI_SCOPE_THREAD) || !t_buffer)
+            return;
+
+        flush_thread_buffer(t_buffer, true);
+        t_buffer = nullptr;
+    }
+
+    void finish(Caliper* c) {
+        flush_all_buffers();
+    }
+
     // static callbacks
 
     static void create_attr_cb(Caliper* c, const Attribute& attr) {
@@ -215,29 +499,55 @@ class TextLogService
         s_textlog->process_snapshot(c, trigger_info, snapshot);
     }
 
-    static void post_init_cb(Caliper* c) { 
+    static void post_init_cb(Caliper* c) {
         s_textlog->post_init(c);
     }
 
+    static void release_scope_cb(Caliper* c, cali_context_scope_t scope) {
+        s_textlog->release_scope(c, scope);
+    }
+
+    static void finish_cb(Caliper* c) {
+        s_textlog->finish(c);
+    }
+
     TextLogService(Caliper* c)
         : config(RuntimeConfig::init("textlog", configdata)),
+          m_stream(Stream::None),
           set_event_attr(Attribute::invalid),
-          end_event_attr(Attribute::invalid)
-        { 
+          end_event_attr(Attribute::invalid),
+          buffer_size(config.get("buffer_size").to_uint()),
+          buffer_list(nullptr)
+        {
             init_stream();
 
-            util::split(config.get("trigger").to_string(), ':', 
+            util::split(config.get("trigger").to_string(), ':',
                         std::back_inserter(trigger_attr_names));
 
+            trigger_attr_ids.reset(new std::atomic<cali_id_t>[trigger_attr_names.size()]);
+
+            for (size_t i = 0; i < trigger_attr_names.size(); ++i)
+                trigger_attr_ids[i].store(CALI_INV_ID);
+
             c->events().create_attr_evt.connect(&TextLogService::create_attr_cb);
             c->events().post_init_evt.connect(&TextLogService::post_init_cb);
             c->events().process_snapshot.connect(&TextLogService::process_snapshot_cb);
+            c->events().release_scope_evt.connect(&TextLogService::release_scope_cb);
+            c->events().finish_evt.connect(&TextLogService::finish_cb);
 
             Log(1).stream() << "Registered text log service" << std::endl;
         }
 
 public:
 
+    ~TextLogService() {
+        for (ThreadBuffer* tb = buffer_list; tb; ) {
+            ThreadBuffer* next = tb->next;
+            delete tb;
+            tb = next;
+        }
+    }
+
     static void textlog_register(Caliper* c) {
         s_textlog.reset(new TextLogService(c));
     }
@@ -37,27 +37,217 @@
 
 #include <Caliper.h>
 #include <SnapshotRecord.h>
+#include <TaskContext.h>
 
 #include <RuntimeConfig.h>
 #include <ContextRecord.h>
 #include <Log.h>
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
-#include <map>
-#include <mutex>
+#include <ctime>
 #include <string>
 #include <type_traits>
 #include <vector>
 
+#include <time.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CALI_TIMESTAMP_HAVE_TSC
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 using namespace cali;
 using namespace std;
 
 namespace 
 {
 
+//
+// --- Clock sources
+//
+
+enum class ClockSource { Chrono, Monotonic, MonotonicRaw, TSC };
+
+ClockSource clock_source = ClockSource::Chrono;
+
+/// Divisor to convert nanoseconds into the output unit
+uint64_t    ns_per_unit  = 1000;
+/// Absolute time (nanoseconds since the UNIX epoch) at tstart
+uint64_t    tstart_epoch_ns = 0;
+
 chrono::time_point<chrono::high_resolution_clock> tstart;
 
+uint64_t    tstart_ns    = 0;
+
+#ifdef CALI_TIMESTAMP_HAVE_TSC
+/// TSC tick to output unit conversion: units = (ticks * tsc_mult) >> TscShift
+const unsigned TscShift  = 32;
+uint64_t    tsc_mult     = 0;
+uint64_t    tstart_tsc   = 0;
+
+bool tsc_is_invariant()
+{
+    unsigned eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000007)
+        return false;
+
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+
+    return (edx & (1u << 8)) != 0;
+}
+#endif
+
+inline uint64_t
+clock_gettime_ns(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+/// Difference between two clock readings, clamped to zero if the clock
+/// went backwards (e.g., a TSC that is not synchronized across cores)
+
+inline uint64_t
+clock_diff(uint64_t t1, uint64_t t0)
+{
+    return t1 > t0 ? t1 - t0 : 0;
+}
+
+/// Read the clock: returns time since tstart in the output unit
+
+inline uint64_t
+clock_now()
+{
+    switch (clock_source) {
+#ifdef CALI_TIMESTAMP_HAVE_TSC
+    case ClockSource::TSC:
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(clock_diff(__rdtsc(), tstart_tsc)) * tsc_mult) >> TscShift);
+#endif
+    case ClockSource::Monotonic:
+        return (clock_gettime_ns(CLOCK_MONOTONIC) - tstart_ns) / ns_per_unit;
+#ifdef CLOCK_MONOTONIC_RAW
+    case ClockSource::MonotonicRaw:
+        return (clock_gettime_ns(CLOCK_MONOTONIC_RAW) - tstart_ns) / ns_per_unit;
+#endif
+    default:
+    {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - tstart).count();
+        return ns > 0 ? static_cast<uint64_t>(ns) / ns_per_unit : 0;
+    }
+    }
+}
+
+/// Set up the clock source and start time
+
+void
+init_clock(const std::string& clockname, const std::string& unitname)
+{
+    if (unitname == "nsec")
+        ns_per_unit = 1;
+    else {
+        if (unitname != "usec")
+            Log(0).stream() << "Timestamp: Unknown time unit \"" << unitname
+                            << "\", using usec" << std::endl;
+
+        ns_per_unit = 1000;
+    }
+
+    const struct clock_info_t {
+        const char* name; ClockSource source;
+    } clock_info[] = {
+        { "chrono",        ClockSource::Chrono       },
+        { "monotonic",     ClockSource::Monotonic    },
+        { "monotonic_raw", ClockSource::MonotonicRaw },
+        { "tsc",           ClockSource::TSC          }
+    };
+
+    clock_source = ClockSource::Chrono;
+
+    bool found = false;
+
+    for (const clock_info_t& info : clock_info)
+        if (clockname == info.name) {
+            clock_source = info.source;
+            found = true;
+        }
+
+    if (!found)
+        Log(0).stream() << "Timestamp: Unknown clock \"" << clockname
+                        << "\", using chrono" << std::endl;
+
+#ifndef CLOCK_MONOTONIC_RAW
+    if (clock_source == ClockSource::MonotonicRaw) {
+        Log(0).stream() << "Timestamp: monotonic_raw clock not available, using monotonic" << std::endl;
+        clock_source = ClockSource::Monotonic;
+    }
+#endif
+
+    if (clock_source == ClockSource::TSC) {
+#ifdef CALI_TIMESTAMP_HAVE_TSC
+        if (!tsc_is_invariant())
+            Log(0).stream() << "Timestamp: Warning: TSC is not invariant, "
+                "timings may be inaccurate" << std::endl;
+
+        // Calibrate TSC against the monotonic clock
+
+        const uint64_t calibration_ns = 20000000; // 20 msec
+
+        uint64_t ns_0  = clock_gettime_ns(CLOCK_MONOTONIC);
+        uint64_t tsc_0 = __rdtsc();
+        uint64_t ns_1  = ns_0;
+
+        while (ns_1 - ns_0 < calibration_ns)
+            ns_1 = clock_gettime_ns(CLOCK_MONOTONIC);
+
+        uint64_t tsc_1 = __rdtsc();
+
+        if (tsc_1 > tsc_0) {
+            double   units_per_tick = 
+                static_cast<double>(ns_1 - ns_0) / (ns_per_unit * static_cast<double>(tsc_1 - tsc_0));
+
+            tsc_mult = static_cast<uint64_t>(units_per_tick * (1ull << TscShift) + 0.5);
+
+            Log(2).stream() << "Timestamp: TSC frequency is " 
+                            << static_cast<double>(tsc_1 - tsc_0) / (ns_1 - ns_0) << " GHz" << std::endl;
+        } else {
+            Log(0).stream() << "Timestamp: TSC calibration failed, using monotonic" << std::endl;
+            clock_source = ClockSource::Monotonic;
+        }
+#else
+        Log(0).stream() << "Timestamp: TSC clock not available, using monotonic" << std::endl;
+        clock_source = ClockSource::Monotonic;
+#endif
+    }
+
+    tstart       = chrono::high_resolution_clock::now();
+    tstart_epoch_ns = 
+        chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+
+    switch (clock_source) {
+    case ClockSource::Monotonic:
+        tstart_ns = clock_gettime_ns(CLOCK_MONOTONIC);
+        break;
+#ifdef CLOCK_MONOTONIC_RAW
+    case ClockSource::MonotonicRaw:
+        tstart_ns = clock_gettime_ns(CLOCK_MONOTONIC_RAW);
+        break;
+#endif
+#ifdef CALI_TIMESTAMP_HAVE_TSC
+    case ClockSource::TSC:
+        tstart_tsc = __rdtsc();
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
 Attribute timestamp_attr { Attribute::invalid } ;
 Attribute timeoffs_attr  { Attribute::invalid } ;
 Attribute snapshot_duration_attr { Attribute::invalid };
@@ -75,10 +265,19 @@ Attribute set_evt_attr   { Attribute::invalid };
 Attribute end_evt_attr   { Attribute::invalid };
 Attribute lvl_attr       { Attribute::invalid };
 
-typedef std::map<uint64_t, Attribute> OffsetAttributeMap;
+/// Start time of an active begin/end or set/set phase
+struct PhaseTimer {
+    uint64_t key;   ///< attribute id and nesting level, see make_phase_key()
+    uint64_t start;
+};
+
+/// Per-thread stack of active phase timers. Phases are usually properly
+/// nested, so lookups typically hit the top of the stack. Timers for
+/// task-scope attributes are kept in the active task context instead.
+thread_local std::vector<PhaseTimer> t_phase_timers;
 
-std::mutex         offset_attributes_mutex;
-OffsetAttributeMap offset_attributes;
+/// Number of task-scope phases not timed because the task context was full
+std::atomic<unsigned> num_dropped_task_timers { 0 };
 
 static const ConfigSet::Entry s_configdata[] = {
     { "snapshot_duration", CALI_TYPE_BOOL, "false",
@@ -97,11 +296,23 @@ static const ConfigSet::Entry s_configdata[] = {
       "Record inclusive duration of begin/end phases.",
       "Record inclusive duration of begin/end phases."
     },
+    { "clock", CALI_TYPE_STRING, "chrono",
+      "Clock source: chrono, monotonic, monotonic_raw, or tsc",
+      "Clock source. One of\n"
+      "  chrono:        C++ std::chrono::high_resolution_clock\n"
+      "  monotonic:     clock_gettime(CLOCK_MONOTONIC)\n"
+      "  monotonic_raw: clock_gettime(CLOCK_MONOTONIC_RAW)\n"
+      "  tsc:           x86 time-stamp counter, calibrated at start-up"
+    },
+    { "unit", CALI_TYPE_STRING, "usec",
+      "Time unit for offsets and durations: usec or nsec",
+      "Time unit for offsets and durations: usec or nsec"
+    },
     ConfigSet::Terminator
 };
 
 
-uint64_t make_offset_attribute_key(cali_id_t attr_id, unsigned level)
+inline uint64_t make_phase_key(cali_id_t attr_id, unsigned level)
 {
     // assert((level   & 0xFFFF)         == 0);
     // assert((attr_id & 0xFFFFFFFFFFFF) == 0);
@@ -111,69 +322,86 @@ uint64_t make_offset_attribute_key(cali_id_t attr_id, unsigned level)
     return lvl_k | attr_id;    
 }
 
-// Get or create a hidden offset attribute for the given attribute and its
-// current hierarchy level
+/// Find the innermost active phase timer for the given key on this thread.
+/// Returns t_phase_timers.end() if there is none.
 
-Attribute make_offset_attribute(Caliper* c, cali_id_t attr_id, unsigned level)
+inline std::vector<PhaseTimer>::iterator
+find_phase_timer(uint64_t key)
 {
-    uint64_t key = make_offset_attribute_key(attr_id, level);
-
-    {
-        std::lock_guard<std::mutex>  lock(offset_attributes_mutex);
-        OffsetAttributeMap::iterator it = offset_attributes.find(key);
-    
-        if (it != offset_attributes.end())
-            return it->second;
-    }
-
-    // Not found -> create new entry
-
-    std::string name = "offs.";
-    name.append(std::to_string(attr_id));
-    name.append(".");
-    name.append(std::to_string(level));
+    for (auto it = t_phase_timers.end(); it != t_phase_timers.begin(); --it)
+        if ((it-1)->key == key)
+            return it-1;
 
-    Attribute offs_attr = 
-        c->create_attribute(name, CALI_TYPE_UINT,
-                            CALI_ATTR_ASVALUE     |
-                            CALI_ATTR_SKIP_EVENTS |
-                            CALI_ATTR_HIDDEN      |
-                            CALI_ATTR_SCOPE_THREAD); // FIXME: needs to be original attribute's scope
+    return t_phase_timers.end();
+}
 
-    std::lock_guard<std::mutex> lock(offset_attributes_mutex);
-    offset_attributes.insert(std::make_pair(key, offs_attr));
+/// Update this thread's phase timer for the given begin/set/end event and
+/// append the phase duration to the snapshot record, if any.
 
-    return offs_attr;
+void update_phase_timer(cali_id_t event, uint64_t key, uint64_t now, SnapshotRecord* sbuf)
+{
+    auto it = find_phase_timer(key);
+
+    if (event == begin_evt_attr.id()) {
+        // begin event: save time for current entry
+
+        if (it != t_phase_timers.end())
+            it->start = now;
+        else
+            t_phase_timers.push_back(PhaseTimer { key, now });
+    } else if (event == set_evt_attr.id())   {
+        // set event: get saved time for current entry and calculate duration
+
+        if (it != t_phase_timers.end()) {
+            sbuf->append(phase_duration_attr.id(), Variant(clock_diff(now, it->start)));
+            it->start = now;
+        } else
+            t_phase_timers.push_back(PhaseTimer { key, now });
+    } else if (event == end_evt_attr.id())   {
+        // end event: get saved time for current entry and calculate duration
+
+        if (it != t_phase_timers.end()) {
+            sbuf->append(phase_duration_attr.id(), Variant(clock_diff(now, it->start)));
+            t_phase_timers.erase(it);
+        }
+    }
 }
 
-// Get existing hidden offset attribute for the given attribute and its
-// current hierarchy level
+/// Update the given task context's phase timer for the given begin/set/end
+/// event and append the phase duration to the snapshot record, if any.
 
-Attribute find_offset_attribute(Caliper* c, cali_id_t attr_id, unsigned level)
+void update_task_phase_timer(TaskContext* task, cali_id_t event, uint64_t key, uint64_t now, SnapshotRecord* sbuf)
 {
-    uint64_t key = make_offset_attribute_key(attr_id, level);
-
-    {
-        std::lock_guard<std::mutex>  lock(offset_attributes_mutex);
-        OffsetAttributeMap::iterator it = offset_attributes.find(key);
-    
-        if (it != offset_attributes.end())
-            return it->second;
+    uint64_t* start = task->find_timer(key);
+
+    if (event == begin_evt_attr.id()) {
+        if (start)
+            *start = now;
+        else if (!task->push_timer(key, now))
+            ++num_dropped_task_timers;
+    } else if (event == set_evt_attr.id())   {
+        if (start) {
+            sbuf->append(phase_duration_attr.id(), Variant(clock_diff(now, *start)));
+            *start = now;
+        } else if (!task->push_timer(key, now))
+            ++num_dropped_task_timers;
+    } else if (event == end_evt_attr.id())   {
+        if (start) {
+            sbuf->append(phase_duration_attr.id(), Variant(clock_diff(now, *start)));
+            task->erase_timer(start);
+        }
     }
-
-    return Attribute::invalid;
 }
 
 void snapshot_cb(Caliper* c, int scope, const SnapshotRecord* trigger_info, SnapshotRecord* sbuf) {
-    auto now = chrono::high_resolution_clock::now();
+    uint64_t usec = clock_now(); // in the configured unit (usec or nsec)
 
     if ((record_duration || record_phases || record_offset) && scope & CALI_SCOPE_THREAD) {
-        uint64_t  usec = chrono::duration_cast<chrono::microseconds>(now - tstart).count();
         Variant v_usec = Variant(usec);
         Variant v_offs = c->exchange(timeoffs_attr, v_usec);
 
         if (record_duration && !v_offs.empty()) {
-            uint64_t duration = usec - v_offs.to_uint();
+            uint64_t duration = clock_diff(usec, v_offs.to_uint());
 
             sbuf->append(snapshot_duration_attr.id(), Variant(duration));
         }
@@ -181,8 +409,10 @@ void snapshot_cb(Caliper* c, int scope, const SnapshotRecord* trigger_info, Snap
         if (record_phases && trigger_info) {
             Entry event = trigger_info->get(begin_evt_attr);
 
-            cali_id_t evt_attr_id;
-            Variant   v_level;
+            cali_id_t    evt_attr_id;
+            Variant      v_level;
+            uint64_t     key;
+            TaskContext* task;
 
             if (event.is_empty())
                 event = trigger_info->get(set_evt_attr);
@@ -197,41 +427,22 @@ void snapshot_cb(Caliper* c, int scope, const SnapshotRecord* trigger_info, Snap
             if (evt_attr_id == CALI_INV_ID || v_level.empty())
                 goto record_phases_exit;
 
-            if (event.attribute() == begin_evt_attr.id()) {
-                // begin/set event: save time for current entry
-
-                c->set(make_offset_attribute(c, evt_attr_id, v_level.to_uint()), v_usec);
-            } else if (event.attribute() == set_evt_attr.id())   {
-                // set event: get saved time for current entry and calculate duration
-
-                Variant v_p_usec    = 
-                    c->exchange(make_offset_attribute(c, evt_attr_id, v_level.to_uint()), v_usec);
+            key  = make_phase_key(evt_attr_id, v_level.to_uint());
+            task = c->current_task();
 
-                if (!v_p_usec.empty())
-                    sbuf->append(phase_duration_attr.id(), Variant(usec - v_p_usec.to_uint()));
-            } else if (event.attribute() == end_evt_attr.id())   {
-                // end event: get saved time for current entry and calculate duration
-
-                Attribute offs_attr = 
-                    find_offset_attribute(c, evt_attr_id, v_level.to_uint());
-
-                if (offs_attr == Attribute::invalid)
-                    goto record_phases_exit;
-
-                Variant v_p_usec    = 
-                    c->exchange(offs_attr, Variant());
-
-                if (!v_p_usec.empty())
-                    sbuf->append(phase_duration_attr.id(), Variant(usec - v_p_usec.to_uint()));
-            }
+            if (task && (c->get_attribute(evt_attr_id).properties() & CALI_ATTR_SCOPE_MASK) == CALI_ATTR_SCOPE_TASK)
+                update_task_phase_timer(task, event.attribute(), key, usec, sbuf);
+            else
+                update_phase_timer(event.attribute(), key, usec, sbuf);
 record_phases_exit:
             ;
         }
     }
 
+    // Derive the absolute timestamp from the offset to avoid another clock call
     if (record_timestamp && (scope & CALI_SCOPE_PROCESS))
         sbuf->append(timestamp_attr.id(),
-                     Variant(static_cast<int>(chrono::system_clock::to_time_t(chrono::system_clock::now()))));
+                     Variant(static_cast<int>((tstart_epoch_ns + usec * ns_per_unit) / 1000000000ull)));
 }
 
 void post_init_cb(Caliper* c)
@@ -256,14 +467,22 @@ void post_init_cb(Caliper* c)
 }
 
 
+void finish_cb(Caliper* c)
+{
+    if (num_dropped_task_timers.load() > 0)
+        Log(1).stream() << "Timestamp: " << num_dropped_task_timers.load()
+                        << " task-scope regions not timed (too many active regions in task context)" 
+                        << std::endl;
+}
+
 /// Initialization handler
 void timestamp_service_register(Caliper* c)
 {
-    // set start time and create time attribute
-    tstart = chrono::high_resolution_clock::now();
-
     config = RuntimeConfig::init("timer", s_configdata);
 
+    // set start time and create time attribute
+    init_clock(config.get("clock").to_string(), config.get("unit").to_string());
+
     record_duration  = config.get("snapshot_duration").to_bool();
     record_offset    = config.get("offset").to_bool();
     record_timestamp = config.get("timestamp").to_bool();
@@ -274,7 +493,8 @@ void timestamp_service_register(Caliper* c)
     Attribute aggr_class_attr = 
         c->get_attribute("class.aggregatable");
 
-    Variant   usec_val  = Variant(CALI_TYPE_STRING, "usec", 4);
+    Variant   usec_val  = 
+        ns_per_unit == 1 ? Variant(CALI_TYPE_STRING, "nsec", 4) : Variant(CALI_TYPE_STRING, "usec", 4);
     Variant   sec_val   = Variant(CALI_TYPE_STRING, "sec",  3);
     Variant   true_val  = Variant(true);
     
@@ -313,6 +533,7 @@ void timestamp_service_register(Caliper* c)
     // c->events().create_attr_evt.connect(&create_attr_cb);
     c->events().post_init_evt.connect(&post_init_cb);
     c->events().snapshot.connect(&snapshot_cb);
+    c->events().finish_evt.connect(&finish_cb);
 
     Log(1).stream() << "Registered timestamp service" << endl;
 }
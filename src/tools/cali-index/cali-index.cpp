@@ -0,0 +1,147 @@
+// Copyright (c) 2016, Lawrence Livermore National Security, LLC.
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// @file cali-index.cpp
+/// A tool that builds sidecar index files for .cali files
+
+#include <Args.h>
+
+#include <CaliIndex.h>
+
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace cali;
+using namespace std;
+using namespace util;
+
+namespace
+{
+    const char* usage = "cali-index [OPTION]... FILE..."
+        "\n  Build index files for Caliper streams to speed up selective queries";
+
+    const Args::Table option_table[] = { 
+        // name, longopt name, shortopt char, has argument, info, argument info
+        { "block-size", "block-size", 'b', true,
+          "Number of snapshot records per index block (default 4096)",
+          "NUMBER"
+        },
+        { "threads", "threads", 0, true,
+          "Use this many threads (applicable only with multiple files)",
+          "THREADS"
+        },
+        { "help",   "help",   'h', false, "Print help message",       nullptr },
+        Args::Table::Terminator
+    };
+}
+
+
+//
+// --- main()
+//
+
+int main(int argc, const char* argv[])
+{
+    Args args(::option_table);
+
+    //
+    // --- Parse command line arguments
+    //
+
+    {
+        int i = args.parse(argc, argv);
+
+        if (i < argc) {
+            cerr << "cali-index: error: unknown option: " << argv[i] << '\n'
+                 << "  Available options: ";
+
+            args.print_available_options(cerr);
+            
+            return -1;
+        }
+
+        if (args.is_set("help")) {
+            cerr << usage << "\n\n";
+
+            args.print_available_options(cerr);
+
+            return 0;
+        }
+    }
+
+    std::vector<std::string> files = args.arguments();
+
+    if (files.empty()) {
+        cerr << "cali-index: error: no input files given" << endl;
+        return -1;
+    }
+
+    std::size_t block_size  = std::stoul(args.get("block-size", "4096"));
+    unsigned    num_threads =
+        std::min<unsigned>(files.size(), std::stoul(args.get("threads", "4")));
+
+    //
+    // --- Build indexes
+    //
+
+    std::atomic<unsigned> index(0);
+    std::atomic<int>      errors(0);
+    std::mutex            os_lock;
+
+    auto thread_fn = [&]() {
+        for (unsigned i = index++; i < files.size(); i = index++) {
+            if (CaliIndex(files[i]).build(block_size))
+                continue;
+
+            ++errors;
+
+            std::lock_guard<std::mutex>
+                g(os_lock);
+
+            cerr << "cali-index: could not index file " << files[i] << endl;
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (unsigned t = 0; t < num_threads; ++t)
+        threads.emplace_back(thread_fn);
+
+    for (auto &t : threads)
+        t.join();
+
+    return errors.load() > 0 ? -2 : 0;
+}
@@ -0,0 +1,375 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+/// @file cali-netrecv.cpp
+/// A simple receiver for the netout service's batched binary stream
+
+#include "caliper-config.h"
+
+#include <Args.h>
+
+#include <ContextRecord.h>
+#include <NetBatch.h>
+#include <Node.h>
+
+#include <csv/CsvSpec.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifdef CALIPER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace cali;
+using namespace std;
+using namespace util;
+
+namespace
+{
+    const char* usage = "cali-netrecv [OPTION]..."
+        "\n  Receive snapshot batches from the Caliper netout service and write them as .cali stream";
+
+    const Args::Table option_table[] = { 
+        // name, longopt name, shortopt char, has argument, info, argument info
+        { "listen", "listen", 'l', true,
+          "Listen on this endpoint: tcp:[host:]port or unix:path",
+          "ENDPOINT"
+        },
+        { "output", "output", 'o', true,  
+          "Set the output file name. \"%n\" is replaced with the connection number.",
+          "FILE"
+        },
+        { "once",   "once",   0,   false, 
+          "Exit after the first connection is closed", 
+          nullptr 
+        },
+        { "help",   "help",   'h', false, "Print help message",       nullptr },
+        Args::Table::Terminator
+    };
+
+    int listen_endpoint(const std::string& endpoint) {
+        if (endpoint.compare(0, 5, "unix:") == 0) {
+            std::string path = endpoint.substr(5);
+            struct sockaddr_un addr;
+
+            if (path.size() >= sizeof(addr.sun_path))
+                return -1;
+
+            std::memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+
+            unlink(path.c_str());
+
+            int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+
+            if (sock < 0)
+                return -1;
+            if (bind(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 || listen(sock, 16) != 0) {
+                close(sock);
+                return -1;
+            }
+
+            return sock;
+        }
+
+        if (endpoint.compare(0, 4, "tcp:") == 0) {
+            std::string hostport = endpoint.substr(4);
+            std::string host;
+            std::string port     = hostport;
+            auto        p        = hostport.rfind(':');
+
+            if (p != std::string::npos) {
+                host = hostport.substr(0, p);
+                port = hostport.substr(p+1);
+            }
+
+            struct addrinfo hints;
+            struct addrinfo *res = nullptr;
+
+            std::memset(&hints, 0, sizeof(hints));
+            hints.ai_family   = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags    = AI_PASSIVE;
+
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &res) != 0)
+                return -1;
+
+            int sock = -1;
+
+            for (struct addrinfo* ai = res; ai; ai = ai->ai_next) {
+                sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+
+                if (sock < 0)
+                    continue;
+
+                int on = 1;
+                setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+                if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0 && listen(sock, 16) == 0)
+                    break;
+
+                close(sock);
+                sock = -1;
+            }
+
+            freeaddrinfo(res);
+
+            return sock;
+        }
+
+        return -1;
+    }
+
+    bool recv_all(int sock, unsigned char* buf, size_t size) {
+        while (size > 0) {
+            ssize_t n = recv(sock, buf, size, 0);
+
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+
+            buf  += n;
+            size -= n;
+        }
+
+        return true;
+    }
+
+    void write_node(std::ostream& os, cali_id_t id, cali_id_t attr, cali_id_t parent, const Variant& data) {
+        int n[] = { 1, 1, 1, (parent == CALI_INV_ID ? 0 : 1) };
+
+        Variant  v_id     { static_cast<uint64_t>(id)     };
+        Variant  v_attr   { static_cast<uint64_t>(attr)   }; 
+        Variant  v_parent { static_cast<uint64_t>(parent) };
+
+        const Variant* rec[] = { &v_id, &v_attr, &data, &v_parent };
+
+        CsvSpec::write_record(os, Node::record_descriptor(), n, rec);
+    }
+
+    void write_snapshot(std::ostream& os, size_t n_nodes, const cali_id_t node_ids[], 
+                        size_t n_imm, const cali_id_t attr[], const Variant data[]) {
+        std::vector<Variant> node_vec;
+        std::vector<Variant> attr_vec;
+
+        for (size_t i = 0; i < n_nodes; ++i)
+            node_vec.push_back(Variant(static_cast<uint64_t>(node_ids[i])));
+        for (size_t i = 0; i < n_imm; ++i)
+            attr_vec.push_back(Variant(static_cast<uint64_t>(attr[i])));
+
+        int            n[3]   = { static_cast<int>(n_nodes), static_cast<int>(n_imm), static_cast<int>(n_imm) };
+        const Variant* rec[3] = { node_vec.data(), attr_vec.data(), data };
+
+        CsvSpec::write_record(os, ContextRecord::record_descriptor(), n, rec);
+    }
+
+    /// Receive batches from \a sock until the connection is closed.
+    /// Returns the number of batches received, or -1 on error.
+    long receive(int sock, std::ostream& os) {
+        long num_batches = 0;
+
+        std::vector<unsigned char> payload;
+        std::vector<unsigned char> raw;
+
+        while (true) {
+            unsigned char    hbuf[netbatch::HeaderSize];
+            netbatch::Header header;
+
+            if (!recv_all(sock, hbuf, netbatch::HeaderSize))
+                break; // connection closed
+
+            if (!netbatch::read_header(hbuf, &header)) {
+                cerr << "cali-netrecv: error: invalid batch header" << endl;
+                return -1;
+            }
+
+            payload.resize(header.payload_size);
+
+            if (!recv_all(sock, payload.data(), payload.size())) {
+                cerr << "cali-netrecv: error: incomplete batch" << endl;
+                return -1;
+            }
+
+            const unsigned char* buf  = payload.data();
+            size_t               size = payload.size();
+
+            if (header.flags & netbatch::Compressed) {
+#ifdef CALIPER_HAVE_ZLIB
+                uLongf len = header.raw_size;
+                raw.resize(len);
+
+                if (uncompress(raw.data(), &len, payload.data(), payload.size()) != Z_OK) {
+                    cerr << "cali-netrecv: error: could not decompress batch" << endl;
+                    return -1;
+                }
+
+                buf  = raw.data();
+                size = len;
+#else
+                cerr << "cali-netrecv: error: received compressed batch, but zlib is not available" << endl;
+                return -1;
+#endif
+            }
+
+            bool ok = netbatch::decode(buf, size,
+                                       [&os](cali_id_t id, cali_id_t attr, cali_id_t parent, const Variant& data) {
+                                           write_node(os, id, attr, parent, data);
+                                       },
+                                       [&os](size_t n, const cali_id_t ids[], size_t m, const cali_id_t attr[], const Variant data[]) {
+                                           write_snapshot(os, n, ids, m, attr, data);
+                                       });
+
+            if (!ok) {
+                cerr << "cali-netrecv: error: malformed batch" << endl;
+                return -1;
+            }
+
+            os.flush();
+            ++num_batches;
+        }
+
+        return num_batches;
+    }
+}
+
+
+//
+// --- main()
+//
+
+int main(int argc, const char* argv[])
+{
+    Args args(::option_table);
+
+    //
+    // --- Parse command line arguments
+    //
+
+    {
+        int i = args.parse(argc, argv);
+
+        if (i < argc) {
+            cerr << "cali-netrecv: error: unknown option: " << argv[i] << '\n'
+                 << "  Available options: ";
+
+            args.print_available_options(cerr);
+            
+            return -1;
+        }
+
+        if (args.is_set("help")) {
+            cerr << usage << "\n\n";
+
+            args.print_available_options(cerr);
+
+            return 0;
+        }
+    }
+
+    if (!args.is_set("listen")) {
+        cerr << "cali-netrecv: error: no endpoint given (use --listen)" << endl;
+        return -1;
+    }
+
+    std::string endpoint = args.get("listen");
+    std::string filename = args.get("output", "stdout");
+
+    int lsock = ::listen_endpoint(endpoint);
+
+    if (lsock < 0) {
+        cerr << "cali-netrecv: error: could not listen on " << endpoint << ": " << strerror(errno) << endl;
+        return -1;
+    }
+
+    //
+    // --- Receive data
+    //
+
+    for (unsigned conn = 0; ; ++conn) {
+        int sock = accept(lsock, nullptr, nullptr);
+
+        if (sock < 0) {
+            if (errno == EINTR)
+                continue;
+
+            cerr << "cali-netrecv: error: accept failed: " << strerror(errno) << endl;
+            break;
+        }
+
+        long num_batches = 0;
+
+        if (filename == "stdout") {
+            num_batches = ::receive(sock, cout);
+        } else {
+            std::string name = filename;
+            auto        p    = name.find("%n");
+
+            if (p != std::string::npos)
+                name.replace(p, 2, std::to_string(conn));
+
+            ofstream fs(name.c_str(), conn == 0 || p != std::string::npos ? ios::out : ios::app);
+
+            if (!fs)
+                cerr << "cali-netrecv: error: could not open output file " << name << endl;
+            else
+                num_batches = ::receive(sock, fs);
+        }
+
+        close(sock);
+
+        cerr << "cali-netrecv: connection " << conn << ": received " << num_batches << " batches" << endl;
+
+        if (args.is_set("once"))
+            break;
+    }
+
+    close(lsock);
+
+    if (endpoint.compare(0, 5, "unix:") == 0)
+        unlink(endpoint.substr(5).c_str());
+
+    return 0;
+}
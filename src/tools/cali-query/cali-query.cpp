@@ -40,12 +40,14 @@
 #include "Annotation.h"
 
 #include "Aggregator.h"
+#include "CaliIndex.h"
 #include "CaliperMetadataDB.h"
 #include "Expand.h"
 #include "Format.h"
 #include "RecordProcessor.h"
 #include "RecordSelector.h"
 #include "Table.h"
+#include "TopK.h"
 #include "Json.h"
 
 #include "ContextRecord.h"
@@ -57,12 +59,19 @@
 
 #include <util/split.hpp>
 
+#include <sys/stat.h>
+
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <fstream>
+#include <future>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <mutex>
 #include <sstream>
+#include <stdexcept>
 #include <thread>
 
 using namespace cali;
@@ -101,6 +110,10 @@ namespace
           "Sort rows in table format: attribute[:...]", 
           "SORT_ATTRIBUTES" 
         },
+        { "top", "top", 0, true,
+          "Only output the N snapshots with the largest values of the --sort-by attributes",
+          "N"
+        },
 	{ "format", "format", 'f', true,
           "Format output according to format string: %[<width+alignment(l|r|c)>]attr_name%...",
           "FORMAT_STRING"
@@ -118,7 +131,7 @@ namespace
           "ATTRIBUTES"
         },
         { "threads", "threads", 0, true,
-          "Use this many threads (applicable only with multiple files)",
+          "Use this many threads (applicable with multiple or large files)",
           "THREADS"
         },
         { "output", "output", 'o', true,  "Set the output file name", "FILE"  },
@@ -202,6 +215,38 @@ namespace
             m_filter_fn(db, node, m_push_fn);
         }
     };
+
+    /// Files larger than this may be split into byte ranges processed by different threads
+    const std::size_t MinRangeSize = 16 * 1024 * 1024;
+
+    /// Shared state of a file that is processed in byte ranges
+    struct SplitFile {
+        IdMap               idmap;          ///< Written by the metadata pass only
+        std::promise<void>  metadata_done;
+        std::shared_future<void> metadata_ready;
+
+        SplitFile()
+            : metadata_ready { metadata_done.get_future().share() }
+            { }
+    };
+
+    /// A unit of work for the thread pool
+    struct WorkItem {
+        enum Kind { 
+            File,       ///< Process a whole file (or stdin)
+            Metadata,   ///< Merge the node records of a split file
+            Range       ///< Process the snapshot records in a byte range of a split file
+        }           kind;
+        unsigned    file;
+        std::size_t begin;
+        std::size_t end;
+        std::size_t size;   ///< Scheduling weight
+        SplitFile*  split;
+    };
+
+    inline bool is_node_line(const std::string& line) {
+        return line.compare(0, 10, "__rec=node") == 0;
+    }
 }
 
 
@@ -273,7 +318,19 @@ int main(int argc, const char* argv[])
     // --- Build up processing chain (from back to front)
     //
 
-    Table             tbl_writer(args.get("attributes"), args.get("sort"));
+    unsigned top_k = 0;
+
+    if (args.is_set("top")) {
+        top_k = std::stoul(args.get("top", "0"));
+
+        if (args.get("sort").empty()) {
+            cerr << "cali-query: --top requires --sort-by" << endl;
+            return -2;
+        }
+    }
+
+    // Top-k results are pushed in descending order: don't re-sort them in the table
+    Table             tbl_writer(args.get("attributes"), top_k > 0 ? "" : args.get("sort"));
     Json              jsn_writer(args.get("attributes"));
 
     NodeProcessFn     node_proc   = [](CaliperMetadataAccessInterface&,const Node*) { return; };
@@ -305,16 +362,38 @@ int main(int argc, const char* argv[])
         node_proc   = writer;
     }
 
+    TopK              topk(top_k, args.get("sort"));
+    SnapshotProcessFn snap_out(top_k > 0 ? topk : snap_writer);
+
     Aggregator        aggregate(args.get("aggregate"), args.get("aggregate-key"));
-    SnapshotProcessFn snap_proc(args.is_set("aggregate") ? aggregate : snap_writer);
+    SnapshotProcessFn snap_proc(args.is_set("aggregate") ? aggregate : snap_out);
 
-    string select = args.get("select");
+    string         select = args.get("select");
+    RecordSelector selector(select);
 
     if (!select.empty())
-        snap_proc = ::SnapshotFilterStep(RecordSelector(select), snap_proc);
+        snap_proc = ::SnapshotFilterStep(selector, snap_proc);
     else if (args.is_set("select"))
         cerr << "cali-query: Arguments required for --select" << endl;
 
+    // With an up-to-date index file, skip blocks that can't match the selection
+    CaliIndex::BlockFilterFn block_filter =
+        [&selector](const CaliIndex::RangeMap& ranges) {
+            return selector.may_pass([&ranges](const std::string& name, Variant& min, Variant& max) {
+                    auto it = ranges.find(name);
+
+                    if (it == ranges.end())
+                        return false;
+
+                    if (!it->second.min.empty() && !it->second.max.empty()) {
+                        min = Variant::from_string(it->second.type, it->second.min.c_str());
+                        max = Variant::from_string(it->second.type, it->second.max.c_str());
+                    }
+
+                    return true;
+                });
+        };
+
     if (args.is_set("list-attributes")) {
         node_proc = AttributeExtract(snap_proc);
         snap_proc = [](CaliperMetadataAccessInterface&,const EntryList&){ return; };
@@ -327,8 +406,79 @@ int main(int argc, const char* argv[])
     if (files.empty())
         files.push_back(""); // read from stdin if no files are given
     
+    //
+    // --- Schedule work
+    //
+
+    // Process the largest files first. With multiple threads, large files are
+    // split into byte ranges: a metadata pass merges the file's node records,
+    // after which the snapshot records in each range can be processed in 
+    // parallel using the file's (then read-only) id map. This is only done
+    // for aggregation, top-k, and sorted table output, where the order in
+    // which snapshots arrive does not matter.
+
+    std::vector<std::size_t> file_sizes(files.size(), 0);
+    std::size_t total_size = 0;
+
+    for (std::vector<std::string>::size_type i = 0; i < files.size(); ++i) {
+        struct stat st;
+
+        if (!files[i].empty() && stat(files[i].c_str(), &st) == 0)
+            file_sizes[i] = static_cast<std::size_t>(st.st_size);
+
+        total_size += file_sizes[i];
+    }
+
+    // Ranges of a split file are read concurrently, so snapshots arrive out
+    // of order: only split files if the output doesn't depend on the order
+    bool order_insensitive = 
+        args.is_set("aggregate") || top_k > 0 || (args.is_set("table") && !args.get("sort").empty());
+
+    // Use more threads than files only if there are large files to split
     unsigned num_threads =
-        std::min<unsigned>(files.size(), std::stoul(args.get("threads", "4")));
+        std::min<std::size_t>(std::stoul(args.get("threads", "4")),
+                              std::max<std::size_t>(files.size(), order_insensitive ? total_size / MinRangeSize : 0));
+
+    num_threads = std::max(num_threads, 1u);
+
+    const std::size_t range_size =
+        std::max<std::size_t>(MinRangeSize, total_size / (4 * num_threads));
+
+    std::vector< std::unique_ptr<SplitFile> > split_files;
+    std::vector<WorkItem> meta_items;
+    std::vector<WorkItem> data_items;
+
+    for (std::vector<std::string>::size_type i = 0; i < files.size(); ++i) {
+        std::size_t size = file_sizes[i];
+
+        // Files with an index are read through the index as a whole
+        bool split = order_insensitive && num_threads > 1 && size > range_size &&
+            (select.empty() || !std::ifstream(CaliIndex::index_filename(files[i]).c_str()));
+
+        if (!split) {
+            data_items.push_back(WorkItem { WorkItem::File, static_cast<unsigned>(i), 0, size, size, nullptr });
+            continue;
+        }
+
+        split_files.emplace_back(new SplitFile);
+        SplitFile* sf = split_files.back().get();
+
+        meta_items.push_back(WorkItem { WorkItem::Metadata, static_cast<unsigned>(i), 0, size, size, sf });
+
+        for (std::size_t begin = 0; begin < size; begin += range_size) {
+            std::size_t end = std::min(begin + range_size, size);
+            data_items.push_back(WorkItem { WorkItem::Range, static_cast<unsigned>(i), begin, end, end - begin, sf });
+        }
+    }
+
+    // Metadata passes go first so that range items never wait on unscheduled work
+    std::stable_sort(meta_items.begin(), meta_items.end(),
+                     [](const WorkItem& a, const WorkItem& b) { return a.size > b.size; });
+    std::stable_sort(data_items.begin(), data_items.end(),
+                     [](const WorkItem& a, const WorkItem& b) { return a.size > b.size; });
+
+    std::vector<WorkItem> work_items(meta_items);
+    work_items.insert(work_items.end(), data_items.begin(), data_items.end());
 
     std::cerr << "cali-query: processing " << files.size() << " files using "
               << num_threads << " thread" << (num_threads == 1 ? "." : "s.")  << std::endl;
@@ -344,20 +494,104 @@ int main(int argc, const char* argv[])
     CaliperMetadataDB     metadb;
     std::atomic<unsigned> index(0);
     
+    // Process one work item. Range items must only be started once their
+    // file's metadata pass is done.
+    auto process_item = [&](const WorkItem& item, std::size_t& bytes) {
+        const std::string& file = files[item.file];
+
+        Annotation::Guard 
+            g_s(Annotation("cali-query.stream").set(file.empty() ? "stdin" : file.c_str()));
+
+        if (item.kind == WorkItem::Metadata) {
+            Annotation::Guard 
+                g_w(Annotation("cali-query.work").set("metadata"));
+
+            auto rec_fn = [&](const RecordMap& rec){ metadb.merge(rec, item.split->idmap, node_proc, snap_proc); };
+
+            // Pass errors on to the range items of this file: they can't
+            // proceed without the file's id map
+            try {
+                if (!CsvReader(file).read(0, item.end, ::is_node_line, rec_fn))
+                    throw std::runtime_error("could not read file");
+
+                item.split->metadata_done.set_value();
+            } catch (std::exception& e) {
+                cerr << "cali-query: error: " << file << ": " << e.what() << endl;
+                item.split->metadata_done.set_exception(std::current_exception());
+            }
+
+            return;
+        } else if (item.kind == WorkItem::Range) {
+            Annotation::Guard 
+                g_w(Annotation("cali-query.work").set("range"));
+
+            auto rec_fn = [&](const RecordMap& rec){ metadb.merge(rec, item.split->idmap, node_proc, snap_proc); };
+
+            CsvReader(file).read(item.begin, item.end, 
+                                 [](const std::string& line) { return !::is_node_line(line); }, 
+                                 rec_fn);
+
+            bytes += item.size;
+            return;
+        }
+
+        Annotation::Guard 
+            g_w(Annotation("cali-query.work").set("file"));
+            
+        IdMap     idmap;
+        auto      rec_fn = [&](const RecordMap& rec){ metadb.merge(rec, idmap, node_proc, snap_proc); };
+
+        bytes += item.size;
+
+        if (!select.empty() && !file.empty()) {
+            CaliIndex index(file);
+
+            if (index.load()) {
+                std::size_t skipped = 0;
+
+                if (!index.read(block_filter, rec_fn, &skipped))
+                    cerr << "Could not read file " << file << endl;
+
+                Annotation("cali-query.index.skipped-blocks").set(static_cast<int>(skipped));
+
+                return;
+            }
+        }
+
+        CsvReader reader(file);
+
+        if (!reader.read(rec_fn))
+            cerr << "Could not read file " << file << endl;
+    };
+
     auto thread_fn = [&](unsigned t) {
         Annotation::Guard
             g_t(Annotation("thread").set(static_cast<int>(t)));
+
+        std::chrono::duration<double> busy(0);
+        std::size_t bytes = 0;
         
-        for (unsigned i = index++; i < files.size(); i = index++) { // "index++" is atomic read-mod-write 
-            Annotation::Guard 
-                g_s(Annotation("cali-query.stream").set(files[i].empty() ? "stdin" : files[i].c_str()));
-            
-            CsvReader reader(files[i]);
-            IdMap     idmap;
+        for (unsigned i = index++; i < work_items.size(); i = index++) { // "index++" is atomic read-mod-write 
+            const WorkItem& item = work_items[i];
+
+            // Waiting for the metadata pass does not count as busy time
+            if (item.kind == WorkItem::Range) {
+                try {
+                    item.split->metadata_ready.get();
+                } catch (...) {
+                    continue; // already reported by the metadata pass
+                }
+            }
+
+            auto start = std::chrono::steady_clock::now();
 
-            if (!reader.read([&](const RecordMap& rec){ metadb.merge(rec, idmap, node_proc, snap_proc); }))
-                cerr << "Could not read file " << files[i] << endl;
+            process_item(item, bytes);
+
+            busy += std::chrono::steady_clock::now() - start;
         }
+
+        Annotation("cali-query.thread.bytes").set(Variant(static_cast<uint64_t>(bytes)));
+        Annotation("cali-query.thread.time").set(busy.count());
     };
 
     std::vector<std::thread> threads;
@@ -378,7 +612,8 @@ int main(int argc, const char* argv[])
 
     a_phase.set("flush");
 
-    aggregate.flush(metadb, snap_writer);
+    aggregate.flush(metadb, snap_out);
+    topk.flush(metadb, snap_writer);
 
     if (args.is_set("table"))
         tbl_writer.flush(metadb, fs.is_open() ? fs : cout);
@@ -0,0 +1,114 @@
+// Copyright (c) 2015, Lawrence Livermore National Security, LLC.  
+// Produced at the Lawrence Livermore National Laboratory.
+//
+// This file is part of Caliper.
+// Written by David Boehme, boehme3@llnl.gov.
+// LLNL-CODE-678900
+// All rights reserved.
+//
+// For details, see https://github.com/scalability-llnl/Caliper.
+// Please also see the LICENSE file for our additional BSD notice.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the disclaimer below.
+//  * Redistributions in binary form must reproduce the above copyright notice, this list of
+//    conditions and the disclaimer (as noted below) in the documentation and/or other materials
+//    provided with the distribution.
+//  * Neither the name of the LLNS/LLNL nor the names of its contributors may be used to endorse
+//    or promote products derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// LAWRENCE LIVERMORE NATIONAL SECURITY, LLC, THE U.S. DEPARTMENT OF ENERGY OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Thread-scaling benchmark for Caliper annotation begin/end.
+//
+// Usage: cali-annotation-perftest [max_threads] [iterations]
+//
+// Runs the same begin/end loop with 1, 2, 4, ..., max_threads threads
+// and reports the time per begin/end pair. Use CALI_SERVICES_ENABLE to
+// select the services under test, e.g. CALI_SERVICES_ENABLE=event:pthread.
+
+#include <Annotation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+void annotation_loop(int iterations)
+{
+    cali::Annotation phase("perftest.phase");
+    cali::Annotation iter("perftest.iteration");
+
+    for (int i = 0; i < iterations; ++i) {
+        phase.begin("loop");
+        iter.begin(i % 16);
+        iter.end();
+        phase.end();
+    }
+}
+
+double run(int nthreads, int iterations)
+{
+    std::vector<std::thread> threads;
+
+    auto stime = std::chrono::steady_clock::now();
+
+    for (int t = 0; t < nthreads; ++t)
+        threads.emplace_back(annotation_loop, iterations);
+    for (std::thread& t : threads)
+        t.join();
+
+    auto etime = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(etime - stime).count();
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : std::thread::hardware_concurrency();
+    int iterations  = argc > 2 ? std::atoi(argv[2]) : 100000;
+
+    if (max_threads < 1)
+        max_threads = 1;
+
+    // initialize Caliper and warm up outside of the measurement
+    run(1, 100);
+
+    std::cout << std::setw(8) << "threads" 
+              << std::setw(12) << "time (s)" 
+              << std::setw(16) << "ns/begin+end" 
+              << std::setw(16) << "Mops/s total" << std::endl;
+
+    for (int nthreads = 1; ; nthreads = std::min(2*nthreads, max_threads)) {
+        double t   = run(nthreads, iterations);
+        double ops = 2.0 * nthreads * iterations; // two begin/end pairs per iteration
+
+        std::cout << std::setw(8)  << nthreads
+                  << std::setw(12) << std::fixed << std::setprecision(4) << t
+                  << std::setw(16) << std::setprecision(1) << (t * 1e9 * nthreads / ops)
+                  << std::setw(16) << std::setprecision(2) << (ops / t / 1e6)
+                  << std::endl;
+
+        if (nthreads == max_threads)
+            break;
+    }
+}
@@ -55,6 +55,44 @@ def run_test_with_query(target_cmd, query_cmd, env):
     return query_out
 
 
+def run_test(target_cmd, env):
+    """ Execute a command with the environment given by env, and return its stdout output """
+
+    target_proc = subprocess.Popen(target_cmd, env=env, stdout=subprocess.PIPE)
+    target_out, target_err = target_proc.communicate()
+
+    return target_out
+
+
+def get_table_from_text(table_output):
+    """ Translate the fixed-width table output of the `report` service into list of dicts
+
+        Takes input in the form 
+
+          attr1  attr2 
+          x          1
+                    12
+          ...
+
+        and converts it to `[ { 'attr1' : 'x', 'attr2' : '1' }, { 'attr1' : '', 'attr2' : '12' } ]`
+    """
+
+    lines  = table_output.decode().splitlines()
+    header = lines[0]
+
+    # a column starts where its name starts in the header
+    starts = [ i for i, c in enumerate(header) if c != ' ' and (i == 0 or header[i-1] == ' ') ]
+    names  = header.split()
+    bounds = list(zip(starts, starts[1:] + [ None ]))
+
+    rows = []
+
+    for line in lines[1:]:
+        rows.append( { name : line[b:e].strip() for name, (b, e) in zip(names, bounds) } )
+
+    return rows
+
+
 def get_snapshots_from_text(query_output):
     """ Translate expanded snapshots from `cali-query -e` output into list of dicts 
 
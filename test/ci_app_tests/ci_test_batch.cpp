@@ -0,0 +1,24 @@
+// --- Caliper continuous integration test app for batch updates
+
+#include <Annotation.h>
+#include <Variant.h>
+
+int main()
+{
+    cali::Annotation phase_ann("phase");
+    cali::Annotation region_ann("region");
+    cali::Annotation iter_ann("iteration", CALI_ATTR_ASVALUE);
+
+    cali::Annotation* anns[] = { &phase_ann, &region_ann, &iter_ann };
+
+    for (int i = 0; i < 4; ++i) {
+        cali::Variant data[] = { 
+            cali::Variant(CALI_TYPE_STRING, "loop", 4), 
+            cali::Variant(CALI_TYPE_STRING, "body", 4), 
+            cali::Variant(i) 
+        };
+
+        cali::Annotation::begin_batch(3, anns, data);
+        cali::Annotation::end_batch(3, anns);
+    }
+}
@@ -0,0 +1,65 @@
+// --- Caliper continuous integration test app for the sampler service
+
+#include <Annotation.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+
+std::atomic<bool> worker_ready { false };
+
+/// Spin for the given time, with frequent Caliper updates in between so
+/// that some samples interrupt Caliper operations
+double busy_loop(cali::Annotation& iter_ann, std::chrono::milliseconds msec)
+{
+    auto   start = std::chrono::steady_clock::now();
+    double res   = 0.0;
+
+    for (int i = 0; std::chrono::steady_clock::now() - start < msec; ++i) {
+        iter_ann.set(i);
+
+        for (int j = 0; j < 20000; ++j)
+            res += 0.5 * j;
+    }
+
+    return res;
+}
+
+}
+
+int main()
+{
+    // The worker stays in its region until the program exits, so its last
+    // buffered samples can only be processed by the final flush on the main
+    // thread.
+    std::thread worker([](){
+            cali::Annotation("region").begin("worker");
+
+            cali::Annotation iter_ann("worker.iteration", CALI_ATTR_ASVALUE);
+            busy_loop(iter_ann, std::chrono::milliseconds(100));
+
+            worker_ready.store(true);
+
+            while (true)
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+        });
+
+    worker.detach();
+
+    cali::Annotation region_ann("region");
+
+    region_ann.begin("main");
+
+    cali::Annotation iter_ann("iteration", CALI_ATTR_ASVALUE);
+    double res = busy_loop(iter_ann, std::chrono::milliseconds(200));
+
+    while (!worker_ready.load())
+        std::this_thread::yield();
+
+    region_ann.end();
+
+    return res > 0.0 ? 0 : 1;
+}
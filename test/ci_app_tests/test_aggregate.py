@@ -89,5 +89,57 @@ class CaliperAggregationTest(unittest.TestCase):
         self.assertFalse(calitest.has_snapshot_with_keys(
             snapshots, [ 'aggregate.sum#time.inclusive.duration' ] ))
 
+    def test_report_aggregate(self):
+        target_cmd = [ './ci_test_basic' ]
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'    : 'event:report:timestamp:trace',
+            'CALI_REPORT_AGGREGATE'   : 'count:sum(time.inclusive.duration)',
+            'CALI_REPORT_ATTRIBUTES'  : 'phase:aggregate.count:time.inclusive.duration',
+            'CALI_REPORT_SORT_BY'     : 'aggregate.count',
+            'CALI_LOG_VERBOSITY'      : '0'
+        }
+
+        rows = calitest.get_table_from_text(calitest.run_test(target_cmd, caliper_config))
+
+        # one row per phase, with the sum in the source attribute's column
+        self.assertEqual(sorted(r['phase'] for r in rows), [ '', 'initialization', 'loop' ])
+
+        loop = [ r for r in rows if r['phase'] == 'loop' ][0]
+
+        self.assertEqual(loop['aggregate.count'], '9')
+        self.assertTrue(int(loop['time.inclusive.duration']) > 0)
+
+        counts = [ int(r['aggregate.count']) for r in rows ]
+        self.assertEqual(counts, sorted(counts))
+
+    def test_report_aggregate_sort(self):
+        target_cmd = [ './ci_test_aggregate' ]
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'    : 'event:report:timestamp:trace',
+            'CALI_REPORT_AGGREGATE'   : 'count:sum(time.inclusive.duration)',
+            'CALI_REPORT_ATTRIBUTES'  : 'loop.id:function:aggregate.count:time.inclusive.duration',
+            'CALI_REPORT_SORT_BY'     : 'aggregate.count',
+            'CALI_LOG_VERBOSITY'      : '0'
+        }
+
+        rows = calitest.get_table_from_text(calitest.run_test(target_cmd, caliper_config))
+        keys = [ (r['loop.id'], r['function']) for r in rows ]
+
+        # records are collapsed into one row per key
+        self.assertEqual(len(keys), len(set(keys)))
+
+        self.assertTrue(calitest.has_snapshot_with_attributes(
+            rows, { 'loop.id': 'A', 'function': 'foo', 'aggregate.count': '6' }))
+        self.assertTrue(calitest.has_snapshot_with_attributes(
+            rows, { 'loop.id': 'B', 'function': 'foo', 'aggregate.count': '4' }))
+
+        # numeric, not lexicographic order: 9 before 10
+        counts = [ int(r['aggregate.count']) for r in rows ]
+
+        self.assertEqual(counts, sorted(counts))
+        self.assertTrue(9 in counts and 10 in counts)
+
 if __name__ == "__main__":
     unittest.main()
@@ -59,6 +59,30 @@ class CaliperBasicTraceTest(unittest.TestCase):
                 'function'   : 'main/foo',
                 'loop'       : 'fooloop',
                 'iteration#fooloop' : 3 }))
+
+    def test_batch(self):
+        target_cmd = [ './ci_test_batch' ]
+        query_cmd  = [ '../../src/tools/cali-query/cali-query', '-e' ]
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'   : 'event:recorder:timestamp:trace',
+            'CALI_RECORDER_FILENAME' : 'stdout',
+            'CALI_LOG_VERBOSITY'     : '0'
+        }
+
+        query_output = calitest.run_test_with_query(target_cmd, query_cmd, caliper_config)
+        snapshots = calitest.get_snapshots_from_text(query_output)
+
+        # every attribute in the batch gets its own begin and end snapshots
+        for attr, values in [ ('phase',     [ 'loop' ] * 4 ),
+                              ('region',    [ 'body' ] * 4 ),
+                              ('iteration', [ str(i) for i in range(4) ]) ]:
+            begin = [ s['event.begin#' + attr] for s in snapshots if 'event.begin#' + attr in s ]
+            end   = [ s['event.end#'   + attr] for s in snapshots
+                        if 'event.end#' + attr in s and 'time.inclusive.duration' in s ]
+
+            self.assertEqual(begin, values)
+            self.assertEqual(end,   values)
         
     
 if __name__ == "__main__":
@@ -0,0 +1,82 @@
+# NetOut service tests: export snapshots to cali-netrecv
+
+import os
+import shutil
+import subprocess
+import tempfile
+import time
+import unittest
+
+import calipertest as calitest
+
+class CaliperNetOutTest(unittest.TestCase):
+    """ Caliper netout service test case """
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.tmpdir)
+
+    def get_reference_snapshots(self):
+        target_cmd = [ './ci_test_basic' ]
+        query_cmd  = [ '../../src/tools/cali-query/cali-query', '-e' ]
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'   : 'event:recorder:timestamp:trace',
+            'CALI_RECORDER_FILENAME' : 'stdout',
+            'CALI_LOG_VERBOSITY'     : '0'
+        }
+
+        query_output = calitest.run_test_with_query(target_cmd, query_cmd, caliper_config)
+        return calitest.get_snapshots_from_text(query_output)
+
+    def run_netout(self, export):
+        sockpath = os.path.join(self.tmpdir, 'netout.sock')
+        outfile  = os.path.join(self.tmpdir, 'netout.cali')
+
+        recv_cmd = [ '../../src/tools/cali-netrecv/cali-netrecv',
+                     '--listen', 'unix:' + sockpath, '--output', outfile, '--once' ]
+
+        recv_proc = subprocess.Popen(recv_cmd, stderr=subprocess.DEVNULL)
+
+        for i in range(100):
+            if os.path.exists(sockpath):
+                break
+            time.sleep(0.05)
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'   : 'event:netout:timestamp:trace',
+            'CALI_NETOUT_ENDPOINT'   : 'unix:' + sockpath,
+            'CALI_NETOUT_EXPORT'     : export,
+            'CALI_LOG_VERBOSITY'     : '0'
+        }
+
+        subprocess.check_call([ './ci_test_basic' ], env=caliper_config)
+        recv_proc.wait(timeout=30)
+
+        query_output = subprocess.check_output(
+            [ '../../src/tools/cali-query/cali-query', '-e', outfile ], stderr=subprocess.DEVNULL)
+
+        return calitest.get_snapshots_from_text(query_output)
+
+    def check_received(self, export):
+        reference = self.get_reference_snapshots()
+        received  = self.run_netout(export)
+
+        # each record is received exactly once
+        self.assertEqual(len(received), len(reference))
+
+        self.assertTrue(calitest.has_snapshot_with_keys(
+            received, {'iteration', 'phase', 'time.inclusive.duration'}))
+        self.assertTrue(calitest.has_snapshot_with_attributes(
+            received, {'event.end#iteration': '3', 'iteration': '3', 'phase': 'loop'}))
+
+    def test_export_snapshots(self):
+        self.check_received('snapshots')
+
+    def test_export_flush(self):
+        self.check_received('flush')
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,48 @@
+# Sampler service tests
+
+import unittest
+
+import calipertest as calitest
+
+class CaliperSamplerTest(unittest.TestCase):
+    """ Caliper sampler service test case """
+
+    def run_sampler(self, extra_config):
+        target_cmd = [ './ci_test_sampler' ]
+        query_cmd  = [ '../../src/tools/cali-query/cali-query', '-e' ]
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'   : 'event:recorder:sampler:trace',
+            'CALI_SAMPLER_FREQUENCY' : '1000',
+            'CALI_RECORDER_FILENAME' : 'stdout',
+            'CALI_LOG_VERBOSITY'     : '0'
+        }
+        caliper_config.update(extra_config)
+
+        query_output = calitest.run_test_with_query(target_cmd, query_cmd, caliper_config)
+        snapshots = calitest.get_snapshots_from_text(query_output)
+
+        samples = [ s for s in snapshots if 'cali.sampler.pc' in s ]
+
+        self.assertTrue(len(samples) > 10)
+
+        # samples carry the enclosing region of the main and the worker thread
+        self.assertTrue(calitest.has_snapshot_with_attributes(samples, { 'region': 'main'   }))
+        self.assertTrue(calitest.has_snapshot_with_attributes(samples, { 'region': 'worker' }))
+
+        return samples
+
+    def test_unbuffered(self):
+        samples = self.run_sampler({ 'CALI_SAMPLER_BUFFER_SIZE' : '0' })
+
+        # samples are processed in the signal handler: no late context
+        self.assertFalse(calitest.has_snapshot_with_keys(samples, { 'cali.sampler.late_context' }))
+
+    def test_buffered(self):
+        self.run_sampler({ 'CALI_SAMPLER_BUFFER_SIZE' : '32' })
+
+    def test_deferred(self):
+        self.run_sampler({ 'CALI_SAMPLER_BUFFER_SIZE' : '32', 'CALI_SAMPLER_DEFERRED' : 'true' })
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,57 @@
+# Timestamp service tests: clock sources and time units
+
+import unittest
+
+import calipertest as calitest
+
+class CaliperTimestampTest(unittest.TestCase):
+    """ Caliper timestamp service test case """
+
+    def run_with_clock(self, clock):
+        target_cmd = [ './ci_test_basic' ]
+        query_cmd  = [ '../../src/tools/cali-query/cali-query', '-e' ]
+
+        caliper_config = {
+            'CALI_SERVICES_ENABLE'   : 'event:recorder:timestamp:trace',
+            'CALI_TIMER_CLOCK'       : clock,
+            'CALI_TIMER_UNIT'        : 'nsec',
+            'CALI_TIMER_SNAPSHOT_DURATION'  : 'true',
+            'CALI_TIMER_INCLUSIVE_DURATION' : 'true',
+            'CALI_RECORDER_FILENAME' : 'stdout',
+            'CALI_LOG_VERBOSITY'     : '0'
+        }
+
+        query_output = calitest.run_test_with_query(target_cmd, query_cmd, caliper_config)
+        return calitest.get_snapshots_from_text(query_output)
+
+    def check_durations(self, snapshots):
+        self.assertTrue(len(snapshots) > 10)
+
+        for s in snapshots:
+            self.assertIn('time.duration', s)
+            self.assertGreaterEqual(int(s['time.duration']), 0)
+
+        # the snapshot durations within the loop phase add up to its 
+        # inclusive duration, which covers the iterations' inclusive durations
+        begin = [ i for i, s in enumerate(snapshots) if s.get('event.begin#phase') == 'loop' ]
+        end   = [ i for i, s in enumerate(snapshots) if s.get('event.end#phase')   == 'loop' ]
+
+        self.assertEqual(len(begin), 1)
+        self.assertEqual(len(end),   1)
+
+        loop_incl = int(snapshots[end[0]]['time.inclusive.duration'])
+        loop_sum  = sum(int(s['time.duration']) for s in snapshots[begin[0]+1:end[0]+1])
+        iter_sum  = sum(int(s['time.inclusive.duration']) for s in snapshots if 'event.end#iteration' in s)
+
+        self.assertGreater(loop_incl, 0)
+        self.assertLessEqual(abs(loop_sum - loop_incl), max(0.01 * loop_incl, 100))
+        self.assertLessEqual(iter_sum, loop_incl)
+
+    def test_tsc_nsec(self):
+        self.check_durations(self.run_with_clock('tsc'))
+
+    def test_monotonic_raw_nsec(self):
+        self.check_durations(self.run_with_clock('monotonic_raw'))
+
+if __name__ == "__main__":
+    unittest.main()